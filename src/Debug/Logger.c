@@ -6,19 +6,59 @@
 
 #include "../dyn.h"
 
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <strings.h>
 #include <time.h>
 
+/// The amount of messages that can wait to be written, must be a power of two
+#define LOG_RING_SIZE 4096
+/// The longest message that is kept, longer ones are cut off and end with "..."
+#define LOG_PAYLOAD_SIZE 256
+/// How long the writer thread sleeps when there is nothing to write
+#define LOG_IDLE_NS 2000000
+
+/// A message waiting to be written.
+///
+/// `seq` tells producers and the writer whose turn it is: a slot at ring position `pos` is free
+/// for the producer of `pos` when `seq == pos`, and holds a message for the writer when
+/// `seq == pos + 1`. This is Dmitry Vyukov's bounded queue, see
+/// https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+typedef struct
+{
+    atomic_size_t seq;
+    struct timespec time;
+    LOG_MESSAGE_TYPE level;
+    char payload[LOG_PAYLOAD_SIZE];
+} LogSlot;
+
 FILE* logStream;
+LOG_MESSAGE_TYPE logLevel = TRACE;
 
-char* now();
+static LogSlot logRing[LOG_RING_SIZE];
+/// The next ring position a producer takes
+static atomic_size_t logHead;
+/// The next ring position the writer reads, only touched by the writer thread
+static size_t logTail;
+/// The amount of messages dropped because the ring was full, since the writer last reported it
+static atomic_size_t logDropped;
+static atomic_bool logStopping;
+
+static pthread_once_t logOnce = PTHREAD_ONCE_INIT;
+static pthread_t logThread;
+static bool logThreadRunning;
 
 
 char* LOG_MSG_TYPE_TO_STRING(LOG_MESSAGE_TYPE msg_type)
 {
     switch (msg_type)
     {
+        case TRACE:
+            return "TRACE";
         case MESSAGE:
             return "MESSAGE";
         case WARNING:
@@ -30,44 +70,195 @@ char* LOG_MSG_TYPE_TO_STRING(LOG_MESSAGE_TYPE msg_type)
     }
 }
 
-void init_debug()
+void set_log_level(LOG_MESSAGE_TYPE level)
 {
-    logStream = fopen("debug.log", "w+");
-    debug_log(MESSAGE, "===========================================", 123);
-    debug_log(MESSAGE, "Log is running!", 123);
+    logLevel = level;
 }
 
-void debug_log(const LOG_MESSAGE_TYPE messageType, char* format, ...)
+bool log_level_from_string(const char* name, LOG_MESSAGE_TYPE* level)
 {
-    if (logStream == NULL)
-        init_debug();
-    va_list arg;
-    String msg = str_from("");
+    const LOG_MESSAGE_TYPE levels[] = {TRACE, MESSAGE, WARNING, ERROR};
+    for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++)
+    {
+        if (strcasecmp(name, LOG_MSG_TYPE_TO_STRING(levels[i])) == 0)
+        {
+            *level = levels[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void log_write_line(struct timespec time, LOG_MESSAGE_TYPE messageType, const char* message)
+{
+    // asctime format without its newline
+    struct tm timeInfo;
+    char timeStr[32];
+    localtime_r(&time.tv_sec, &timeInfo);
+    strftime(timeStr, sizeof(timeStr), "%a %b %e %H:%M:%S %Y", &timeInfo);
+
+    fprintf(logStream, "[%s][%s]: %s\n", timeStr, LOG_MSG_TYPE_TO_STRING(messageType), message);
+}
+
+/// Write every message in the ring, and get how many there were. Only called by the writer thread
+static size_t log_drain()
+{
+    size_t count = 0;
+    while (true)
+    {
+        LogSlot* slot = &logRing[logTail & (LOG_RING_SIZE - 1)];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != logTail + 1)
+            break;
+
+        log_write_line(slot->time, slot->level, slot->payload);
+
+        // Hand the slot back to the producers for its next lap around the ring
+        atomic_store_explicit(&slot->seq, logTail + LOG_RING_SIZE, memory_order_release);
+        logTail++;
+        count++;
+    }
+
+    const size_t dropped = atomic_exchange_explicit(&logDropped, 0, memory_order_relaxed);
+    if (dropped > 0)
+    {
+        struct timespec time;
+        clock_gettime(CLOCK_REALTIME, &time);
+
+        char message[64];
+        snprintf(message, sizeof(message), "%zu log messages were dropped", dropped);
+        log_write_line(time, WARNING, message);
+        count++;
+    }
 
-    char messageInfo[100];
-    sprintf(messageInfo, "[%s][%s]: ", now(), LOG_MSG_TYPE_TO_STRING(messageType));
-    str_append(&msg, messageInfo);
+    if (count > 0)
+        fflush(logStream);
+    return count;
+}
+
+/// The writer thread, which writes the messages in batches until the log is stopped
+static void* log_writer(void* arg)
+{
+    (void)arg;
+    const struct timespec idle = {.tv_sec = 0, .tv_nsec = LOG_IDLE_NS};
 
+    while (true)
+    {
+        // Read the flag before draining, so nothing logged before the stop is left behind
+        const bool stopping = atomic_load(&logStopping);
+        if (log_drain() == 0)
+        {
+            if (stopping)
+                break;
+            nanosleep(&idle, NULL);
+        }
+    }
+
+    return NULL;
+}
+
+/// Stop the writer thread once everything logged so far is written, run at exit
+static void log_stop()
+{
+    if (!logThreadRunning)
+        return;
+
+    atomic_store(&logStopping, true);
+    pthread_join(logThread, NULL);
+    logThreadRunning = false;
+}
+
+/// Enqueue a message, or count it as dropped if the ring is full
+static void log_push(LOG_MESSAGE_TYPE messageType, const char* format, va_list arg)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_REALTIME, &time);
+
+    size_t pos = atomic_load_explicit(&logHead, memory_order_relaxed);
+    LogSlot* slot;
+    while (true)
+    {
+        slot = &logRing[pos & (LOG_RING_SIZE - 1)];
+        const size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0)
+        {
+            // The slot is free, try to claim its position. On failure pos is reloaded
+            if (atomic_compare_exchange_weak_explicit(&logHead, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else if (diff < 0)
+        {
+            // The writer has not got to this slot since the last lap, so the ring is full
+            atomic_fetch_add_explicit(&logDropped, 1, memory_order_relaxed);
+            return;
+        }
+        else
+            pos = atomic_load_explicit(&logHead, memory_order_relaxed);
+    }
+
+    slot->time = time;
+    slot->level = messageType;
+    const int len = vsnprintf(slot->payload, LOG_PAYLOAD_SIZE, format, arg);
+    if (len >= LOG_PAYLOAD_SIZE)
+        memcpy(&slot->payload[LOG_PAYLOAD_SIZE - 4], "...", 4);
+
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+static void log_pushf(LOG_MESSAGE_TYPE messageType, const char* format, ...)
+{
+    va_list arg;
     va_start(arg, format);
-    char message[100];
-    vsprintf(message, format, arg);
-    str_append(&msg, message);
+    log_push(messageType, format, arg);
     va_end(arg);
+}
+
+/// Open the log file and start the writer thread, once
+static void log_start()
+{
+    for (size_t i = 0; i < LOG_RING_SIZE; i++)
+        atomic_init(&logRing[i].seq, i);
 
-    str_push(&msg, '\n');
-    fprintf(logStream, "%s", msg.chars);
-    fflush(logStream);
-    str_free(&msg);
+    logStream = fopen("debug.log", "w+");
+    if (logStream == NULL)
+    {
+        fprintf(stderr, "Could not open debug.log, logging is disabled\n");
+        return;
+    }
+
+    if (pthread_create(&logThread, NULL, log_writer, NULL) != 0)
+    {
+        fprintf(stderr, "Could not start the log writer, logging is disabled\n");
+        fclose(logStream);
+        logStream = NULL;
+        return;
+    }
+    logThreadRunning = true;
+    atexit(log_stop);
+
+    log_pushf(MESSAGE, "===========================================");
+    log_pushf(MESSAGE, "Log is running!");
 }
 
-char* now()
+void init_debug()
 {
-    // https://stackoverflow.com/questions/5141960/get-the-current-time-in-c
-    time_t rawTime;
-    time(&rawTime);
-    struct tm* timeInfo = localtime(&rawTime);
-    char* t = asctime(timeInfo);
-    size_t len = strlen(t);
-    memmove(&t[len - 1], &t[len], 1);
-    return t;
+    pthread_once(&logOnce, log_start);
+}
+
+void debug_log(const LOG_MESSAGE_TYPE messageType, char* format, ...)
+{
+    if (messageType < logLevel)
+        return;
+
+    pthread_once(&logOnce, log_start);
+    if (!logThreadRunning)
+        return;
+
+    va_list arg;
+    va_start(arg, format);
+    log_push(messageType, format, arg);
+    va_end(arg);
 }
@@ -5,17 +5,65 @@
 #ifndef WILDFIRE_ROAD_SAFETY_LOGGER_H
 #define WILDFIRE_ROAD_SAFETY_LOGGER_H
 
+#include <stdbool.h>
+
+// The levels as plain numbers, so the preprocessor can compare them
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_MESSAGE 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_OFF 4
+
+/// Calls to the LOG_* macros below this level are compiled out, arguments and all. Set it with the
+/// WFRS_LOG_LEVEL CMake option. TRACE is meant for messages inside loops over roads, fires or
+/// parsed objects, which cost more than the work they describe, so it is left out by default.
+#ifndef WFRS_LOG_LEVEL
+#define WFRS_LOG_LEVEL LOG_LEVEL_MESSAGE
+#endif
+
 typedef enum
 {
-    MESSAGE,
-    WARNING,
-    ERROR,
+    TRACE = LOG_LEVEL_TRACE,
+    MESSAGE = LOG_LEVEL_MESSAGE,
+    WARNING = LOG_LEVEL_WARNING,
+    ERROR = LOG_LEVEL_ERROR,
 } LOG_MESSAGE_TYPE;
 
+/// Messages below this level are not written, see `set_log_level()`
+extern LOG_MESSAGE_TYPE logLevel;
+
+/// Log a message if its level is compiled in and enabled at runtime. The arguments are only
+/// evaluated if the message is written
+#define LOG_AT(level, ...)                                                                         \
+    do                                                                                             \
+    {                                                                                              \
+        if ((level) >= WFRS_LOG_LEVEL && (level) >= logLevel)                                      \
+            debug_log((level), __VA_ARGS__);                                                       \
+    } while (0)
+
+#define LOG_TRACE(...) LOG_AT(TRACE, __VA_ARGS__)
+#define LOG_MESSAGE(...) LOG_AT(MESSAGE, __VA_ARGS__)
+#define LOG_WARNING(...) LOG_AT(WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(ERROR, __VA_ARGS__)
+
 char* LOG_MSG_TYPE_TO_STRING(LOG_MESSAGE_TYPE msg_type);
 
+/// Set the lowest level that is written to the log, TRACE (the default) writes everything that is
+/// compiled in
+void set_log_level(LOG_MESSAGE_TYPE level);
+
+/// Get a level by its name, ignoring case, for example "warning"
+bool log_level_from_string(const char* name, LOG_MESSAGE_TYPE* level);
 
+/// Open debug.log and start the thread that writes to it. Logging does this by itself on first use
 void init_debug();
+/// Write a message to debug.log if its level is enabled at runtime. Prefer the LOG_* macros in
+/// loops, which also skip formatting the arguments and can be compiled out.
+///
+/// The message is formatted into a lock-free queue and written by a background thread, so it is
+/// safe to call from any thread and does not wait on the file. Messages are cut off after 255
+/// characters. If the queue is full the message is dropped, and the writer notes how many were.
+/// Everything queued is written when the program exits
 void debug_log(LOG_MESSAGE_TYPE, char* format, ...);
 
 #endif //WILDFIRE_ROAD_SAFETY_LOGGER_H
@@ -0,0 +1,714 @@
+#include "batch.h"
+
+#include "../Debug/Logger.h"
+#include "../dyn.h"
+#include "../map/map.h"
+#include "../models/fire.h"
+#include "../models/geo.h"
+#include "../models/road.h"
+#include "../models/vegetation.h"
+#include "../risk/fire_field.h"
+#include "../risk/risk.h"
+#include "../routing/contraction.h"
+#include "../routing/critical.h"
+#include "../routing/road_graph.h"
+#include "../routing/route.h"
+#include "../simulation/fire_arrival.h"
+#include "../simulation/isochrone.h"
+#include "../simulation/traffic.h"
+#include "../spatial/veg_index.h"
+#include "../threading/pool.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/// The size of the cells of the fire arrival map in metres, the same as the console uses
+#define BATCH_CELL_SIZE 5
+/// The size of the cells of the field the fire distance of each road is read off in metres. The
+/// distance is measured to the exact position of the fire a cell picks, so the cells can be coarse
+#define BATCH_FIRE_FIELD_CELL_SIZE 25
+/// The most cells along each side of the fire distance field
+#define BATCH_FIRE_FIELD_MAX_CELLS 2048
+#define BATCH_LINE_SIZE 512
+/// How many of the risky roads without a way around them `--critical-risk` lists per bbox
+#define BATCH_LISTED_CRITICAL 10
+
+typedef enum
+{
+    BATCH_CSV,
+    BATCH_NDJSON,
+} BatchFormat;
+
+typedef VecDef(BoundBox) BoundBoxVec;
+
+static const struct
+{
+    RoadRiskReason flag;
+    const char* name;
+} RISK_REASON_NAMES[] = {
+    {RISK_ASPHALT_MELT, "asphalt_melt"},
+    {RISK_NEAR_FIRE, "near_fire"},
+};
+
+static void print_usage(FILE* file)
+{
+    fprintf(file, "Usage: wfrs [--bbox lat1,lon1,lat2,lon2]... [--bbox-file path]\n"
+                  "            [--format csv|ndjson] [--output path]\n"
+                  "            [--log-level trace|message|warning|error]\n"
+                  "            [--route-from lat,lon] [--route-file path] [--critical-risk min]\n"
+                  "            [--isochrones path] [--traffic max-minutes]\n"
+                  "\n"
+                  "Without arguments the interactive console is started.\n");
+}
+
+static double now_seconds(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+/// Parse four numbers separated by commas and/or whitespace into a bbox
+static bool parse_bbox(const char* text, BoundBox* bbox)
+{
+    double lat1, lon1, lat2, lon2;
+    char rest;
+    if (sscanf(text, " %lf%*[ ,\t]%lf%*[ ,\t]%lf%*[ ,\t]%lf %c", &lat1, &lon1, &lat2, &lon2,
+               &rest) != 4)
+        return false;
+
+    if (lat1 < -90 || lat1 > 90 || lat2 < -90 || lat2 > 90 || lon1 < -180 || lon1 > 180 ||
+        lon2 < -180 || lon2 > 180)
+        return false;
+
+    *bbox = (BoundBox){.c1 = {.lat = lat1, .lon = lon1}, .c2 = {.lat = lat2, .lon = lon2}};
+    return true;
+}
+
+/// Parse two numbers separated by a comma and/or whitespace into a coordinate
+static bool parse_coord(const char* text, GCoord* coord)
+{
+    double lat, lon;
+    char rest;
+    if (sscanf(text, " %lf%*[ ,\t]%lf %c", &lat, &lon, &rest) != 2)
+        return false;
+
+    if (lat < -90 || lat > 90 || lon < -180 || lon > 180)
+        return false;
+
+    *coord = (GCoord){.lat = lat, .lon = lon};
+    return true;
+}
+
+static bool read_bbox_file(const char* path, BoundBoxVec* bboxes)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Could not open %s\n", path);
+        return false;
+    }
+
+    char line[BATCH_LINE_SIZE];
+    size_t lineNum = 0;
+    bool success = true;
+    while (success && fgets(line, sizeof(line), file) != NULL)
+    {
+        lineNum++;
+
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+        if (strspn(line, " \t\r\n") == strlen(line))
+            continue;
+
+        BoundBox bbox;
+        if (parse_bbox(line, &bbox))
+        {
+            vec_push(bboxes, bbox);
+        }
+        else
+        {
+            fprintf(stderr, "%s:%zu: Expected a bbox as lat1,lon1,lat2,lon2\n", path, lineNum);
+            success = false;
+        }
+    }
+
+    fclose(file);
+    return success;
+}
+
+/// Read one `lat,lon` per line, with `#` starting a comment
+static bool read_coord_file(const char* path, GCoordVec* coords)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Could not open %s\n", path);
+        return false;
+    }
+
+    char line[BATCH_LINE_SIZE];
+    size_t lineNum = 0;
+    bool success = true;
+    while (success && fgets(line, sizeof(line), file) != NULL)
+    {
+        lineNum++;
+
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+        if (strspn(line, " \t\r\n") == strlen(line))
+            continue;
+
+        GCoord coord;
+        if (parse_coord(line, &coord))
+        {
+            vec_push(coords, coord);
+        }
+        else
+        {
+            fprintf(stderr, "%s:%zu: Expected a coordinate as lat,lon\n", path, lineNum);
+            success = false;
+        }
+    }
+
+    fclose(file);
+    return success;
+}
+
+static void write_csv_string(FILE* out, const char* str)
+{
+    fputc('"', out);
+    for (; str != NULL && *str != '\0'; str++)
+    {
+        if (*str == '"')
+            fputc('"', out);
+        fputc(*str, out);
+    }
+    fputc('"', out);
+}
+
+static void write_json_string(FILE* out, const char* str)
+{
+    fputc('"', out);
+    for (; str != NULL && *str != '\0'; str++)
+    {
+        const unsigned char ch = (unsigned char)*str;
+        if (ch == '"' || ch == '\\')
+            fprintf(out, "\\%c", ch);
+        else if (ch < 0x20)
+            fprintf(out, "\\u%04x", ch);
+        else
+            fputc(ch, out);
+    }
+    fputc('"', out);
+}
+
+/// Write the names of the reasons joined by '|'
+static void write_reason(FILE* out, RoadRiskReason reason)
+{
+    bool first = true;
+    for (size_t i = 0; i < sizeof(RISK_REASON_NAMES) / sizeof(RISK_REASON_NAMES[0]); i++)
+    {
+        if ((reason & RISK_REASON_NAMES[i].flag) == 0)
+            continue;
+
+        if (!first)
+            fputc('|', out);
+        fputs(RISK_REASON_NAMES[i].name, out);
+        first = false;
+    }
+}
+
+/// Write one road. A negative distance means there are no fires
+static void write_road(FILE* out, BatchFormat format, size_t bboxIdx, RoadSeg road,
+                       double fireDst)
+{
+    if (format == BATCH_CSV)
+    {
+        fprintf(out, "%zu,%zu,", bboxIdx, road.id);
+        write_csv_string(out, road.name);
+        fprintf(out, ",%d,", road.risk);
+        write_reason(out, road.risk_reason);
+        if (fireDst >= 0)
+            fprintf(out, ",%.1f\n", fireDst);
+        else
+            fputs(",\n", out);
+    }
+    else
+    {
+        fprintf(out, "{\"bbox\":%zu,\"id\":%zu,\"name\":", bboxIdx, road.id);
+        if (road.name != NULL)
+            write_json_string(out, road.name);
+        else
+            fputs("null", out);
+        fprintf(out, ",\"risk\":%d,\"reason\":\"", road.risk);
+        write_reason(out, road.risk_reason);
+        if (fireDst >= 0)
+            fprintf(out, "\",\"fire_distance\":%.1f}\n", fireDst);
+        else
+            fputs("\",\"fire_distance\":null}\n", out);
+    }
+}
+
+/// Write the fire arrival lines of a bbox as GeoJSON features, one per line of the file
+static void write_isochrones(FILE* out, size_t bboxIdx, IsochroneVec lines)
+{
+    for (size_t i = 0; i < lines.len; i++)
+    {
+        const Isochrone line = lines.items[i];
+        fputs("{\"type\":\"Feature\",\"geometry\":{\"type\":\"LineString\",\"coordinates\":[", out);
+        for (size_t j = 0; j < line.points.len; j++)
+            fprintf(out, "%s[%.7f,%.7f]", j > 0 ? "," : "", line.points.items[j].lon,
+                    line.points.items[j].lat);
+        fprintf(out, "]},\"properties\":{\"bbox\":%zu,\"minutes\":%g,\"closed\":%s}}\n",
+                bboxIdx, line.time / 60, line.closed ? "true" : "false");
+    }
+}
+
+/// Simulate everyone in the built up areas of the bbox driving out at once for up to `maxTime`
+/// seconds, report on stderr how it went, and get the time to safety of every segment of the roads
+/// with the jams on the way, like `road_segment_escape()` lays it out
+static double* congested_escape(size_t bboxIdx, BoundBox bbox, RoadSegSlice roads,
+                                VegSlice vegetation, double maxTime, ThreadPool* pool)
+{
+    RoadGraph graph = road_graph_from_roads(roads, bbox);
+    const double simStart = now_seconds();
+    TrafficSim traffic = traffic_create(&graph, roads, vegetation, bbox);
+    traffic_run(&traffic, maxTime, pool);
+    fprintf(stderr,
+            "bbox %zu: %.0f of %.0f cars out after %.0f min, %.0f with no way out "
+            "(%zu cells simulated in %.3f s)\n",
+            bboxIdx, traffic.evacuated, traffic.demand, traffic.time / 60, traffic.stranded,
+            traffic.cell_count, now_seconds() - simStart);
+
+    double* times = malloc(MAX(graph.vertex_count, 1) * sizeof(double));
+    traffic_times_to_safety(&traffic, times);
+    double* escape = road_segment_escape_times(&graph, roads, times);
+    free(times);
+    traffic_free(&traffic);
+    road_graph_free(&graph);
+    return escape;
+}
+
+/// Find the safest way out of the bbox from the road closest to a coordinate, and report it on
+/// stderr. The roads must have been assessed
+static void report_route(size_t bboxIdx, BoundBox bbox, RoadSegSlice roads,
+                         const RoadRisk* segmentRisk, GCoord from)
+{
+    const Projection proj = projection_from_bbox(bbox);
+    RoadGraph graph = road_graph_from_roads(roads, bbox);
+    road_graph_set_risk(&graph, roads, segmentRisk, ROAD_GRAPH_RISK_WEIGHT);
+
+    const size_t start = road_graph_nearest_vertex(&graph, project_coord(from, proj));
+    RouteSearch* search = route_search_create(&graph);
+    RoutePath path = {0};
+    const double routeStart = now_seconds();
+    if (start != SIZE_MAX && route_safest_exit(search, start, &path))
+    {
+        const size_t exitVertex = path.vertices.items[path.vertices.len - 1];
+        const GCoord exit = unproject_coord(graph.coords[exitVertex], proj);
+        fprintf(stderr,
+                "bbox %zu: safest exit is %.0f m and %.0f s away at %.6f,%.6f "
+                "(%zu vertices searched in %.3f s)\n",
+                bboxIdx, path.length, path.time, exit.lat, exit.lon, path.settled,
+                now_seconds() - routeStart);
+    }
+    else
+        fprintf(stderr, "bbox %zu: no way out of the area from %.6f,%.6f\n", bboxIdx, from.lat,
+                from.lon);
+
+    route_path_free(&path);
+    route_search_free(search);
+    road_graph_free(&graph);
+}
+
+/// Report on stderr the safest way out of the bbox from the road closest to each of the points. The
+/// routes are found on a contraction hierarchy, built once for all of them
+static void report_routes(size_t bboxIdx, BoundBox bbox, RoadSegSlice roads,
+                          const RoadRisk* segmentRisk, GCoordVec starts)
+{
+    const Projection proj = projection_from_bbox(bbox);
+    RoadGraph graph = road_graph_from_roads(roads, bbox);
+    road_graph_set_risk(&graph, roads, segmentRisk, ROAD_GRAPH_RISK_WEIGHT);
+
+    const double buildStart = now_seconds();
+    RouteHierarchy hierarchy = route_hierarchy_build(&graph);
+    const double queryStart = now_seconds();
+
+    RoutePath path = {0};
+    size_t found = 0;
+    for (size_t i = 0; i < starts.len; i++)
+    {
+        const GCoord from = starts.items[i];
+        const size_t start = road_graph_nearest_vertex(&graph, project_coord(from, proj));
+        if (start != SIZE_MAX && route_hierarchy_safest_exit(&hierarchy, start, &path))
+        {
+            const size_t exitVertex = path.vertices.items[path.vertices.len - 1];
+            const GCoord exit = unproject_coord(graph.coords[exitVertex], proj);
+            fprintf(stderr,
+                    "bbox %zu: route %zu from %.6f,%.6f: safest exit is %.0f m and %.0f s away at "
+                    "%.6f,%.6f\n",
+                    bboxIdx, i, from.lat, from.lon, path.length, path.time, exit.lat, exit.lon);
+            found++;
+        }
+        else
+            fprintf(stderr, "bbox %zu: route %zu: no way out of the area from %.6f,%.6f\n",
+                    bboxIdx, i, from.lat, from.lon);
+    }
+    fprintf(stderr,
+            "bbox %zu: %zu of %zu routes found (hierarchy with %zu shortcuts built in %.3f s, "
+            "routes found in %.3f s)\n",
+            bboxIdx, found, starts.len, hierarchy.shortcut_count, queryStart - buildStart,
+            now_seconds() - queryStart);
+
+    route_path_free(&path);
+    route_hierarchy_free(&hierarchy);
+    road_graph_free(&graph);
+}
+
+/// Report on stderr the roads with a risk above `minRisk` whose closure would cut part of the road
+/// network off from every way out of the bbox. The roads must have been assessed
+static void report_critical_roads(size_t bboxIdx, BoundBox bbox, RoadSegSlice roads,
+                                  RoadRisk minRisk)
+{
+    RoadGraph graph = road_graph_from_roads(roads, bbox);
+    const double findStart = now_seconds();
+    RoadCriticality criticality = road_criticality_find(&graph);
+    CriticalRoadVec critical = road_criticality_risky_roads(&criticality, &graph, roads, minRisk);
+    fprintf(stderr,
+            "bbox %zu: %zu bridges, %zu cut vertices, %zu vertices without a way out, "
+            "%zu critical roads above risk %d (found in %.3f s)\n",
+            bboxIdx, criticality.bridge_count, criticality.cut_vertex_count,
+            criticality.stranded_count, critical.len, minRisk, now_seconds() - findStart);
+
+    for (size_t i = 0; i < MIN(critical.len, BATCH_LISTED_CRITICAL); i++)
+    {
+        const RoadSeg road = roads.items[critical.items[i].road];
+        fprintf(stderr, "bbox %zu: road %zu (%s) risk %d, closing it traps %zu vertices\n",
+                bboxIdx, road.id, road.name != NULL ? road.name : "unnamed", road.risk,
+                critical.items[i].trapped);
+    }
+
+    vec_free(critical);
+    road_criticality_free(&criticality);
+    road_graph_free(&graph);
+}
+
+static void free_bbox_data(RoadSegSlice* roads, FireSlice* fires, VegSlice* vegetation)
+{
+    for (size_t i = 0; i < roads->len; i++)
+    {
+        free(roads->items[i].nodes.items);
+        free(roads->items[i].name);
+        free(roads->items[i].material);
+    }
+    free(roads->items);
+    *roads = (RoadSegSlice){0};
+
+    for (size_t i = 0; i < fires->len; i++)
+        free(fires->items[i].category);
+    free(fires->items);
+    *fires = (FireSlice){0};
+
+    for (size_t i = 0; i < vegetation->len; i++)
+        vec_free(vegetation->items[i].area);
+    free(vegetation->items);
+    *vegetation = (VegSlice){0};
+}
+
+/// Get the distance from every road to the nearest fire, read off a fire distance field. The field
+/// covers the fires as well as the bbox, as fires outside it would be measured from its border.
+/// INFINITY for every road if there are no fires.
+/// The caller is responsible for freeing the array
+static double* road_fire_distances(BoundBox bbox, RoadSegSlice roads, FireSlice fires,
+                                   ThreadPool* pool)
+{
+    const Projection proj = projection_from_bbox(bbox);
+    const MCoord corner1 = project_coord(bbox.c1, proj);
+    const MCoord corner2 = project_coord(bbox.c2, proj);
+    MRect area = {
+        .min_x = MIN(corner1.x, corner2.x),
+        .min_y = MIN(corner1.y, corner2.y),
+        .max_x = MAX(corner1.x, corner2.x),
+        .max_y = MAX(corner1.y, corner2.y),
+    };
+    for (size_t i = 0; i < fires.len; i++)
+    {
+        area.min_x = MIN(area.min_x, fires.items[i].mcoord.x);
+        area.min_y = MIN(area.min_y, fires.items[i].mcoord.y);
+        area.max_x = MAX(area.max_x, fires.items[i].mcoord.x);
+        area.max_y = MAX(area.max_y, fires.items[i].mcoord.y);
+    }
+
+    // Fires far away make the cells coarser, rather than the field larger
+    const double side = MAX(area.max_x - area.min_x, area.max_y - area.min_y);
+    const double cellSize = MAX(BATCH_FIRE_FIELD_CELL_SIZE, side / BATCH_FIRE_FIELD_MAX_CELLS);
+
+    FireField field = fire_field_create(fires, area, cellSize, pool);
+    double* dsts = malloc(MAX(roads.len, 1) * sizeof(double));
+    fire_field_road_dsts(&field, roads, dsts, pool);
+    fire_field_free(&field);
+    return dsts;
+}
+
+/// Fetch, parse and assess a single bbox, and write its roads
+static bool run_bbox(size_t bboxIdx, BoundBox bbox, BatchFormat format, FILE* out,
+                     ThreadPool* pool, const GCoord* routeFrom, const GCoordVec* routeStarts,
+                     const RoadRisk* criticalRisk, FILE* isochroneOut, const double* trafficTime)
+{
+    RoadSegSlice roads = {0};
+    FireSlice fires = {0};
+    VegSlice vegetation = {0};
+    String roadData = {0};
+    String fireData = {0};
+    String vegData = {0};
+
+    const double fetchStart = now_seconds();
+    bool success = fetch_road_data(bbox, &roadData) && fetch_fire_data(bbox.c1, &fireData) &&
+                   fetch_vegetation_data(bbox, &vegData);
+
+    const double parseStart = now_seconds();
+    success = success && parse_road_data(roadData, bbox, &roads) &&
+              parse_fire_data(fireData, &fires) && parse_vegetation_data(vegData, &vegetation);
+    str_free(&roadData);
+    str_free(&fireData);
+    str_free(&vegData);
+
+    if (!success)
+    {
+        fprintf(stderr, "bbox %zu: Could not get the data of the area\n", bboxIdx);
+        debug_log(ERROR, "Batch: could not get the data of bbox %zu", bboxIdx);
+        free_bbox_data(&roads, &fires, &vegetation);
+        return false;
+    }
+    project_fires(fires, projection_from_bbox(bbox));
+
+    const double assessStart = now_seconds();
+    VegIndex vegIndex = veg_index_from_vegetation(vegetation, bbox);
+
+    const GCoord center = {
+        .lat = (bbox.c1.lat + bbox.c2.lat) / 2,
+        .lon = (bbox.c1.lon + bbox.c2.lon) / 2,
+    };
+    Vec2 wind = {0};
+    if (!get_wind_velocity(center, &wind))
+        debug_log(WARNING, "Batch: could not get the wind, assessing bbox %zu without it", bboxIdx);
+
+    FireArrival arrival = fire_arrival_create(vegetation, bbox, BATCH_CELL_SIZE);
+    fire_arrival_solve(&arrival, fires, wind, 1);
+    double* segmentEscape = NULL;
+    if (trafficTime != NULL)
+        segmentEscape = congested_escape(bboxIdx, bbox, roads, vegetation, *trafficTime, pool);
+
+    // Routes avoid the risky parts of a road rather than the whole road
+    RoadRisk* segmentRisk = NULL;
+    if (routeFrom != NULL || routeStarts != NULL)
+    {
+        size_t nodeCount = 0;
+        for (size_t i = 0; i < roads.len; i++)
+            nodeCount += roads.items[i].nodes.len;
+        segmentRisk = malloc(MAX(nodeCount, 1) * sizeof(RoadRisk));
+        assess_road_segments(&roads, &fires, &vegIndex, bbox, segmentEscape, &arrival, pool,
+                             segmentRisk);
+    }
+    else
+        assess_roads_arrival(&roads, &fires, &vegIndex, bbox, segmentEscape, &arrival, pool);
+    free(segmentEscape);
+    if (isochroneOut != NULL)
+    {
+        IsochroneVec isochrones = isochrones_extract(
+            &arrival, ISOCHRONE_DEFAULT_TIMES, ISOCHRONE_DEFAULT_COUNT, ISOCHRONE_TOLERANCE, pool);
+        write_isochrones(isochroneOut, bboxIdx, isochrones);
+        fflush(isochroneOut);
+        isochrones_free(&isochrones);
+    }
+    fire_arrival_free(&arrival);
+    veg_index_free(&vegIndex);
+
+    const double writeStart = now_seconds();
+    double* fireDsts = road_fire_distances(bbox, roads, fires, pool);
+    for (size_t i = 0; i < roads.len; i++)
+        write_road(out, format, bboxIdx, roads.items[i], isinf(fireDsts[i]) ? -1 : fireDsts[i]);
+    free(fireDsts);
+    fflush(out);
+    const double end = now_seconds();
+
+    fprintf(stderr,
+            "bbox %zu: %zu roads, %zu fires, %zu vegetation areas | fetch %.3f s, parse %.3f s, "
+            "assess %.3f s, write %.3f s\n",
+            bboxIdx, roads.len, fires.len, vegetation.len, parseStart - fetchStart,
+            assessStart - parseStart, writeStart - assessStart, end - writeStart);
+
+    if (routeFrom != NULL)
+        report_route(bboxIdx, bbox, roads, segmentRisk, *routeFrom);
+    if (routeStarts != NULL)
+        report_routes(bboxIdx, bbox, roads, segmentRisk, *routeStarts);
+    free(segmentRisk);
+    if (criticalRisk != NULL)
+        report_critical_roads(bboxIdx, bbox, roads, *criticalRisk);
+
+    free_bbox_data(&roads, &fires, &vegetation);
+    return true;
+}
+
+int batch_main(int argc, char** argv)
+{
+    BoundBoxVec bboxes = {0};
+    BatchFormat format = BATCH_CSV;
+    const char* outputPath = NULL;
+    const char* isochronePath = NULL;
+    GCoord routeFrom;
+    bool hasRouteFrom = false;
+    GCoordVec routeStarts = {0};
+    RoadRisk criticalRisk;
+    bool hasCriticalRisk = false;
+    double trafficTime;
+    bool hasTrafficTime = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+        {
+            print_usage(stdout);
+            vec_free(bboxes);
+            vec_free(routeStarts);
+            return EXIT_SUCCESS;
+        }
+
+        if (i + 1 >= argc)
+        {
+            fprintf(stderr, "Unknown argument or missing value: %s\n", arg);
+            print_usage(stderr);
+            vec_free(bboxes);
+            vec_free(routeStarts);
+            return EXIT_FAILURE;
+        }
+
+        const char* value = argv[++i];
+        bool valid = true;
+        if (strcmp(arg, "--bbox") == 0)
+        {
+            BoundBox bbox;
+            valid = parse_bbox(value, &bbox);
+            if (valid)
+            {
+                vec_push(&bboxes, bbox);
+            }
+        }
+        else if (strcmp(arg, "--bbox-file") == 0)
+            valid = read_bbox_file(value, &bboxes);
+        else if (strcmp(arg, "--format") == 0 && strcmp(value, "csv") == 0)
+            format = BATCH_CSV;
+        else if (strcmp(arg, "--format") == 0 && strcmp(value, "ndjson") == 0)
+            format = BATCH_NDJSON;
+        else if (strcmp(arg, "--output") == 0)
+            outputPath = value;
+        else if (strcmp(arg, "--isochrones") == 0)
+            isochronePath = value;
+        else if (strcmp(arg, "--route-from") == 0)
+            valid = hasRouteFrom = parse_coord(value, &routeFrom);
+        else if (strcmp(arg, "--route-file") == 0)
+            valid = read_coord_file(value, &routeStarts);
+        else if (strcmp(arg, "--critical-risk") == 0)
+        {
+            char rest;
+            valid = hasCriticalRisk = sscanf(value, " %d %c", &criticalRisk, &rest) == 1;
+        }
+        else if (strcmp(arg, "--traffic") == 0)
+        {
+            char rest;
+            double minutes;
+            valid = hasTrafficTime = sscanf(value, " %lf %c", &minutes, &rest) == 1 && minutes > 0;
+            if (valid)
+                trafficTime = minutes * 60;
+        }
+        else if (strcmp(arg, "--log-level") == 0)
+        {
+            LOG_MESSAGE_TYPE level;
+            valid = log_level_from_string(value, &level);
+            if (valid)
+                set_log_level(level);
+        }
+        else
+            valid = false;
+
+        if (!valid)
+        {
+            fprintf(stderr, "Invalid argument: %s %s\n", arg, value);
+            print_usage(stderr);
+            vec_free(bboxes);
+            vec_free(routeStarts);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (bboxes.len == 0)
+    {
+        fprintf(stderr, "No bbox given\n");
+        print_usage(stderr);
+        vec_free(bboxes);
+        vec_free(routeStarts);
+        return EXIT_FAILURE;
+    }
+
+    FILE* out = stdout;
+    if (outputPath != NULL)
+    {
+        out = fopen(outputPath, "w");
+        if (out == NULL)
+        {
+            fprintf(stderr, "Could not open %s\n", outputPath);
+            vec_free(bboxes);
+            vec_free(routeStarts);
+            return EXIT_FAILURE;
+        }
+    }
+
+    FILE* isochroneOut = NULL;
+    if (isochronePath != NULL)
+    {
+        isochroneOut = fopen(isochronePath, "w");
+        if (isochroneOut == NULL)
+        {
+            fprintf(stderr, "Could not open %s\n", isochronePath);
+            if (out != stdout)
+                fclose(out);
+            vec_free(bboxes);
+            vec_free(routeStarts);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (format == BATCH_CSV)
+        fputs("bbox,id,name,risk,reason,fire_distance\n", out);
+
+    ThreadPool* pool = pool_create(0);
+    const double start = now_seconds();
+    size_t failed = 0;
+    for (size_t i = 0; i < bboxes.len; i++)
+    {
+        if (!run_bbox(i, bboxes.items[i], format, out, pool, hasRouteFrom ? &routeFrom : NULL,
+                      routeStarts.len > 0 ? &routeStarts : NULL,
+                      hasCriticalRisk ? &criticalRisk : NULL, isochroneOut,
+                      hasTrafficTime ? &trafficTime : NULL))
+            failed++;
+    }
+    fprintf(stderr, "Assessed %zu of %zu bboxes in %.3f s\n", bboxes.len - failed, bboxes.len,
+            now_seconds() - start);
+    pool_free(pool);
+
+    if (out != stdout)
+        fclose(out);
+    if (isochroneOut != NULL)
+        fclose(isochroneOut);
+    vec_free(bboxes);
+    vec_free(routeStarts);
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,22 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/// Run the risk assessment without the console, for scripts and benchmarks.
+///
+/// Every bbox given with `--bbox lat1,lon1,lat2,lon2` or listed in `--bbox-file` (one per line,
+/// `#` starts a comment) is fetched, parsed and assessed in turn. One record per road is written
+/// to stdout (or `--output`) as CSV or NDJSON (`--format`), and the wall time of each phase is
+/// written to stderr. `--log-level` sets the lowest level written to debug.log. With
+/// `--route-from lat,lon`, the safest way out of each bbox from the road closest to that point is
+/// written to stderr as well. `--route-file path` does the same for every `lat,lon` line of
+/// `path`, building a contraction hierarchy once per bbox so the many routes are found quickly.
+/// With `--critical-risk min`, the roads with a risk above `min` whose
+/// closure would leave part of the road network without a way out are listed on stderr. With
+/// `--isochrones path`, the lines the fire reaches in 15, 30 and 60 minutes are written to `path`
+/// as GeoJSON features, one per line. With `--traffic max-minutes`, everyone in the built up areas
+/// drives out at once for up to that long, and the risk counts the jams on the way out.
+///
+/// Returns the exit code of the program
+int batch_main(int argc, char** argv);
+
+#endif // BATCH_H
@@ -1,22 +1,58 @@
 #include "Debug/Logger.h"
+#include "batch/batch.h"
 #include "dyn.h"
 #include "map/map.h"
 #include "models/fire.h"
 #include "models/geo.h"
 #include "models/road.h"
 #include "models/vegetation.h"
+#include "risk/ensemble.h"
 #include "risk/risk.h"
+#include "routing/critical.h"
+#include "routing/road_graph.h"
+#include "routing/safety.h"
 #include "signal.h"
+#include "simulation/fire_spread.h"
+#include "simulation/isochrone.h"
+#include "simulation/traffic.h"
+#include "spatial/veg_index.h"
 #include "visual/visual.h"
 
 #include <pthread.h>
 #include <stdio.h>
+#include <time.h>
 #include <unistd.h>
 
+/// The size of the cells of the fire spread simulation in metres
+#define SIM_CELL_SIZE 5
+/// The simulated seconds per step, short enough that the fire moves less than a cell per step
+#define SIM_TIME_STEP 5
+#define SIM_STEPS_PER_SECOND 10
+/// The amount of scenarios of RUN ENSEMBLE, and how many of the riskiest roads it lists
+#define ENSEMBLE_MEMBERS 1000
+#define ENSEMBLE_LISTED_ROADS 20
+
 bool simIsRunning = false;
 bool programIsRunning = true;
 bool errorHappened = false;
 
+// The data the simulation runs on, set up by main
+BoundBox simBounds;
+RoadSegSlice simRoads;
+FireSlice simFires;
+VegSlice simVegetation;
+// The vegetation the roads are assessed with
+VegIndex simVegIndex;
+ThreadPool* simPool;
+// The fire ETAs and the times to safety the roads were assessed with at the start
+FireArrival simArrival;
+double* simSegmentEscape;
+
+// The roads closed from the console, and the times to safety with them closed
+RoadGraph closureGraph;
+SafetyTimes closureSafety;
+bool* closedRoads;
+
 void* simulation_stop_check_thread()
 {
     getchar();
@@ -30,21 +66,169 @@ void run_simulation()
     pthread_t stopCheckThread;
     pthread_create(&stopCheckThread, NULL, (void*)simulation_stop_check_thread, NULL);
     simIsRunning = true;
+
+    // Start from the detected fires. The ones inside the bbox are taken out of the risk, as the
+    // burning cells of the simulation take their place
+    // The risks of the simulation are only shown while it runs, so the ones from the start are
+    // put back once it stops
+    RoadRisk* startRisk = malloc(MAX(simRoads.len, 1) * sizeof(RoadRisk));
+    for (size_t i = 0; i < simRoads.len; i++)
+        startRisk[i] = simRoads.items[i].risk;
+
+    FireSpread spread = fire_spread_create(simVegetation, simBounds, SIM_CELL_SIZE);
+    RiskState risk = risk_state_create(&simRoads, simFires, &simVegIndex, simBounds,
+                                       simSegmentEscape, &simArrival, simPool);
+    for (size_t i = 0; i < simFires.len; i++)
+    {
+        if (fire_spread_ignite(&spread, simFires.items[i].gcoord))
+            risk_remove_fire(&risk, i);
+    }
+    debug_log(MESSAGE, "Simulating fire spread on a %zux%zu grid", spread.grid.width,
+              spread.grid.height);
+
+    // Which roads have no way around them only depends on the roads, so it is found once and
+    // only matched against the risk every step
+    RoadGraph graph = road_graph_from_roads(simRoads, simBounds);
+    RoadCriticality criticality = road_criticality_find(&graph);
+
+    const GCoord center = {
+        .lat = (simBounds.c1.lat + simBounds.c2.lat) / 2,
+        .lon = (simBounds.c1.lon + simBounds.c2.lon) / 2,
+    };
     // ReSharper disable once CppDFAConstantConditions
     while (simIsRunning)
     {
-        // DO STUFF
         simIsRunning = true;
-        printf("SIM IS RUNNING!\n");
-        sleep(1);
+        struct timespec stepStart, stepEnd;
+        clock_gettime(CLOCK_MONOTONIC, &stepStart);
+
+        Vec2 wind = {0};
+        if (!get_wind_velocity(center, &wind))
+            debug_log(WARNING, "Could not get the wind, simulating without it");
+
+        const size_t burning = fire_spread_step(&spread, wind, SIM_TIME_STEP, simPool);
+        fire_spread_sync_risk(&spread, &risk);
+        const size_t rescored = risk_rescore(&risk);
+        CriticalRoadVec critical =
+            road_criticality_risky_roads(&criticality, &graph, simRoads, RISK_THRESHOLD_HIGH);
+        printf("SIM TIME: %.0f s, BURNING CELLS: %zu, ROADS RESCORED: %zu, CRITICAL ROADS: %zu\n",
+               spread.time, burning, rescored, critical.len);
+        vec_free(critical);
+
+        // Keep to a steady amount of steps per second
+        clock_gettime(CLOCK_MONOTONIC, &stepEnd);
+        const double elapsed = (double)(stepEnd.tv_sec - stepStart.tv_sec) +
+                               (double)(stepEnd.tv_nsec - stepStart.tv_nsec) / 1e9;
+        const double stepTime = 1.0 / SIM_STEPS_PER_SECOND;
+        if (elapsed < stepTime)
+            usleep((useconds_t)((stepTime - elapsed) * 1e6));
     }
     // ReSharper disable once CppDFAUnreachableCode
     pthread_join(stopCheckThread, NULL);
+    road_criticality_free(&criticality);
+    road_graph_free(&graph);
+    risk_state_free(&risk);
+    fire_spread_free(&spread);
+    for (size_t i = 0; i < simRoads.len; i++)
+        simRoads.items[i].risk = startRisk[i];
+    free(startRisk);
     printf("SIM STOPPED!");
     sleep(1);
     draw_console();
 }
 
+typedef struct
+{
+    size_t road;
+    RoadRisk p90;
+} RoadP90;
+
+static int cmp_road_p90(const void* r1, const void* r2)
+{
+    const RoadRisk risk1 = ((const RoadP90*)r1)->p90;
+    const RoadRisk risk2 = ((const RoadP90*)r2)->p90;
+    return (risk2 > risk1) - (risk2 < risk1);
+}
+
+void run_ensemble()
+{
+    clear();
+    printf("RUNNING %d SCENARIOS...\n", ENSEMBLE_MEMBERS);
+
+    const GCoord center = {
+        .lat = (simBounds.c1.lat + simBounds.c2.lat) / 2,
+        .lon = (simBounds.c1.lon + simBounds.c2.lon) / 2,
+    };
+    Vec2 wind = {0};
+    if (!get_wind_velocity(center, &wind))
+        debug_log(WARNING, "Could not get the wind, running the ensemble without it");
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    RiskEnsemble ensemble = risk_ensemble_run(simRoads, simFires, simVegetation, &simVegIndex,
+                                              simBounds, SIM_CELL_SIZE, simSegmentEscape, wind,
+                                              ensemble_config_default(ENSEMBLE_MEMBERS), simPool);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("DONE IN %.1f s\n\n",
+           (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9);
+
+    // List the roads with the highest risk in the worst tenth of the scenarios
+    RoadP90* order = malloc(MAX(simRoads.len, 1) * sizeof(RoadP90));
+    for (size_t i = 0; i < simRoads.len; i++)
+        order[i] = (RoadP90){.road = i, .p90 = risk_ensemble_percentile(&ensemble, i, 90)};
+    qsort(order, simRoads.len, sizeof(RoadP90), cmp_road_p90);
+
+    printf("%-12s %-32s %8s %8s %8s\n", "ROAD ID", "NAME", "P10", "P50", "P90");
+    for (size_t i = 0; i < MIN(simRoads.len, ENSEMBLE_LISTED_ROADS); i++)
+    {
+        const RoadSeg road = simRoads.items[order[i].road];
+        printf("%-12zu %-32.32s %8d %8d %8d\n", road.id, road.name != NULL ? road.name : "",
+               risk_ensemble_percentile(&ensemble, order[i].road, 10),
+               risk_ensemble_percentile(&ensemble, order[i].road, 50), order[i].p90);
+    }
+    free(order);
+    risk_ensemble_free(&ensemble);
+
+    printf("\nPress any key to return...");
+    getchar();
+    draw_console();
+}
+
+/// Close the road selected on the grid, or open it again if it is closed, and show how the times
+/// to safety changed
+void toggle_road_closure()
+{
+    const long road = get_selected_road_idx();
+    if (road < 0)
+    {
+        write_to_textbox("Click on a road on the map to close or open it");
+        return;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    closedRoads[road] = !closedRoads[road];
+    const SafetyChange change = closedRoads[road]
+                                    ? safety_times_close_road(&closureSafety, (size_t)road)
+                                    : safety_times_open_road(&closureSafety, (size_t)road);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    const RoadSeg seg = simRoads.items[road];
+    String text = str_from("");
+    str_appendf(&text, "%s road %zu (%s)\n", closedRoads[road] ? "Closed" : "Opened", seg.id,
+                seg.name != NULL ? seg.name : "unnamed");
+    str_appendf(&text, "├⮞ changed: %zu crossings\n", change.changed);
+    str_appendf(&text, "├⮞ trapped: %zu crossings\n", change.lost_exit);
+    str_appendf(&text, "├⮞ freed:   %zu crossings\n", change.gained_exit);
+    str_appendf(&text, "├⮞ delay:   %.0f s in total, %.0f s at most\n", change.total_delay,
+                change.max_delay);
+    str_appendf(&text, "└⮞ took:    %.3f ms\n",
+                (double)(end.tv_sec - start.tv_sec) * 1e3 +
+                    (double)(end.tv_nsec - start.tv_nsec) / 1e6);
+    write_to_textbox(text.chars);
+    str_free(&text);
+}
+
 void stop_program()
 {
     programIsRunning = false;
@@ -72,11 +256,15 @@ void signal_handler(int signalNum)
 }
 
 
-int main()
+int main(int argc, char** argv)
 {
     signal(SIGSEGV, signal_handler);
     signal(SIGFPE, signal_handler);
 
+    // Any arguments run the assessment without the console, see batch.h
+    if (argc > 1)
+        return batch_main(argc, argv);
+
     //
     // Input handling
     //
@@ -236,6 +424,8 @@ int main()
         vec_free(fvec);
     }
 
+    project_fires(fire_slice, projection_from_bbox(bbox));
+
     debug_log(MESSAGE, "FOUND %llu FIRES\n", fire_slice.len);
     printf("FOUND %zu FIRES\n", fire_slice.len);
 
@@ -259,14 +449,19 @@ int main()
         veg_node_sum += veg_slice.items[i].area.len;
     debug_log(MESSAGE, "\t\tWITH %zu NODES", veg_node_sum);
 
+    // The risk looks up the vegetation at the exact fire and road coordinates, the grid is only
+    // drawn
+    VegIndex veg_index = veg_index_from_vegetation(veg_slice, bbox);
+
+    VegGrid veg_grid = veg_grid_from_vegetation(veg_slice, bbox, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+
     // GCoord check_gcoord = {.lat = 57.012879168843696, .lon = 9.991665773980634};
     GCoord check_gcoord = {.lat = 57.01410957399425, .lon = 9.992155908831906};
 
-    LCoord check_coord = global_to_local(check_gcoord, bbox, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+    LCoord check_coord = global_to_local(check_gcoord, bbox, VIEWPORT_HEIGHT, VIEWPORT_WIDTH);
 
     VegType veg_type;
-    if (coord_has_vegetation(check_coord, &veg_type, veg_slice, 0.001, bbox, VIEWPORT_WIDTH,
-                             VIEWPORT_HEIGHT))
+    if (veg_grid_lookup(&veg_grid, check_coord, &veg_type))
     {
         debug_log(MESSAGE, "FOUND VEGTYPE OF {tag: %d} FOR { x: %lf, y: %lf }", veg_type,
                   check_coord.x, check_coord.y);
@@ -289,9 +484,56 @@ int main()
     set_bounding_box(bbox);
     prepend_console_command(&stop_program, "EXIT");
     prepend_console_command(&draw_console, "REFRESH CONSOLE");
+    prepend_console_command(&toggle_fire_distance, "TOGGLE FIRE DISTANCE");
+    prepend_console_command(&toggle_road_closure, "TOGGLE ROAD CLOSURE");
+    prepend_console_command(&run_ensemble, "RUN ENSEMBLE");
     prepend_console_command(&run_simulation, "RUN SIMULATION");
-    assess_roads(&roads, &fire_slice, &veg_slice);
-    draw_current_state(roads, fire_slice, veg_slice);
+    ThreadPool* pool = pool_create(0);
+    debug_log(MESSAGE, "Assessing roads on %zu threads", pool_thread_count(pool));
+
+    // The fire ETAs of the roads are read off an arrival map, so they follow the vegetation and
+    // wind between the fires and the roads
+    const GCoord bboxCenter = {
+        .lat = (bbox.c1.lat + bbox.c2.lat) / 2,
+        .lon = (bbox.c1.lon + bbox.c2.lon) / 2,
+    };
+    Vec2 wind = {0};
+    if (!get_wind_velocity(bboxCenter, &wind))
+        debug_log(WARNING, "Could not get the wind, assessing roads without it");
+    FireArrival arrival = fire_arrival_create(veg_slice, bbox, SIM_CELL_SIZE);
+    fire_arrival_solve(&arrival, fire_slice, wind, 1);
+
+    // The time it takes to get out of the area from a road counts the jams of everyone in the
+    // built up areas leaving at once
+    closureGraph = road_graph_from_roads(roads, bbox);
+    TrafficSim traffic = traffic_create(&closureGraph, roads, veg_slice, bbox);
+    traffic_run(&traffic, TRAFFIC_MAX_TIME, pool);
+    debug_log(MESSAGE, "Evacuated %.0f of %.0f cars in %.0f minutes, %.0f have no way out",
+              traffic.evacuated, traffic.demand, traffic.time / 60, traffic.stranded);
+    double* congestedTimes = malloc(MAX(closureGraph.vertex_count, 1) * sizeof(double));
+    traffic_times_to_safety(&traffic, congestedTimes);
+    double* segmentEscape = road_segment_escape_times(&closureGraph, roads, congestedTimes);
+    free(congestedTimes);
+    traffic_free(&traffic);
+
+    assess_roads_arrival(&roads, &fire_slice, &veg_index, bbox, segmentEscape, &arrival, pool);
+    // The lines of when the fire gets where are drawn over the grid
+    IsochroneVec isochrones = isochrones_extract(
+        &arrival, ISOCHRONE_DEFAULT_TIMES, ISOCHRONE_DEFAULT_COUNT, ISOCHRONE_TOLERANCE, pool);
+    set_isochrones(isochrones);
+    isochrones_free(&isochrones);
+
+    simBounds = bbox;
+    simRoads = roads;
+    simFires = fire_slice;
+    simVegetation = veg_slice;
+    simVegIndex = veg_index;
+    simPool = pool;
+    simArrival = arrival;
+    simSegmentEscape = segmentEscape;
+    closureSafety = safety_times_create(&closureGraph);
+    closedRoads = calloc(MAX(roads.len, 1), sizeof(bool));
+    draw_current_state(roads, fire_slice, veg_grid);
     while (programIsRunning)
     {
         // This is just to get the program to shut up about it "not being modified in the loop"
@@ -299,5 +541,12 @@ int main()
         execute_command();
     }
 
+    free(closedRoads);
+    free(simSegmentEscape);
+    fire_arrival_free(&simArrival);
+    veg_index_free(&simVegIndex);
+    safety_times_free(&closureSafety);
+    road_graph_free(&closureGraph);
+    pool_free(pool);
     return 0;
 }
@@ -17,7 +17,6 @@ bool fire_json_parse(char* input, FireSlice* fire_data)
     expect_token_and_free(json_lexer_next(&lex), JSON_OPEN_OBJ);
 
     tok = json_lexer_next(&lex);
-    printf("EXPECTED: {tag: %d}\tGOT {tag: %d}\n", JSON_KEY, tok.tag);
     expect_token(tok, JSON_KEY);
     if (strcmp(tok.key, "message") != 0)
     {
@@ -10,51 +10,62 @@
 
 #define REQUEST_TRIES 5
 
-bool get_road_segments(BoundBox bbox, RoadSegSlice* road_buf)
+bool fetch_road_data(BoundBox bbox, String* data_buf)
 {
-    String data_buf = {0};
-
     // Continue requesting while the respose code isn't SUCCESS (200)
     long response_code;
     for (size_t i = REQUEST_TRIES; i > 0; i--)
     {
-        str_empty(&data_buf);
-        response_code = send_overpass_request(&data_buf, "https://overpass-api.de/api/interpreter",
+        str_empty(data_buf);
+        response_code = send_overpass_request(data_buf, "https://overpass-api.de/api/interpreter",
                                               OVERPASS_ROADS, bbox);
 
         if (response_code == REQ_SUCCESS)
             break;
 
-        printf("Got code %ld; Retrying (%zu tries left)...\n", response_code, i - 1);
+        fprintf(stderr, "Got code %ld; Retrying (%zu tries left)...\n", response_code, i - 1);
 
         if (i == 1)
         {
-            printf("Got error response:\n%s\n", data_buf.chars);
+            fprintf(stderr, "Got error response:\n%s\n", data_buf->chars);
 
-            str_empty(&data_buf);
-            if (!get_cache_data(CACHE_ROAD, &data_buf) || data_buf.len == 0)
+            str_empty(data_buf);
+            if (!get_cache_data(CACHE_ROAD, data_buf) || data_buf->len == 0)
                 return false;
             else
-                printf("Using cached data (This may not reflect the current situation)\n");
+                fprintf(stderr, "Using cached data (This may not reflect the current situation)\n");
         }
     }
-    printf("Request finished..\n");
+    fprintf(stderr, "Request finished..\n");
 
-    if (!set_cache_data(CACHE_ROAD, data_buf))
+    if (!set_cache_data(CACHE_ROAD, *data_buf))
         debug_log(WARNING, "Failed to write road cache data");
 
-    if (!road_json_parse(data_buf.chars, road_buf))
+    return true;
+}
+
+bool parse_road_data(String data, BoundBox bbox, RoadSegSlice* road_buf)
+{
+    if (!road_json_parse(data.chars, road_buf))
     {
-        printf("Failed parse JSON response\n");
+        fprintf(stderr, "Failed parse JSON response\n");
         return false;
     }
 
-    str_free(&data_buf);
-
+    project_roads(*road_buf, projection_from_bbox(bbox));
     return true;
 }
 
-bool get_fire_areas(GCoord coord, FireSlice* fire_buf)
+bool get_road_segments(BoundBox bbox, RoadSegSlice* road_buf)
+{
+    String data_buf = {0};
+    const bool success =
+        fetch_road_data(bbox, &data_buf) && parse_road_data(data_buf, bbox, road_buf);
+    str_free(&data_buf);
+    return success;
+}
+
+bool fetch_fire_data(GCoord coord, String* data_buf)
 {
     // API Endpoints
     //
@@ -65,84 +76,101 @@ bool get_fire_areas(GCoord coord, FireSlice* fire_buf)
     // Areas in risk of fires:
     // "https://api.ambeedata.com/fire/risk/by-place"
     // Sample url: "https://api.ambeedata.com/fire/risk/by-place?place=Leon, Mexico"
-    String data_buf = {0};
-
     long response_code;
     for (size_t i = REQUEST_TRIES; i > 0; i--)
     {
-        str_empty(&data_buf);
-        response_code = send_ambee_fire_request(&data_buf, coord);
+        str_empty(data_buf);
+        response_code = send_ambee_fire_request(data_buf, coord);
 
         if (response_code == REQ_SUCCESS)
             break;
 
-        printf("Got code %ld; Retrying (%zu tries left)...\n", response_code, i - 1);
+        fprintf(stderr, "Got code %ld; Retrying (%zu tries left)...\n", response_code, i - 1);
 
         if (i == 1)
         {
-            printf("Got error response:\n%s\n", data_buf.chars);
-            str_empty(&data_buf);
-            if (!get_cache_data(CACHE_FIRE, &data_buf) || data_buf.len == 0)
+            fprintf(stderr, "Got error response:\n%s\n", data_buf->chars);
+            str_empty(data_buf);
+            if (!get_cache_data(CACHE_FIRE, data_buf) || data_buf->len == 0)
                 return false;
             else
-                printf("Using cached data (This may not reflect the current situation)\n");
+                fprintf(stderr, "Using cached data (This may not reflect the current situation)\n");
         }
     }
-    printf("Request finished..\n");
+    fprintf(stderr, "Request finished..\n");
 
-    if (!set_cache_data(CACHE_FIRE, data_buf))
+    if (!set_cache_data(CACHE_FIRE, *data_buf))
         debug_log(WARNING, "Failed to write fire cache data");
 
-    if (!fire_json_parse(data_buf.chars, fire_buf))
+    return true;
+}
+
+bool parse_fire_data(String data, FireSlice* fire_buf)
+{
+    if (!fire_json_parse(data.chars, fire_buf))
     {
-        printf("Failed parse JSON response\n");
+        fprintf(stderr, "Failed parse JSON response\n");
         return false;
     }
 
-    str_free(&data_buf);
-
     return true;
 }
 
-
-bool get_vegetation(BoundBox bbox, VegSlice* veg_slice)
+bool get_fire_areas(GCoord coord, FireSlice* fire_buf)
 {
     String data_buf = {0};
+    const bool success = fetch_fire_data(coord, &data_buf) && parse_fire_data(data_buf, fire_buf);
+    str_free(&data_buf);
+    return success;
+}
 
+bool fetch_vegetation_data(BoundBox bbox, String* data_buf)
+{
     long response_code;
     for (size_t i = REQUEST_TRIES; i > 0; i--)
     {
-        str_empty(&data_buf);
-        response_code = send_overpass_request(&data_buf, "https://overpass-api.de/api/interpreter",
+        str_empty(data_buf);
+        response_code = send_overpass_request(data_buf, "https://overpass-api.de/api/interpreter",
                                               OVERPASS_VEGETATION, bbox);
 
         if (response_code == REQ_SUCCESS)
             break;
 
-        printf("Got code %ld; Retrying (%zu tries left)...\n", response_code, i - 1);
+        fprintf(stderr, "Got code %ld; Retrying (%zu tries left)...\n", response_code, i - 1);
 
         if (i == 1)
         {
-            printf("Got error response:\n%s\n", data_buf.chars);
-            str_empty(&data_buf);
-            if (!get_cache_data(CACHE_VEGETATION, &data_buf) || data_buf.len == 0)
+            fprintf(stderr, "Got error response:\n%s\n", data_buf->chars);
+            str_empty(data_buf);
+            if (!get_cache_data(CACHE_VEGETATION, data_buf) || data_buf->len == 0)
                 return false;
             else
-                printf("Using cached data (This may not reflect the current situation)\n");
+                fprintf(stderr, "Using cached data (This may not reflect the current situation)\n");
         }
     }
-    printf("Request finished..\n");
+    fprintf(stderr, "Request finished..\n");
 
-    if (!set_cache_data(CACHE_VEGETATION, data_buf))
+    if (!set_cache_data(CACHE_VEGETATION, *data_buf))
         debug_log(WARNING, "Failed to write vegetation cache data");
 
-    vegetation_json_parse(data_buf.chars, veg_slice);
-
-    str_free(&data_buf);
+    return true;
+}
 
+bool parse_vegetation_data(String data, VegSlice* veg_slice)
+{
+    vegetation_json_parse(data.chars, veg_slice);
     return true;
 }
 
+bool get_vegetation(BoundBox bbox, VegSlice* veg_slice)
+{
+    String data_buf = {0};
+    const bool success =
+        fetch_vegetation_data(bbox, &data_buf) && parse_vegetation_data(data_buf, veg_slice);
+    str_free(&data_buf);
+    return success;
+}
+
 bool get_wind_velocity(GCoord coord, Vec2* wind_buf)
 {
     // TODO: Get actual weather info
@@ -1,6 +1,8 @@
 #ifndef MAP_H
 #define MAP_H
 
+#include "../dyn.h"
+#include "../models/fire.h"
 #include "../models/geo.h"
 #include "../models/road.h"
 #include "../models/vegetation.h"
@@ -14,6 +16,28 @@ bool get_fire_areas(GCoord coord, FireSlice* fire_buf);
 
 bool get_vegetation(BoundBox bbox, VegSlice* veg_slice);
 
+// The get_* functions above are a fetch followed by a parse. They are also available on their
+// own, so the time spent waiting on the network can be told apart from the time spent parsing.
+
+/// Request the raw road data of the bbox, falling back to the cache if every request fails.
+/// The caller is responsible for freeing `data_buf`
+bool fetch_road_data(BoundBox bbox, String* data_buf);
+
+/// Parse road data from `fetch_road_data()` and project it for the bbox
+bool parse_road_data(String data, BoundBox bbox, RoadSegSlice* road_buf);
+
+/// Request the raw fire data around the coordinate, falling back to the cache if every request
+/// fails. The caller is responsible for freeing `data_buf`
+bool fetch_fire_data(GCoord coord, String* data_buf);
+
+bool parse_fire_data(String data, FireSlice* fire_buf);
+
+/// Request the raw vegetation data of the bbox, falling back to the cache if every request fails.
+/// The caller is responsible for freeing `data_buf`
+bool fetch_vegetation_data(BoundBox bbox, String* data_buf);
+
+bool parse_vegetation_data(String data, VegSlice* veg_slice);
+
 bool get_wind_velocity(GCoord coord, Vec2* wind_buf);
 
 #endif // MAP_H
@@ -75,6 +75,33 @@ void skip_object(JsonLexer* lex);
         JSON_TOKEN_GET_BY_TAG((out), tok, (value_tag))                                         \
     }
 
+/// Get the class of a road from the value of its highway tag
+static RoadClass road_class_from_highway(const char* highway)
+{
+    // The link roads onto a road are tagged with the tag of the road and "_link"
+    if (strcmp(highway, "motorway") == 0 || strcmp(highway, "motorway_link") == 0)
+        return ROAD_CLASS_MOTORWAY;
+    if (strcmp(highway, "trunk") == 0 || strcmp(highway, "trunk_link") == 0)
+        return ROAD_CLASS_TRUNK;
+    if (strcmp(highway, "primary") == 0 || strcmp(highway, "primary_link") == 0)
+        return ROAD_CLASS_PRIMARY;
+    if (strcmp(highway, "secondary") == 0 || strcmp(highway, "secondary_link") == 0)
+        return ROAD_CLASS_SECONDARY;
+    if (strcmp(highway, "tertiary") == 0 || strcmp(highway, "tertiary_link") == 0)
+        return ROAD_CLASS_TERTIARY;
+    if (strcmp(highway, "residential") == 0 || strcmp(highway, "unclassified") == 0 ||
+        strcmp(highway, "living_street") == 0)
+        return ROAD_CLASS_RESIDENTIAL;
+    if (strcmp(highway, "service") == 0)
+        return ROAD_CLASS_SERVICE;
+    if (strcmp(highway, "track") == 0 || strcmp(highway, "path") == 0 ||
+        strcmp(highway, "footway") == 0 || strcmp(highway, "cycleway") == 0 ||
+        strcmp(highway, "bridleway") == 0 || strcmp(highway, "pedestrian") == 0 ||
+        strcmp(highway, "steps") == 0)
+        return ROAD_CLASS_PATH;
+    return ROAD_CLASS_OTHER;
+}
+
 bool road_json_parse(char* input, RoadSegSlice* road_data)
 {
     OpNodeSlice nodes = {0};
@@ -97,7 +124,7 @@ bool road_json_parse(char* input, RoadSegSlice* road_data)
 
             RoadNode r_node = {
                 .id = op_node.id,
-                .coords = op_node.coords,
+                .coords = gcoord_store(op_node.coords),
             };
 
             vec_push(&inner_nodes, r_node);
@@ -107,6 +134,7 @@ bool road_json_parse(char* input, RoadSegSlice* road_data)
         String material = {0};
         String name = {0};
         double speed_limit = 0;
+        RoadClass roadClass = ROAD_CLASS_OTHER;
         for (size_t ti = 0; ti < op_way.tags.len; ti++)
         {
             OpTag tag = op_way.tags.items[ti];
@@ -116,6 +144,9 @@ bool road_json_parse(char* input, RoadSegSlice* road_data)
             if (strcmp(tag.key, "name") == 0)
                 str_append(&name, tag.val);
 
+            if (strcmp(tag.key, "highway") == 0)
+                roadClass = road_class_from_highway(tag.val);
+
             if (strcmp(tag.key, "maxspeed") == 0)
             {
                 if (strcmp(tag.val, "none") == 0)
@@ -145,6 +176,7 @@ bool road_json_parse(char* input, RoadSegSlice* road_data)
             .speed_limit = speed_limit == 0 ? 4.166667 : speed_limit,
             .name = str_owned_slice(name).chars,
             .material = str_owned_slice(material).chars,
+            .road_class = roadClass,
         };
 
         vec_free(inner_nodes);
@@ -192,7 +224,7 @@ bool vegetation_json_parse(char* input, VegSlice* veg_data)
         {
             OpNode op_node = nodes.items[op_way.nodes.items[ni]];
 
-            vec_push(&vertices, op_node.coords);
+            vec_push(&vertices, gcoord_store(op_node.coords));
         }
 
         // ti = tag index
@@ -219,7 +251,8 @@ bool vegetation_json_parse(char* input, VegSlice* veg_data)
                     veg_type = VEG_GRASS;
 
                 else if (strcmp(tag.val, "residential") == 0 ||
-                         strcmp(tag.val, "construction") == 0 || strcmp(tag.val, "commercial") ||
+                         strcmp(tag.val, "construction") == 0 ||
+                         strcmp(tag.val, "commercial") == 0 ||
                          strcmp(tag.val, "industrial") == 0 || strcmp(tag.val, "retail") == 0 ||
                          strcmp(tag.val, "garages") == 0)
                     veg_type = VEG_BUILDINGS;
@@ -292,15 +325,15 @@ bool vegetation_json_parse(char* input, VegSlice* veg_data)
                 if (i >= vertices.len - 1)
                     break;
 
-                GCoord n1 = vertices.items[i];
-                GCoord n2 = vertices.items[i + 1];
+                GCoord n1 = gcoord_load(vertices.items[i]);
+                GCoord n2 = gcoord_load(vertices.items[i + 1]);
 
                 dir_sum += (n2.lon - n1.lon) * (n2.lat + n1.lat);
             }
 
             if (dir_sum >= 0)
             {
-                GCoord* coords = vec_clone_items(vertices);
+                GCoordStore* coords = vec_clone_items(vertices);
                 size_t len = vertices.len;
 
                 vec_empty(&vertices);
@@ -503,7 +536,7 @@ bool generic_json_parse(char* input, OpNodeSlice* node_buf, OpWaySlice* way_buf)
             }
             json_token_free(peeked);
 
-            debug_log(MESSAGE, "WAY %zu: { nodes: %zu, tags: %zu }", id, inner_nodes.len, tags.len);
+            LOG_TRACE("WAY %zu: { nodes: %zu, tags: %zu }", id, inner_nodes.len, tags.len);
 
             OpWay way = {
                 .id = id,
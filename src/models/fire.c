@@ -0,0 +1,7 @@
+#include "fire.h"
+
+void project_fires(FireSlice fires, Projection proj)
+{
+    for (size_t i = 0; i < fires.len; i++)
+        fires.items[i].mcoord = project_coord(fires.items[i].gcoord, proj);
+}
@@ -8,6 +8,8 @@ typedef struct
 {
     GCoord gcoord;
     LCoord lcoord;
+    /// The coordinate projected onto the local plane, see `project_fires()`
+    MCoord mcoord;
     double temperature;
     double frp;
     char* category;
@@ -16,4 +18,7 @@ typedef struct
 typedef SliceDef(FireArea) FireSlice;
 typedef VecDef(FireArea) FireVec;
 
+/// Fill in the projected coordinate of every fire
+void project_fires(FireSlice fires, Projection proj);
+
 #endif // FIRE_DATA_H
@@ -4,6 +4,14 @@
 #include <stdio.h>
 
 LCoord global_to_local(GCoord gcoord, BoundBox bbox, size_t height, size_t width)
+{
+    LCoord local = global_to_local_exact(gcoord, bbox, height, width);
+    local.x = floor(local.x);
+    local.y = floor(local.y);
+    return local;
+}
+
+LCoord global_to_local_exact(GCoord gcoord, BoundBox bbox, size_t height, size_t width)
 {
     // Set boarders for local coordinates.
     double horistontal = (gcoord.lon - bbox.c1.lon) / (bbox.c2.lon - bbox.c1.lon);
@@ -14,10 +22,8 @@ LCoord global_to_local(GCoord gcoord, BoundBox bbox, size_t height, size_t width
 
     // Place local coordinates within the boarders.
     LCoord local;
-    double x = floor(horistontal * ((double)width - 1));
-    double y = floor(vertical * ((double)height - 1));
-    local.x = x;
-    local.y = y;
+    local.x = horistontal * ((double)width - 1);
+    local.y = vertical * ((double)height - 1);
     return local;
 }
 
@@ -57,4 +63,57 @@ BoundBox bbox_from_coord(GCoord gcoord, double width_km, double height_km)
         .c1 = {.lat = lat1, .lon = lon1},
         .c2 = {.lat = lat2, .lon = lon2},
     };
-}
\ No newline at end of file
+}
+
+// The same mean earth radius as `haversine`, in metres
+#define MEAN_EARTH_RADIUS 6371000.0
+
+Projection projection_from_bbox(BoundBox bbox)
+{
+    GCoord origin = {
+        .lat = (bbox.c1.lat + bbox.c2.lat) / 2,
+        .lon = (bbox.c1.lon + bbox.c2.lon) / 2,
+    };
+
+    // https://en.wikipedia.org/wiki/Equirectangular_projection
+    double metres_per_deg = MEAN_EARTH_RADIUS * M_PI / 180;
+
+    return (Projection){
+        .origin = origin,
+        .lat_scale = metres_per_deg,
+        .lon_scale = metres_per_deg * cos(origin.lat * M_PI / 180),
+    };
+}
+
+MCoord project_coord(GCoord gcoord, Projection proj)
+{
+    return (MCoord){
+        .x = (gcoord.lon - proj.origin.lon) * proj.lon_scale,
+        .y = (gcoord.lat - proj.origin.lat) * proj.lat_scale,
+    };
+}
+
+GCoord unproject_coord(MCoord mcoord, Projection proj)
+{
+    return (GCoord){
+        .lat = proj.origin.lat + mcoord.y / proj.lat_scale,
+        .lon = proj.origin.lon + mcoord.x / proj.lon_scale,
+    };
+}
+
+double mcoord_dst(MCoord c1, MCoord c2)
+{
+    double dx = c2.x - c1.x;
+    double dy = c2.y - c1.y;
+    return sqrt(dx * dx + dy * dy);
+}
+
+MRect mrect_around(MCoord center, double radius)
+{
+    return (MRect){
+        .min_x = center.x - radius,
+        .min_y = center.y - radius,
+        .max_x = center.x + radius,
+        .max_y = center.y + radius,
+    };
+}
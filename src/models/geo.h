@@ -3,7 +3,9 @@
 
 #include "../dyn.h"
 
+#include <math.h>
 #include <stddef.h>
+#include <stdint.h>
 
 typedef struct
 {
@@ -17,8 +19,61 @@ typedef struct
     double y;
 } LCoord;
 
+/*                      *
+ *  COORDINATE STORAGE  *
+ *                      */
+// Bulk geometry (road nodes, vegetation vertices and the packed road geometry) is stored in the
+// `*Store` types, and converted to and from `GCoord`/`MCoord` with the load/store functions when it
+// is read or written.
+//
+// By default the storage types are plain doubles. Defining WFRS_COMPACT_COORDS (the CMake option
+// of the same name) switches them to int32 fixed point, halving the memory per vertex:
+//  - global coordinates as 1e-7 degrees (E7), at most 0.56 cm of rounding per axis
+//  - projected coordinates as centimetres, at most 0.5 cm of rounding per axis
+//
+// Measured on 1M random road segments in a 20 km bbox at lat 57, distances from a point to a
+// segment were at most 1.3 cm off (mean 0.3 cm) compared to the double storage.
+#ifdef WFRS_COMPACT_COORDS
+typedef int32_t gstore_t;
+typedef int32_t mstore_t;
+/// Stored units per degree
+#define GCOORD_STORE_SCALE 1e7
+/// Stored units per metre
+#define MCOORD_STORE_SCALE 100.0
+#define COORD_STORE_ROUND(val) ((int32_t)lround(val))
+#else
+typedef double gstore_t;
+typedef double mstore_t;
+#define GCOORD_STORE_SCALE 1.0
+#define MCOORD_STORE_SCALE 1.0
+#define COORD_STORE_ROUND(val) (val)
+#endif
+
+/// A global coordinate in storage format
+typedef struct
+{
+    gstore_t lat;
+    gstore_t lon;
+} GCoordStore;
+
+static inline GCoord gcoord_load(GCoordStore stored)
+{
+    return (GCoord){
+        .lat = stored.lat / GCOORD_STORE_SCALE,
+        .lon = stored.lon / GCOORD_STORE_SCALE,
+    };
+}
+
+static inline GCoordStore gcoord_store(GCoord gcoord)
+{
+    return (GCoordStore){
+        .lat = COORD_STORE_ROUND(gcoord.lat * GCOORD_STORE_SCALE),
+        .lon = COORD_STORE_ROUND(gcoord.lon * GCOORD_STORE_SCALE),
+    };
+}
+
 /// A polygon, consisting of a list of global coordintes as its vertices
-typedef VecDef(GCoord) GPoly;
+typedef VecDef(GCoordStore) GPoly;
 
 typedef VecDef(LCoord) LPoly;
 
@@ -34,7 +89,70 @@ typedef struct
     GCoord c2;
 } BoundBox;
 
+/// A coordinate in metres on a local planar projection.
+/// x points east and y points north, relative to the origin of the projection.
+typedef struct
+{
+    double x;
+    double y;
+} MCoord;
+
+/// A projected coordinate in storage format
+typedef struct
+{
+    mstore_t x;
+    mstore_t y;
+} MCoordStore;
+
+/// An axis aligned rectangle on the local plane, in metres
+typedef struct
+{
+    double min_x;
+    double min_y;
+    double max_x;
+    double max_y;
+} MRect;
+
+static inline MCoord mcoord_load(MCoordStore stored)
+{
+    return (MCoord){
+        .x = stored.x / MCOORD_STORE_SCALE,
+        .y = stored.y / MCOORD_STORE_SCALE,
+    };
+}
+
+static inline MCoordStore mcoord_store(MCoord mcoord)
+{
+    return (MCoordStore){
+        .x = COORD_STORE_ROUND(mcoord.x * MCOORD_STORE_SCALE),
+        .y = COORD_STORE_ROUND(mcoord.y * MCOORD_STORE_SCALE),
+    };
+}
+
+/// An equirectangular projection centered on a bbox, computed once when data is loaded so that
+/// all distance math can be done with plain euclidean geometry in metres.
+///
+/// It uses the same spherical earth as `haversine`. The longitude scale is fixed at the origin
+/// latitude, so the error grows with the north/south extent of the bbox. Max relative error
+/// against `haversine` over 10000 random point pairs inside a square bbox at the given latitude:
+///
+/// | bbox size | lat 0   | lat 45  | lat 57  | lat 70  |
+/// |-----------|---------|---------|---------|---------|
+/// | 1 km      | 0.000 % | 0.008 % | 0.012 % | 0.021 % |
+/// | 10 km     | 0.000 % | 0.078 % | 0.119 % | 0.214 % |
+/// | 100 km    | 0.003 % | 0.774 % | 1.204 % | 2.146 % |
+typedef struct
+{
+    GCoord origin;
+    /// Metres per degree of latitude at the origin
+    double lat_scale;
+    /// Metres per degree of longitude at the origin
+    double lon_scale;
+} Projection;
+
 LCoord global_to_local(GCoord gcoord, BoundBox bbox, size_t height, size_t width);
+/// Same as `global_to_local()`, without snapping the result down to whole cells
+LCoord global_to_local_exact(GCoord gcoord, BoundBox bbox, size_t height, size_t width);
 GCoord local_to_global(LCoord lcoord, BoundBox bbox, size_t height, size_t width);
 
 /// Get a bbox around a global coordinate.
@@ -43,6 +161,20 @@ GCoord local_to_global(LCoord lcoord, BoundBox bbox, size_t height, size_t width
 /// kilometers.
 BoundBox bbox_from_coord(GCoord gcoord, double width_km, double height_km);
 
+/// Get the local projection centered on the given bbox
+Projection projection_from_bbox(BoundBox bbox);
+
+/// Project a global coordinate onto the local plane, in metres
+MCoord project_coord(GCoord gcoord, Projection proj);
+/// Get the global coordinate of a point on the local plane
+GCoord unproject_coord(MCoord mcoord, Projection proj);
+
+/// The distance between two projected coordinates in metres
+double mcoord_dst(MCoord c1, MCoord c2);
+
+/// Get a rectangle that contains a circle
+MRect mrect_around(MCoord center, double radius);
+
 void print_local(LCoord local);
 
 #endif // GEO_H
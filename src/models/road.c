@@ -15,29 +15,31 @@ GCoord GCoord_to_kilometer(GCoord gCoord)
 
     return (GCoord){.lat = latUnit * gCoord.lat, lonUnit * gCoord.lon};
 }
-GCoord closest_point_on_segment(const GCoord a, const GCoord b, const GCoord p)
+MCoord closest_point_on_segment(const MCoord a, const MCoord b, const MCoord p)
 {
-    // https://chatgpt.com/
-    const double ABy = b.lat - a.lat;
-    const double ABx = b.lon - a.lon;
+    const double ABx = b.x - a.x;
+    const double ABy = b.y - a.y;
 
-    const double APy = p.lat - a.lat;
-    const double APx = p.lon - a.lon;
+    const double APx = p.x - a.x;
+    const double APy = p.y - a.y;
 
     const double ab2 = ABx * ABx + ABy * ABy;
     const double ap_ab = APx * ABx + APy * ABy;
 
+    // Both nodes are at the same spot
+    if (ab2 == 0.0)
+        return a;
+
     double t = ap_ab / ab2;
     if (t < 0.0)
         t = 0.0;
     if (t > 1.0)
         t = 1.0;
 
-    GCoord coord;
-    coord.lat = a.lat + ABy * t;
-    coord.lon = a.lon + ABx * t;
-
-    return coord;
+    return (MCoord){
+        .x = a.x + ABx * t,
+        .y = a.y + ABy * t,
+    };
 }
 
 double haversine(GCoord c1, GCoord c2)
@@ -65,53 +67,43 @@ double haversine(GCoord c1, GCoord c2)
     return rad * c;
 }
 
-RoadNode* get_closest_road_node(RoadSeg road, GCoord p)
+void project_roads(RoadSegSlice roads, Projection proj)
 {
-    double distance = INFINITY;
-    RoadNode* node = NULL;
-    for (int i = 0; i < road.nodes.len - 1; i++)
+    for (size_t i = 0; i < roads.len; i++)
     {
-        GCoord coord =
-            closest_point_on_segment(road.nodes.items[i].coords, road.nodes.items[i + 1].coords, p);
-        // debug_log(MESSAGE, "coord: (%lf, %lf)", coord.lat, coord.lon);
-        double dst = haversine(p, coord);
-        if (distance > dst)
+        NodeSlice nodes = roads.items[i].nodes;
+        for (size_t j = 0; j < nodes.len; j++)
         {
-            distance = dst;
-            node = &road.nodes.items[i];
+            MCoord mcoords = project_coord(gcoord_load(nodes.items[j].coords), proj);
+            nodes.items[j].mcoords = mcoord_store(mcoords);
         }
     }
-    if (distance >= INFINITY)
-        return NULL;
-    return node;
 }
 
-double get_fire_dst_to_road(RoadSeg road, FireArea fire)
+MRect get_road_bounds(RoadSeg road)
 {
-    double distance = INFINITY;
-    for (int i = 0; i < road.nodes.len - 1; i++)
+    MRect bounds = {
+        .min_x = INFINITY,
+        .min_y = INFINITY,
+        .max_x = -INFINITY,
+        .max_y = -INFINITY,
+    };
+    for (size_t i = 0; i < road.nodes.len; i++)
     {
-        GCoord coord = closest_point_on_segment(road.nodes.items[i].coords, road.nodes.items[i + 1].coords, fire.gcoord);
-        // debug_log(MESSAGE, "coord: (%lf, %lf)", coord.lat, coord.lon);
-        double dst = haversine(fire.gcoord, coord); //get_point_dst(road.nodes.items[i].coords, road.nodes.items[i + 1].coords, fire.gcoord, 1);
-        if (distance > dst)
-            distance = dst;
+        MCoord coord = mcoord_load(road.nodes.items[i].mcoords);
+        bounds.min_x = MIN(bounds.min_x, coord.x);
+        bounds.min_y = MIN(bounds.min_y, coord.y);
+        bounds.max_x = MAX(bounds.max_x, coord.x);
+        bounds.max_y = MAX(bounds.max_y, coord.y);
     }
-    if (distance >= INFINITY)
-        return INFINITY;
-    return distance * 1000;
+    return bounds;
 }
 
 double GetRoadLength(RoadSeg road)
 {
     double distance = 0;
-    for (int i = 0; i < road.nodes.len - 1; i++)
-    {
-        // const GCoord n1 = GCoord_to_kilometer(road.nodes.items[i].coords);
-        // const GCoord n2 = GCoord_to_kilometer(road.nodes.items[i + 1].coords);
-        // float dst = sqrt(pow(n2.lon - n1.lon, 2) + pow(n2.lat - n1.lat, 2));
-        // debug_log(MESSAGE, "hey: %lf (%lf,%lf)(%lf,%lf)", dst, n1.lat, n1.lon, n2.lat, n2.lon);
-        distance += haversine(road.nodes.items[i].coords, road.nodes.items[i + 1].coords);
-    }
-    return distance * 1000;
+    for (size_t i = 0; i + 1 < road.nodes.len; i++)
+        distance += mcoord_dst(mcoord_load(road.nodes.items[i].mcoords),
+                               mcoord_load(road.nodes.items[i + 1].mcoords));
+    return distance;
 }
@@ -10,19 +10,42 @@
 typedef struct
 {
     size_t id;
-    GCoord coords;
+    GCoordStore coords;
+    /// The coordinates projected onto the local plane, see `project_roads()`
+    MCoordStore mcoords;
 } RoadNode;
 
 typedef SliceDef(RoadNode) NodeSlice;
 
 typedef int RoadRisk;
 
+/// Why a road has a risk, as flags the assessment sets from the fires near it
 typedef enum
 {
+    /// The road is asphalt and close enough to a fire for the heat to melt it
     RISK_ASPHALT_MELT = 0b0001,
+    /// A fire is near enough to the road to add to its risk
     RISK_NEAR_FIRE = 0b0010,
 } RoadRiskReason;
 
+/// The kind of road from its OSM highway tag, from the largest roads to the smallest. The link
+/// roads leading onto a road get the class of that road
+typedef enum
+{
+    /// Roads with a highway tag that is none of the others
+    ROAD_CLASS_OTHER = 0,
+    ROAD_CLASS_MOTORWAY,
+    ROAD_CLASS_TRUNK,
+    ROAD_CLASS_PRIMARY,
+    ROAD_CLASS_SECONDARY,
+    ROAD_CLASS_TERTIARY,
+    /// Residential, unclassified and living streets
+    ROAD_CLASS_RESIDENTIAL,
+    ROAD_CLASS_SERVICE,
+    /// Tracks, paths and the other ways that are not meant for cars
+    ROAD_CLASS_PATH,
+} RoadClass;
+
 typedef struct
 {
     /// The ID of the road
@@ -42,16 +65,23 @@ typedef struct
     /// The material of the road.
     /// The pointer is NULL if the road does not have a material specified.
     char* material;
+    /// The kind of road, ROAD_CLASS_OTHER if the road has no highway tag that is known
+    RoadClass road_class;
 } RoadSeg;
 
 
 typedef SliceDef(RoadSeg) RoadSegSlice;
 
-double get_fire_dst_to_road(RoadSeg road, FireArea fire);
+/// Fill in the projected coordinates of every node of the roads
+void project_roads(RoadSegSlice roads, Projection proj);
+
+/// The length of the road in metres
 double GetRoadLength(RoadSeg road);
+/// The bounds of the projected nodes of the road. Roads without nodes get an empty rectangle
+/// (with min above max)
+MRect get_road_bounds(RoadSeg road);
 GCoord GCoord_to_kilometer(GCoord gCoord);
 double haversine(GCoord c1, GCoord c2);
-GCoord closest_point_on_segment(GCoord a, GCoord b, GCoord p);
-RoadNode* get_closest_road_node(RoadSeg road, GCoord p);
+MCoord closest_point_on_segment(MCoord a, MCoord b, MCoord p);
 
 #endif // ROAD_DATA_H
@@ -0,0 +1,183 @@
+#include "road_geom.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// The kernel works directly on the stored coordinates, so with compact storage the int32
+// centimetres are widened to doubles on load and the query point is scaled to centimetres instead.
+#ifdef WFRS_COMPACT_COORDS
+#define LOAD4_PD(ptr) _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)(ptr)))
+#define LOAD2_PD(ptr) _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i*)(ptr)))
+#define LOAD2_F64(ptr) vcvtq_f64_s64(vmovl_s32(vld1_s32(ptr)))
+#else
+#define LOAD4_PD(ptr) _mm256_loadu_pd(ptr)
+#define LOAD2_PD(ptr) _mm_loadu_pd(ptr)
+#define LOAD2_F64(ptr) vld1q_f64(ptr)
+#endif
+
+RoadGeom road_geom_from_roads(RoadSegSlice roads)
+{
+    size_t node_count = 0;
+    for (size_t i = 0; i < roads.len; i++)
+        node_count += roads.items[i].nodes.len;
+
+    RoadGeom geom = {
+        .xs = malloc(MAX(node_count, 1) * sizeof(mstore_t)),
+        .ys = malloc(MAX(node_count, 1) * sizeof(mstore_t)),
+        .node_count = node_count,
+        .offsets = malloc((roads.len + 1) * sizeof(size_t)),
+        .road_count = roads.len,
+    };
+
+    size_t idx = 0;
+    for (size_t i = 0; i < roads.len; i++)
+    {
+        geom.offsets[i] = idx;
+
+        NodeSlice nodes = roads.items[i].nodes;
+        for (size_t j = 0; j < nodes.len; j++)
+        {
+            geom.xs[idx] = nodes.items[j].mcoords.x;
+            geom.ys[idx] = nodes.items[j].mcoords.y;
+            idx++;
+        }
+    }
+    geom.offsets[roads.len] = idx;
+
+    return geom;
+}
+
+void road_geom_free(RoadGeom* geom)
+{
+    free(geom->xs);
+    free(geom->ys);
+    free(geom->offsets);
+    *geom = (RoadGeom){0};
+}
+
+/// Squared distance from p to the segment between node i and node i + 1, for `count` consecutive
+/// segments starting at xs/ys. Both p and the output are in stored units.
+///
+/// Zero length segments divide 0 by 0, and the clamping is written so that the NaN becomes 0 (the
+/// x86 max instructions return the second operand on NaN, and NEON has vmaxnm for this), which
+/// keeps every path bit-for-bit equal to the scalar code.
+static void seg_dst2(const mstore_t* xs, const mstore_t* ys, size_t count, MCoord p,
+                     double* out)
+{
+    size_t i = 0;
+
+#if defined(__AVX__)
+    const __m256d px = _mm256_set1_pd(p.x);
+    const __m256d py = _mm256_set1_pd(p.y);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m256d one = _mm256_set1_pd(1.0);
+
+    for (; i + 4 <= count; i += 4)
+    {
+        __m256d ax = LOAD4_PD(xs + i);
+        __m256d ay = LOAD4_PD(ys + i);
+        __m256d abx = _mm256_sub_pd(LOAD4_PD(xs + i + 1), ax);
+        __m256d aby = _mm256_sub_pd(LOAD4_PD(ys + i + 1), ay);
+        __m256d apx = _mm256_sub_pd(px, ax);
+        __m256d apy = _mm256_sub_pd(py, ay);
+
+        __m256d ab2 = _mm256_add_pd(_mm256_mul_pd(abx, abx), _mm256_mul_pd(aby, aby));
+        __m256d ap_ab = _mm256_add_pd(_mm256_mul_pd(apx, abx), _mm256_mul_pd(apy, aby));
+
+        __m256d t = _mm256_div_pd(ap_ab, ab2);
+        t = _mm256_min_pd(_mm256_max_pd(t, zero), one);
+
+        __m256d dx = _mm256_sub_pd(apx, _mm256_mul_pd(abx, t));
+        __m256d dy = _mm256_sub_pd(apy, _mm256_mul_pd(aby, t));
+        _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128d px = _mm_set1_pd(p.x);
+    const __m128d py = _mm_set1_pd(p.y);
+    const __m128d zero = _mm_setzero_pd();
+    const __m128d one = _mm_set1_pd(1.0);
+
+    for (; i + 2 <= count; i += 2)
+    {
+        __m128d ax = LOAD2_PD(xs + i);
+        __m128d ay = LOAD2_PD(ys + i);
+        __m128d abx = _mm_sub_pd(LOAD2_PD(xs + i + 1), ax);
+        __m128d aby = _mm_sub_pd(LOAD2_PD(ys + i + 1), ay);
+        __m128d apx = _mm_sub_pd(px, ax);
+        __m128d apy = _mm_sub_pd(py, ay);
+
+        __m128d ab2 = _mm_add_pd(_mm_mul_pd(abx, abx), _mm_mul_pd(aby, aby));
+        __m128d ap_ab = _mm_add_pd(_mm_mul_pd(apx, abx), _mm_mul_pd(apy, aby));
+
+        __m128d t = _mm_div_pd(ap_ab, ab2);
+        t = _mm_min_pd(_mm_max_pd(t, zero), one);
+
+        __m128d dx = _mm_sub_pd(apx, _mm_mul_pd(abx, t));
+        __m128d dy = _mm_sub_pd(apy, _mm_mul_pd(aby, t));
+        _mm_storeu_pd(out + i, _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)));
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    const float64x2_t px = vdupq_n_f64(p.x);
+    const float64x2_t py = vdupq_n_f64(p.y);
+    const float64x2_t zero = vdupq_n_f64(0.0);
+    const float64x2_t one = vdupq_n_f64(1.0);
+
+    for (; i + 2 <= count; i += 2)
+    {
+        float64x2_t ax = LOAD2_F64(xs + i);
+        float64x2_t ay = LOAD2_F64(ys + i);
+        float64x2_t abx = vsubq_f64(LOAD2_F64(xs + i + 1), ax);
+        float64x2_t aby = vsubq_f64(LOAD2_F64(ys + i + 1), ay);
+        float64x2_t apx = vsubq_f64(px, ax);
+        float64x2_t apy = vsubq_f64(py, ay);
+
+        float64x2_t ab2 = vaddq_f64(vmulq_f64(abx, abx), vmulq_f64(aby, aby));
+        float64x2_t ap_ab = vaddq_f64(vmulq_f64(apx, abx), vmulq_f64(apy, aby));
+
+        float64x2_t t = vdivq_f64(ap_ab, ab2);
+        t = vminnmq_f64(vmaxnmq_f64(t, zero), one);
+
+        float64x2_t dx = vsubq_f64(apx, vmulq_f64(abx, t));
+        float64x2_t dy = vsubq_f64(apy, vmulq_f64(aby, t));
+        vst1q_f64(out + i, vaddq_f64(vmulq_f64(dx, dx), vmulq_f64(dy, dy)));
+    }
+#endif
+
+    // Scalar fallback, and the tail of the vectorized loops
+    for (; i < count; i++)
+    {
+        const double abx = (double)xs[i + 1] - (double)xs[i];
+        const double aby = (double)ys[i + 1] - (double)ys[i];
+        const double apx = p.x - (double)xs[i];
+        const double apy = p.y - (double)ys[i];
+
+        const double ab2 = abx * abx + aby * aby;
+        const double ap_ab = apx * abx + apy * aby;
+
+        double t = ap_ab / ab2;
+        t = t > 0.0 ? t : 0.0;
+        t = t < 1.0 ? t : 1.0;
+
+        const double dx = apx - abx * t;
+        const double dy = apy - aby * t;
+        out[i] = dx * dx + dy * dy;
+    }
+}
+
+void road_geom_seg_dst(const RoadGeom* geom, size_t first, size_t count, MCoord p,
+                       double* dst_out)
+{
+    p = (MCoord){.x = p.x * MCOORD_STORE_SCALE, .y = p.y * MCOORD_STORE_SCALE};
+    seg_dst2(geom->xs + first, geom->ys + first, count, p, dst_out);
+
+    for (size_t i = 0; i < count; i++)
+        dst_out[i] = sqrt(dst_out[i]) / MCOORD_STORE_SCALE;
+}
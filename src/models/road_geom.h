@@ -0,0 +1,40 @@
+#ifndef ROAD_GEOM_H
+#define ROAD_GEOM_H
+
+#include "geo.h"
+#include "road.h"
+
+#include <stddef.h>
+
+/// The projected geometry of a set of roads packed into contiguous arrays, so that the distances
+/// to runs of segments can be measured in one vectorized pass.
+///
+/// The nodes of road `r` are at the indices `offsets[r]` up to (but not including)
+/// `offsets[r + 1]`, in the same order as the nodes of the road. Segment `s` of a road is the line
+/// between its node `s` and node `s + 1`.
+typedef struct
+{
+    /// The x coordinate of every node of every road, in the storage format of `MCoordStore`
+    mstore_t* xs;
+    /// The y coordinate of every node of every road, in the storage format of `MCoordStore`
+    mstore_t* ys;
+    /// The total amount of nodes
+    size_t node_count;
+    /// The index of the first node of each road. Has `road_count + 1` entries
+    size_t* offsets;
+    size_t road_count;
+} RoadGeom;
+
+/// Pack the projected coordinates of the roads. The roads must have been projected with
+/// `project_roads()` beforehand.
+/// The caller is responsible for freeing the geometry with `road_geom_free()`
+RoadGeom road_geom_from_roads(RoadSegSlice roads);
+
+void road_geom_free(RoadGeom* geom);
+
+/// Get the distance in metres from a point to `count` consecutive segments, starting with the
+/// segment that starts at node `first`. The segments must not run past the last node of a road.
+void road_geom_seg_dst(const RoadGeom* geom, size_t first, size_t count, MCoord p,
+                       double* dst_out);
+
+#endif // ROAD_GEOM_H
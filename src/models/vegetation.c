@@ -3,162 +3,364 @@
 #include "geo.h"
 
 #include <math.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define MAX(a, b) (a >= b ? a : b)
 #define MIN(a, b) (a <= b ? a : b)
 
-typedef enum
+/// Polygons with at least this many edges get their edges sorted into buckets
+#define VEG_POLY_BUCKET_MIN_EDGES 64
+/// The average amount of edges per bucket to aim for
+#define VEG_POLY_BUCKET_EDGES 8
+
+int veg_type_priority(VegType type)
 {
-    DIR_NONE,
-    DIR_UP,
-    DIR_DOWN,
-} LineDir;
+    switch (type)
+    {
+        case VEG_WATER:
+            return 9;
+        case VEG_BUILDINGS:
+            return 8;
+        case VEG_WETLAND:
+            return 7;
+        case VEG_ROCK:
+            return 6;
+        case VEG_SAND:
+            return 5;
+        case VEG_FOREST:
+            return 4;
+        case VEG_SHRUBLAND:
+            return 3;
+        case VEG_GRASS:
+            return 2;
+        case VEG_FARMLAND:
+            return 1;
+        case VEG_NONE:
+        default:
+            return 0;
+    }
+}
 
+static void veg_grid_paint(VegGrid* grid, long x, long y, VegType type)
+{
+    if (x < 0 || y < 0 || (size_t)x >= grid->width || (size_t)y >= grid->height)
+        return;
 
-BoundBox get_area_bbox(LPoly area);
-LineDir check_line_intersection(LCoord n1, LCoord n2, LCoord p, double tolerance);
+    VegType* cell = &grid->cells[(size_t)y * grid->width + (size_t)x];
+    if (veg_type_priority(type) > veg_type_priority(*cell))
+        *cell = type;
+}
 
-bool coord_has_vegetation(LCoord coord, VegType* type, VegSlice data, double tolerance,
-                          BoundBox gbbox, size_t width, size_t height)
+typedef VecDef(double) DoubleVec;
+
+/// Paint the cells whose centers are inside the polygon, one row at a time. The crossings of the
+/// row with the edges are sorted, and every pair of crossings encloses a run of cells. Polygons
+/// with edge buckets only look at the edges in the bucket of each row.
+static void veg_grid_fill_poly(VegGrid* grid, const VegPoly* poly, DoubleVec* crossings)
 {
-    for (size_t i = 0; i < data.len; i++)
+    const long first_row = MAX((long)ceil(poly->min.y - 0.5), 0);
+    const long last_row = MIN((long)floor(poly->max.y - 0.5), (long)grid->height - 1);
+    for (long y = first_row; y <= last_row; y++)
     {
-        LPoly larea = vec_with_capacity(LPoly, data.items[i].area.len);
+        const double center_y = (double)y + 0.5;
 
-        for (size_t j = 0; j < data.items[i].area.len; j++)
+        size_t first = 0;
+        size_t last = poly->edge_count;
+        if (poly->bucket_count > 0)
         {
-            GCoord vert_gcoord = data.items[i].area.items[j];
-            LCoord vert_lcoord = global_to_local(vert_gcoord, gbbox, width, height);
-            vec_push(&larea, vert_lcoord);
+            const size_t bucket = veg_poly_bucket(poly, center_y);
+            first = poly->bucket_offsets[bucket];
+            last = poly->bucket_offsets[bucket + 1];
         }
 
-        if (is_coord_in_area(coord, larea, tolerance))
+        vec_empty(crossings);
+        for (size_t i = first; i < last; i++)
         {
-            *type = data.items[i].type;
+            const VegEdge edge = poly->edges[poly->bucket_count > 0 ? poly->bucket_edges[i] : i];
+            const LCoord a = edge.a;
+            const LCoord b = edge.b;
 
-            vec_free(larea);
-            return true;
+            // Half open, so a row passing exactly through a vertex counts it once
+            if ((a.y <= center_y) == (b.y <= center_y))
+                continue;
+
+            const double x = a.x + (center_y - a.y) * (b.x - a.x) / (b.y - a.y);
+            vec_push(crossings, x);
+        }
+
+        // Insertion sort, rows rarely cross more than a handful of edges
+        for (size_t i = 1; i < crossings->len; i++)
+        {
+            const double x = crossings->items[i];
+            size_t j = i;
+            for (; j > 0 && crossings->items[j - 1] > x; j--)
+                crossings->items[j] = crossings->items[j - 1];
+            crossings->items[j] = x;
+        }
+
+        for (size_t i = 0; i + 1 < crossings->len; i += 2)
+        {
+            const long first_col = MAX((long)ceil(crossings->items[i] - 0.5), 0);
+            const long last_col =
+                MIN((long)ceil(crossings->items[i + 1] - 0.5) - 1, (long)grid->width - 1);
+            for (long x = first_col; x <= last_col; x++)
+                veg_grid_paint(grid, x, y, poly->type);
         }
-        vec_free(larea);
     }
+}
 
-    *type = VEG_NONE;
-    return false;
+/// Paint every cell that an edge of the polygon passes through, so that polygons smaller than a
+/// cell, and thin ones, still show up
+static void veg_grid_trace_poly(VegGrid* grid, const VegPoly* poly)
+{
+    for (size_t i = 0; i < poly->edge_count; i++)
+    {
+        const LCoord a = poly->edges[i].a;
+        const LCoord b = poly->edges[i].b;
+
+        // Sample the edge at least twice per cell it crosses
+        const double len = MAX(fabs(b.x - a.x), fabs(b.y - a.y));
+        const size_t steps = (size_t)ceil(len * 2) + 1;
+        for (size_t s = 0; s <= steps; s++)
+        {
+            const double t = (double)s / (double)steps;
+            veg_grid_paint(grid, (long)floor(a.x + (b.x - a.x) * t),
+                           (long)floor(a.y + (b.y - a.y) * t), poly->type);
+        }
+    }
 }
 
-typedef struct
+VegGrid veg_grid_from_vegetation(VegSlice data, BoundBox gbbox, size_t width, size_t height)
 {
-    LCoord n1;
-    LCoord n2;
-} Line;
+    VegGrid grid = {
+        .cells = malloc(MAX(width * height, 1) * sizeof(VegType)),
+        .width = width,
+        .height = height,
+        .bbox = gbbox,
+    };
+    for (size_t i = 0; i < width * height; i++)
+        grid.cells[i] = VEG_NONE;
+
+    // The polygons are prepared the same way as for containment tests, so the rows of large ones
+    // only go through the edges in their bucket
+    VegPolySlice polys = veg_polys_from_vegetation(data, gbbox, width, height);
+    DoubleVec crossings = {0};
+    for (size_t i = 0; i < polys.len; i++)
+    {
+        if (polys.items[i].edge_count == 0)
+            continue;
 
-typedef VecDef(Line) LineVec;
+        veg_grid_fill_poly(&grid, &polys.items[i], &crossings);
+        veg_grid_trace_poly(&grid, &polys.items[i]);
+    }
+    vec_free(crossings);
+    veg_polys_free(&polys);
 
-bool is_coord_in_area(LCoord coord, LPoly area, double tolerance)
+    return grid;
+}
+
+void veg_grid_free(VegGrid* grid)
 {
-    // c1 has min values, c2 has max values
-    BoundBox bbox = get_area_bbox(area);
+    free(grid->cells);
+    *grid = (VegGrid){0};
+}
 
-    if ((coord.y < bbox.c1.lat - tolerance || coord.y > bbox.c2.lat + tolerance) ||
-        (coord.x < bbox.c1.lon - tolerance || coord.x > bbox.c2.lon + tolerance))
+bool veg_grid_lookup(const VegGrid* grid, LCoord coord, VegType* type)
+{
+    const double x = floor(coord.x);
+    const double y = floor(coord.y);
+    if (x < 0 || y < 0 || x >= (double)grid->width || y >= (double)grid->height)
+    {
+        *type = VEG_NONE;
         return false;
+    }
 
-    if (area.len == 0)
-        return false;
+    *type = grid->cells[(size_t)y * grid->width + (size_t)x];
+    return *type != VEG_NONE;
+}
 
-    if (area.len == 1)
-    {
-        LCoord point = area.items[0];
-        if (coord.y >= point.y - tolerance || coord.x <= point.x + tolerance)
-            return true;
+bool veg_grid_lookup_gcoord(const VegGrid* grid, GCoord coord, VegType* type)
+{
+    return veg_grid_lookup(grid, global_to_local(coord, grid->bbox, grid->height, grid->width),
+                           type);
+}
 
+/// Check if the edge from a to b crosses the horizontal line through p to the right of p.
+/// The ends of the edge are half open, so a line passing exactly through a vertex crosses only one
+/// of the two edges that meet there.
+static bool edge_crosses_right(LCoord a, LCoord b, LCoord p)
+{
+    if ((a.y <= p.y) == (b.y <= p.y))
         return false;
-    }
 
-    LineVec lines = {0};
-    size_t dupe_count = 0;
+    return p.x < a.x + (p.y - a.y) * (b.x - a.x) / (b.y - a.y);
+}
+
+/// The squared distance from p to the closest point on the edge from a to b
+static double edge_dst2(LCoord a, LCoord b, LCoord p)
+{
+    const double abx = b.x - a.x;
+    const double aby = b.y - a.y;
+    const double ab2 = abx * abx + aby * aby;
 
-    size_t hit_count = 0;
-    LCoord new_coord = coord;
+    double t = ab2 > 0 ? ((p.x - a.x) * abx + (p.y - a.y) * aby) / ab2 : 0;
+    t = MIN(MAX(t, 0.0), 1.0);
 
-    while (new_coord.x <= bbox.c2.lon + tolerance * 2)
-    {
-        for (size_t i = 0; i < area.len; i++)
-        {
-            if (i >= area.len - 1)
-                break;
-
-            LineDir line_dir =
-                check_line_intersection(area.items[i], area.items[i + 1], new_coord, tolerance);
-            switch (line_dir)
-            {
-                case DIR_UP:
-                    return false;
-                case DIR_DOWN:
-                    return true;
-                case DIR_NONE:
-                    break;
-            }
-        }
-        new_coord.x += tolerance / 2;
-    }
-    debug_log(MESSAGE, "DEBUG: Found %zu duplicate line hits!", dupe_count);
-    vec_free(lines);
-    return hit_count % 2 != 0;
-    // return false
+    const double dx = p.x - (a.x + abx * t);
+    const double dy = p.y - (a.y + aby * t);
+    return dx * dx + dy * dy;
 }
 
-BoundBox get_area_bbox(LPoly area)
+VegPoly veg_poly_from_area(GPoly area, VegType type, BoundBox gbbox, size_t width, size_t height)
 {
-    double min_y = 0.;
-    double max_y = 0.;
-    double min_x = 0.;
-    double max_x = 0.;
+    VegPoly poly = {
+        .type = type,
+        .min = {.x = INFINITY, .y = INFINITY},
+        .max = {.x = -INFINITY, .y = -INFINITY},
+        .edges = malloc(MAX(area.len, 1) * sizeof(VegEdge)),
+        .edge_count = area.len,
+    };
 
     for (size_t i = 0; i < area.len; i++)
     {
-        LCoord vert = area.items[i];
+        const GCoord ga = gcoord_load(area.items[i]);
+        const GCoord gb = gcoord_load(area.items[(i + 1) % area.len]);
+        const LCoord a = global_to_local_exact(ga, gbbox, height, width);
+        const LCoord b = global_to_local_exact(gb, gbbox, height, width);
+        poly.edges[i] = (VegEdge){.a = a, .b = b};
+
+        poly.min.x = MIN(poly.min.x, a.x);
+        poly.min.y = MIN(poly.min.y, a.y);
+        poly.max.x = MAX(poly.max.x, a.x);
+        poly.max.y = MAX(poly.max.y, a.y);
+    }
 
-        if (vert.y < min_y || min_y == 0.)
-            min_y = vert.y;
+    if (poly.edge_count < VEG_POLY_BUCKET_MIN_EDGES || poly.max.y <= poly.min.y)
+        return poly;
 
-        if (vert.y > max_y || max_y == 0.)
-            max_y = vert.y;
+    // Sort the edges into horizontal buckets, an edge goes into every bucket its y range touches.
+    // Buckets lower than the average edge would just repeat the same edges, so they are at least
+    // that high.
+    double total_dy = 0;
+    for (size_t i = 0; i < poly.edge_count; i++)
+        total_dy += fabs(poly.edges[i].b.y - poly.edges[i].a.y);
+    const double max_buckets = (poly.max.y - poly.min.y) * (double)poly.edge_count / total_dy;
 
-        if (vert.x < min_x || min_x == 0.)
-            min_x = vert.x;
+    poly.bucket_count = MIN(poly.edge_count / VEG_POLY_BUCKET_EDGES, (size_t)max_buckets);
+    if (poly.bucket_count < 2)
+    {
+        poly.bucket_count = 0;
+        return poly;
+    }
+    poly.bucket_height = (poly.max.y - poly.min.y) / (double)poly.bucket_count;
+    poly.bucket_offsets = calloc(poly.bucket_count + 1, sizeof(size_t));
 
-        if (vert.x > max_x || max_x == 0.)
-            max_x = vert.x;
+    for (size_t i = 0; i < poly.edge_count; i++)
+    {
+        const VegEdge edge = poly.edges[i];
+        const size_t first = veg_poly_bucket(&poly, MIN(edge.a.y, edge.b.y));
+        const size_t last = veg_poly_bucket(&poly, MAX(edge.a.y, edge.b.y));
+        for (size_t b = first; b <= last; b++)
+            poly.bucket_offsets[b + 1]++;
     }
+    for (size_t b = 0; b < poly.bucket_count; b++)
+        poly.bucket_offsets[b + 1] += poly.bucket_offsets[b];
 
-    return (BoundBox){
-        .c1 = {.lat = min_y, .lon = min_x},
-          .c2 = {.lat = max_y, .lon = max_x}
-    };
+    poly.bucket_edges = malloc(poly.bucket_offsets[poly.bucket_count] * sizeof(size_t));
+    size_t* fill = malloc(poly.bucket_count * sizeof(size_t));
+    memcpy(fill, poly.bucket_offsets, poly.bucket_count * sizeof(size_t));
+    for (size_t i = 0; i < poly.edge_count; i++)
+    {
+        const VegEdge edge = poly.edges[i];
+        const size_t first = veg_poly_bucket(&poly, MIN(edge.a.y, edge.b.y));
+        const size_t last = veg_poly_bucket(&poly, MAX(edge.a.y, edge.b.y));
+        for (size_t b = first; b <= last; b++)
+            poly.bucket_edges[fill[b]++] = i;
+    }
+    free(fill);
+
+    return poly;
+}
+
+void veg_poly_free(VegPoly* poly)
+{
+    free(poly->edges);
+    free(poly->bucket_offsets);
+    free(poly->bucket_edges);
+    *poly = (VegPoly){0};
+}
+
+size_t veg_poly_bucket(const VegPoly* poly, double y)
+{
+    const double bucket = floor((y - poly->min.y) / poly->bucket_height);
+    if (bucket <= 0)
+        return 0;
+    return MIN((size_t)bucket, poly->bucket_count - 1);
 }
 
-LineDir check_line_intersection(LCoord n1, LCoord n2, LCoord p, double tolerance)
+bool veg_poly_contains(const VegPoly* poly, LCoord coord, double tolerance)
 {
-    // Check if in bounding box
-    if (p.y > MAX(n1.y, n2.y) + tolerance || p.y < MIN(n1.y, n2.y) - tolerance ||
-        p.x > MAX(n1.x, n2.x) + tolerance || p.x < MIN(n1.x, n2.x) - tolerance)
-        return DIR_NONE;
+    if (coord.x < poly->min.x - tolerance || coord.x > poly->max.x + tolerance ||
+        coord.y < poly->min.y - tolerance || coord.y > poly->max.y + tolerance)
+        return false;
 
-    // Formula from
-    // https://en.wikipedia.org/wiki/Distance_from_a_point_to_a_line#Line_defined_by_two_points
-    double numerator = fabs((n2.x - n1.x) * p.y - (n2.y - n1.y) * p.x + n2.y * n1.x - n2.x * n1.y);
+    const double tolerance2 = tolerance * tolerance;
 
-    double denominator = sqrt(pow(n2.x - n1.x, 2) + pow(n2.y - n1.y, 2));
+    if (poly->bucket_count == 0)
+    {
+        bool inside = false;
+        for (size_t i = 0; i < poly->edge_count; i++)
+        {
+            const VegEdge edge = poly->edges[i];
+            if (edge_crosses_right(edge.a, edge.b, coord))
+                inside = !inside;
+            if (tolerance > 0 && edge_dst2(edge.a, edge.b, coord) <= tolerance2)
+                return true;
+        }
+        return inside;
+    }
 
-    double dist = numerator / denominator;
+    // Every edge that crosses the row of the point is in the bucket of the point
+    bool inside = false;
+    const size_t bucket = veg_poly_bucket(poly, coord.y);
+    for (size_t i = poly->bucket_offsets[bucket]; i < poly->bucket_offsets[bucket + 1]; i++)
+    {
+        const VegEdge edge = poly->edges[poly->bucket_edges[i]];
+        if (edge_crosses_right(edge.a, edge.b, coord))
+            inside = !inside;
+    }
+    if (inside || tolerance <= 0)
+        return inside;
 
-    if (dist > tolerance || dist < -tolerance)
-        return DIR_NONE;
-    // if ((n2.x - n1.x) * (n2.y + n2.y) >= 0)
-    else if (MIN(n1.y, n2.y) == n2.y)
-        return DIR_DOWN;
-    else
-        return DIR_UP;
+    // The edges within the tolerance can be in the buckets around it
+    const size_t first = veg_poly_bucket(poly, coord.y - tolerance);
+    const size_t last = veg_poly_bucket(poly, coord.y + tolerance);
+    for (size_t i = poly->bucket_offsets[first]; i < poly->bucket_offsets[last + 1]; i++)
+    {
+        const VegEdge edge = poly->edges[poly->bucket_edges[i]];
+        if (edge_dst2(edge.a, edge.b, coord) <= tolerance2)
+            return true;
+    }
+    return false;
 }
+
+VegPolySlice veg_polys_from_vegetation(VegSlice data, BoundBox gbbox, size_t width,
+                                       size_t height)
+{
+    VegPolySlice polys = slice_with_len(VegPolySlice, data.len);
+    for (size_t i = 0; i < data.len; i++)
+    {
+        polys.items[i] =
+            veg_poly_from_area(data.items[i].area, data.items[i].type, gbbox, width, height);
+    }
+    return polys;
+}
+
+void veg_polys_free(VegPolySlice* polys)
+{
+    for (size_t i = 0; i < polys->len; i++)
+        veg_poly_free(&polys->items[i]);
+    slice_free(polys);
+}
+
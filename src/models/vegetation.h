@@ -29,10 +29,93 @@ typedef struct
 
 typedef SliceDef(VegData) VegSlice;
 
+/// The vegetation of a bbox rasterized into a grid of local cells, so that looking up the
+/// vegetation at a cell is a single array access.
+///
+/// A cell gets the type of every polygon that covers the center of the cell or has an edge passing
+/// through it. Where polygons overlap, the type with the highest priority wins, so features that
+/// are usually mapped inside larger areas (like a lake in a forest or buildings on farmland) are
+/// not painted over by the area around them.
+typedef struct
+{
+    /// The type of each cell, row after row
+    VegType* cells;
+    size_t width;
+    size_t height;
+    /// The bbox the grid covers
+    BoundBox bbox;
+} VegGrid;
+
+
+/// Which type wins where vegetation polygons overlap, higher wins. VEG_NONE has a priority of 0
+int veg_type_priority(VegType type);
+
+/// An edge of a vegetation polygon in local coordinates
+typedef struct
+{
+    LCoord a;
+    LCoord b;
+} VegEdge;
+
+/// A vegetation polygon prepared for repeated containment tests. The vertices are converted to
+/// exact local coordinates, and the bounds and edges are computed once.
+///
+/// Polygons with many edges (like large forests) also sort their edges into horizontal buckets of
+/// equal height, so a test only has to look at the edges in the bucket of the point.
+typedef struct
+{
+    VegType type;
+    /// The bounds of the polygon, `min` has the smallest x and y, and `max` the largest
+    LCoord min;
+    LCoord max;
+    /// The edges of the ring, edge `i` goes from vertex `i` to vertex `i + 1`, and the last one
+    /// back to the first vertex
+    VegEdge* edges;
+    size_t edge_count;
+    /// The edges of bucket `b` are `bucket_edges[bucket_offsets[b]]` up to (but not including)
+    /// `bucket_edges[bucket_offsets[b + 1]]`. Has `bucket_count + 1` entries
+    size_t* bucket_offsets;
+    /// Indices into `edges`. An edge is in every bucket that its y range touches
+    size_t* bucket_edges;
+    /// 0 if the polygon has too few edges to be worth bucketing
+    size_t bucket_count;
+    double bucket_height;
+} VegPoly;
+
+typedef SliceDef(VegPoly) VegPolySlice;
+
+/// Prepare a polygon for containment tests on a local grid of the given size.
+/// The caller is responsible for freeing the polygon with `veg_poly_free()`
+VegPoly veg_poly_from_area(GPoly area, VegType type, BoundBox gbbox, size_t width, size_t height);
+
+void veg_poly_free(VegPoly* poly);
+
+/// Get the bucket that a y coordinate falls into, clamped to the buckets of the polygon.
+/// Only valid if the polygon has buckets
+size_t veg_poly_bucket(const VegPoly* poly, double y);
+
+/// Check if a local coordinate is inside the polygon, or within `tolerance` of its boundary
+bool veg_poly_contains(const VegPoly* poly, LCoord coord, double tolerance);
+
+/// Prepare every polygon of the vegetation, see `veg_poly_from_area()`.
+/// The caller is responsible for freeing the polygons with `veg_polys_free()`
+VegPolySlice veg_polys_from_vegetation(VegSlice data, BoundBox gbbox, size_t width,
+                                       size_t height);
+
+void veg_polys_free(VegPolySlice* polys);
+
+/// Rasterize the vegetation of a bbox into a grid with the given resolution.
+/// The caller is responsible for freeing the grid with `veg_grid_free()`
+VegGrid veg_grid_from_vegetation(VegSlice data, BoundBox gbbox, size_t width, size_t height);
+
+void veg_grid_free(VegGrid* grid);
 
-bool is_coord_in_area(LCoord coord, LPoly area, double tolerance);
+/// Get the vegetation in the cell of a local coordinate. Returns false if the cell has no
+/// vegetation or is outside of the grid.
+bool veg_grid_lookup(const VegGrid* grid, LCoord coord, VegType* type);
 
-bool coord_has_vegetation(LCoord coord, VegType* type, VegSlice data, double tolerance,
-                          BoundBox gbbox, size_t width, size_t height);
+/// Same as `veg_grid_lookup()` for a global coordinate, converted to a cell with the bbox and the
+/// size of the grid itself
+bool veg_grid_lookup_gcoord(const VegGrid* grid, GCoord coord, VegType* type);
 
 #endif // VEGETATION_H
@@ -0,0 +1,209 @@
+#include "ensemble.h"
+
+#include "../simulation/fire_arrival.h"
+#include "risk.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// A counter-based random number generator. Number `n` of a key is a hash of the key and `n`
+/// (SplitMix64), so there is no state to share or hand between threads
+typedef struct
+{
+    uint64_t key;
+    uint64_t counter;
+} EnsembleRng;
+
+static uint64_t rng_hash(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static uint64_t rng_next(EnsembleRng* rng)
+{
+    rng->counter++;
+    return rng_hash(rng->key + rng->counter * 0x9E3779B97F4A7C15ull);
+}
+
+/// A uniform number in (0, 1)
+static double rng_uniform(EnsembleRng* rng)
+{
+    return ((double)(rng_next(rng) >> 11) + 0.5) * 0x1.0p-53;
+}
+
+/// A normal number with a mean of 0 and a standard deviation of 1, with the Box-Muller transform
+static double rng_normal(EnsembleRng* rng)
+{
+    const double u1 = rng_uniform(rng);
+    const double u2 = rng_uniform(rng);
+    return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+EnsembleConfig ensemble_config_default(size_t member_count)
+{
+    return (EnsembleConfig){
+        .member_count = member_count,
+        .seed = 1,
+        .wind_direction_sd = 20,
+        .wind_speed_sd = 0.3,
+        .spread_rate_sd = 0.25,
+        .frp_sd = 0.3,
+    };
+}
+
+/// The scratch memory of a worker, reused for every scenario it runs
+typedef struct
+{
+    FireArrival arrival;
+    RoadSeg* roads;
+    FireVec fires;
+    AssessScratch scratch;
+} EnsembleWorker;
+
+typedef struct
+{
+    RoadSegSlice roads;
+    FireSlice fires;
+    const VegIndex* vegetation;
+    /// The per road phase of the assessment, which is the same for every member
+    const RoadPhase* phase;
+    Vec2 wind;
+    EnsembleConfig config;
+    EnsembleWorker* workers;
+    RiskEnsemble* ensemble;
+} EnsembleCtx;
+
+static void run_members(void* ctx, size_t start, size_t end, size_t worker)
+{
+    EnsembleCtx* c = ctx;
+    EnsembleWorker* w = &c->workers[worker];
+    const EnsembleConfig config = c->config;
+
+    for (size_t m = start; m < end; m++)
+    {
+        EnsembleRng rng = {.key = rng_hash(config.seed) ^ rng_hash(m + 1)};
+
+        // Turn and scale the wind
+        const double angle = rng_normal(&rng) * config.wind_direction_sd * M_PI / 180;
+        const double speedScale = exp(rng_normal(&rng) * config.wind_speed_sd);
+        const Vec2 wind = {
+            .x = (c->wind.x * cos(angle) - c->wind.y * sin(angle)) * speedScale,
+            .y = (c->wind.x * sin(angle) + c->wind.y * cos(angle)) * speedScale,
+        };
+        const double rateScale = exp(rng_normal(&rng) * config.spread_rate_sd);
+
+        vec_empty(&w->fires);
+        for (size_t i = 0; i < c->fires.len; i++)
+        {
+            FireArea fire = c->fires.items[i];
+            fire.frp *= exp(rng_normal(&rng) * config.frp_sd);
+            vec_push(&w->fires, fire);
+        }
+        FireSlice fires = {.items = w->fires.items, .len = w->fires.len};
+
+        fire_arrival_solve(&w->arrival, fires, wind, rateScale);
+
+        // The risk is written into the roads, so every worker assesses its own copy
+        memcpy(w->roads, c->roads.items, c->roads.len * sizeof(RoadSeg));
+        RoadSegSlice roads = {.items = w->roads, .len = c->roads.len};
+        assess_roads_phased(&roads, &fires, c->vegetation, c->phase, &w->arrival, NULL,
+                            &w->scratch);
+
+        for (size_t r = 0; r < roads.len; r++)
+            c->ensemble->risks[r * config.member_count + m] = roads.items[r].risk;
+    }
+}
+
+static int cmp_risk(const void* r1, const void* r2)
+{
+    const RoadRisk risk1 = *(const RoadRisk*)r1;
+    const RoadRisk risk2 = *(const RoadRisk*)r2;
+    return (risk1 > risk2) - (risk1 < risk2);
+}
+
+static void sort_roads(void* ctx, size_t start, size_t end, size_t worker)
+{
+    (void)worker;
+    RiskEnsemble* ensemble = ctx;
+    for (size_t r = start; r < end; r++)
+    {
+        qsort(&ensemble->risks[r * ensemble->member_count], ensemble->member_count,
+              sizeof(RoadRisk), cmp_risk);
+    }
+}
+
+RiskEnsemble risk_ensemble_run(RoadSegSlice roads, FireSlice fires, VegSlice vegetation,
+                               const VegIndex* veg_index, BoundBox bbox, double cell_size,
+                               const double* segment_escape, Vec2 wind, EnsembleConfig config,
+                               ThreadPool* pool)
+{
+    RiskEnsemble ensemble = {
+        .road_count = roads.len,
+        .member_count = config.member_count,
+        .risks = malloc(MAX(roads.len * config.member_count, 1) * sizeof(RoadRisk)),
+    };
+
+    // The vegetation is rasterized once, and copied to the map of every worker
+    const size_t workerCount = pool_thread_count(pool);
+    FireArrival arrival = fire_arrival_create(vegetation, bbox, cell_size);
+    const size_t cellCount = arrival.grid.width * arrival.grid.height;
+
+    EnsembleWorker* workers = calloc(workerCount, sizeof(EnsembleWorker));
+    for (size_t w = 0; w < workerCount; w++)
+    {
+        workers[w].arrival = (FireArrival){
+            .grid = arrival.grid,
+            .fuel = malloc(cellCount * sizeof(uint8_t)),
+            .time = malloc(cellCount * sizeof(float)),
+        };
+        memcpy(workers[w].arrival.fuel, arrival.fuel, cellCount * sizeof(uint8_t));
+        workers[w].roads = malloc(MAX(roads.len, 1) * sizeof(RoadSeg));
+    }
+
+    // Only the fires differ between the members, so the roads go through their phase once
+    RoadPhase phase = road_phase_create(roads, veg_index, bbox, segment_escape);
+    EnsembleCtx ctx = {
+        .roads = roads,
+        .fires = fires,
+        .vegetation = veg_index,
+        .phase = &phase,
+        .wind = wind,
+        .config = config,
+        .workers = workers,
+        .ensemble = &ensemble,
+    };
+    pool_parallel_for(pool, config.member_count, 1, run_members, &ctx);
+    pool_parallel_for(pool, roads.len, 64, sort_roads, &ensemble);
+
+    for (size_t w = 0; w < workerCount; w++)
+    {
+        fire_arrival_free(&workers[w].arrival);
+        free(workers[w].roads);
+        vec_free(workers[w].fires);
+        assess_scratch_free(&workers[w].scratch);
+    }
+    free(workers);
+    road_phase_free(&phase);
+    fire_arrival_free(&arrival);
+
+    return ensemble;
+}
+
+void risk_ensemble_free(RiskEnsemble* ensemble)
+{
+    free(ensemble->risks);
+    *ensemble = (RiskEnsemble){0};
+}
+
+RoadRisk risk_ensemble_percentile(const RiskEnsemble* ensemble, size_t road, double percentile)
+{
+    assert(road < ensemble->road_count && "risk_ensemble_percentile: unknown road");
+    assert(ensemble->member_count > 0 && "risk_ensemble_percentile: empty ensemble");
+
+    const double rank = ceil(percentile / 100 * (double)ensemble->member_count);
+    const size_t idx = rank <= 1 ? 0 : MIN((size_t)rank - 1, ensemble->member_count - 1);
+    return ensemble->risks[road * ensemble->member_count + idx];
+}
@@ -0,0 +1,68 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include "../models/fire.h"
+#include "../models/geo.h"
+#include "../models/road.h"
+#include "../models/vegetation.h"
+#include "../spatial/veg_index.h"
+#include "../threading/pool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// How much the scenarios of an ensemble differ from the observed conditions
+typedef struct
+{
+    size_t member_count;
+    /// Every scenario of a seed is the same, whatever the amount of threads
+    uint64_t seed;
+    /// The standard deviation of the wind direction in degrees
+    double wind_direction_sd;
+    /// The standard deviation of the log of the wind speed, spread rates and fire radiative power
+    double wind_speed_sd;
+    double spread_rate_sd;
+    double frp_sd;
+} EnsembleConfig;
+
+/// The risk of every road in every scenario of an ensemble
+typedef struct
+{
+    size_t road_count;
+    size_t member_count;
+    /// The risks of each road in ascending order, road after road, so the risks of road `r` are
+    /// `risks[r * member_count]` up to (but not including) `risks[(r + 1) * member_count]`
+    RoadRisk* risks;
+} RiskEnsemble;
+
+/// Get the default spread of the scenarios, for the given amount of them
+EnsembleConfig ensemble_config_default(size_t member_count);
+
+/// Assess the roads in a set of scenarios, each with its own wind, spread rates and fire intensity
+/// drawn around the observed ones. Each scenario works out its own arrival map over the vegetation
+/// with cells of about `cell_size` metres, and assesses the roads with it like
+/// `assess_roads_arrival()`. `segment_escape` is the time to safety of the segments the scenarios
+/// share, like `assess_roads_arrival()` takes it, or NULL to work it out without traffic.
+///
+/// The per road phase of the assessment is worked out once and shared by all scenarios, which
+/// only run the per fire and pair phases.
+///
+/// The scenarios are split between the threads of the pool. Each one draws its numbers from a
+/// counter-based generator keyed by the seed and its index, so the result does not depend on the
+/// amount of threads. The roads are not changed.
+///
+/// Every thread keeps its own copy of the arrival map, at 5 bytes per cell. With the 5 metre cells
+/// of the console, a map can have up to `FIRE_GRID_MAX_SIDE` (4000) cells per side, which is
+/// about 80 MB per thread.
+/// The caller is responsible for freeing the result with `risk_ensemble_free()`
+RiskEnsemble risk_ensemble_run(RoadSegSlice roads, FireSlice fires, VegSlice vegetation,
+                               const VegIndex* veg_index, BoundBox bbox, double cell_size,
+                               const double* segment_escape, Vec2 wind, EnsembleConfig config,
+                               ThreadPool* pool);
+
+void risk_ensemble_free(RiskEnsemble* ensemble);
+
+/// Get a percentile (from 0 to 100) of the risk of a road over the scenarios, by nearest rank
+RoadRisk risk_ensemble_percentile(const RiskEnsemble* ensemble, size_t road, double percentile);
+
+#endif // ENSEMBLE_H
@@ -0,0 +1,280 @@
+#include "fire_field.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+/// Stands in for an infinite squared distance. Far above any real one, while still being safe to
+/// do arithmetic on
+#define EDT_INF 1e20
+
+/// The amount of roads a worker takes at a time in `fire_field_road_dsts()`
+#define ROAD_DST_CHUNK 256
+
+typedef struct
+{
+    FireField* field;
+    /// The squared distance in cells from each cell to the nearest fire
+    double* d2;
+    /// Per worker scratch memory, each worker gets `scratch_len` items of each
+    size_t scratch_len;
+    double* f;
+    int32_t* fi;
+    size_t* v;
+    double* z;
+    double* d;
+    int32_t* di;
+} EdtCtx;
+
+/// The 1D transform of the sampled function `f` with `n` samples: d(q) = min over p of
+/// (q - p)^2 + f(p). The index of the fire behind the chosen f(p) is carried along into `di`.
+/// `v` needs room for `n` items, and `z` for `n + 1`
+static void edt_1d(const double* f, const int32_t* fi, size_t n, double* d, int32_t* di, size_t* v,
+                   double* z)
+{
+    // Find the lower envelope of the parabolas rooted at each sample
+    size_t k = 0;
+    v[0] = 0;
+    z[0] = -INFINITY;
+    z[1] = INFINITY;
+    for (size_t q = 1; q < n; q++)
+    {
+        const double fq = f[q] + (double)q * (double)q;
+        double s;
+        while (true)
+        {
+            const size_t p = v[k];
+            s = (fq - (f[p] + (double)p * (double)p)) / (2.0 * (double)q - 2.0 * (double)p);
+            if (s > z[k] || k == 0)
+                break;
+            k--;
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = INFINITY;
+    }
+
+    // Read the envelope back at every sample
+    k = 0;
+    for (size_t q = 0; q < n; q++)
+    {
+        while (z[k + 1] < (double)q)
+            k++;
+
+        const double diff = (double)q - (double)v[k];
+        d[q] = diff * diff + f[v[k]];
+        di[q] = fi[v[k]];
+    }
+}
+
+/// The transform along each column, from the fire cells
+static void edt_columns(void* ctx, size_t start, size_t end, size_t worker)
+{
+    EdtCtx* c = ctx;
+    const size_t width = c->field->width;
+    const size_t height = c->field->height;
+
+    double* f = c->f + worker * c->scratch_len;
+    int32_t* fi = c->fi + worker * c->scratch_len;
+    size_t* v = c->v + worker * c->scratch_len;
+    double* z = c->z + worker * (c->scratch_len + 1);
+    double* d = c->d + worker * c->scratch_len;
+    int32_t* di = c->di + worker * c->scratch_len;
+
+    for (size_t x = start; x < end; x++)
+    {
+        for (size_t y = 0; y < height; y++)
+        {
+            fi[y] = c->field->nearest[y * width + x];
+            f[y] = fi[y] >= 0 ? 0 : EDT_INF;
+        }
+
+        edt_1d(f, fi, height, d, di, v, z);
+
+        for (size_t y = 0; y < height; y++)
+        {
+            c->d2[y * width + x] = d[y];
+            c->field->nearest[y * width + x] = di[y];
+        }
+    }
+}
+
+/// The transform along each row, from the column distances, and the final distances
+static void edt_rows(void* ctx, size_t start, size_t end, size_t worker)
+{
+    EdtCtx* c = ctx;
+    FireField* field = c->field;
+    const size_t width = field->width;
+
+    size_t* v = c->v + worker * c->scratch_len;
+    double* z = c->z + worker * (c->scratch_len + 1);
+    double* d = c->d + worker * c->scratch_len;
+    int32_t* di = c->di + worker * c->scratch_len;
+
+    for (size_t y = start; y < end; y++)
+    {
+        edt_1d(c->d2 + y * width, field->nearest + y * width, width, d, di, v, z);
+
+        const double center_y = field->bounds.min_y + ((double)y + 0.5) * field->cell_size;
+        for (size_t x = 0; x < width; x++)
+        {
+            const size_t cell = y * width + x;
+            field->nearest[cell] = di[x];
+            if (di[x] < 0)
+            {
+                field->dst[cell] = INFINITY;
+                continue;
+            }
+
+            const MCoord center = {
+                .x = field->bounds.min_x + ((double)x + 0.5) * field->cell_size,
+                .y = center_y,
+            };
+            field->dst[cell] = (float)mcoord_dst(center, field->fires[di[x]]);
+        }
+    }
+}
+
+/// Get the cell column or row of a coordinate on one axis, clamped to the grid
+static size_t cell_of(double c, double min, double cell_size, size_t count)
+{
+    const double cell = floor((c - min) / cell_size);
+    if (cell <= 0)
+        return 0;
+    return MIN((size_t)cell, count - 1);
+}
+
+FireField fire_field_create(FireSlice fires, MRect bounds, double cell_size, ThreadPool* pool)
+{
+    FireField field = {
+        .width = MAX((size_t)ceil((bounds.max_x - bounds.min_x) / cell_size), 1),
+        .height = MAX((size_t)ceil((bounds.max_y - bounds.min_y) / cell_size), 1),
+        .cell_size = cell_size,
+        .bounds = bounds,
+        .fires = malloc(MAX(fires.len, 1) * sizeof(MCoord)),
+        .fire_count = fires.len,
+    };
+    const size_t cell_count = field.width * field.height;
+    field.dst = malloc(cell_count * sizeof(float));
+    field.nearest = malloc(cell_count * sizeof(int32_t));
+
+    for (size_t i = 0; i < cell_count; i++)
+        field.nearest[i] = -1;
+
+    // Seed the cells of the fires. When several fires share a cell the first one is kept
+    for (size_t i = 0; i < fires.len; i++)
+    {
+        const MCoord p = fires.items[i].mcoord;
+        field.fires[i] = p;
+
+        const size_t x = cell_of(p.x, bounds.min_x, cell_size, field.width);
+        const size_t y = cell_of(p.y, bounds.min_y, cell_size, field.height);
+        if (field.nearest[y * field.width + x] < 0)
+            field.nearest[y * field.width + x] = (int32_t)i;
+    }
+
+    const size_t workers = pool_thread_count(pool);
+    const size_t scratch_len = MAX(field.width, field.height);
+    EdtCtx ctx = {
+        .field = &field,
+        .d2 = malloc(cell_count * sizeof(double)),
+        .scratch_len = scratch_len,
+        .f = malloc(workers * scratch_len * sizeof(double)),
+        .fi = malloc(workers * scratch_len * sizeof(int32_t)),
+        .v = malloc(workers * scratch_len * sizeof(size_t)),
+        .z = malloc(workers * (scratch_len + 1) * sizeof(double)),
+        .d = malloc(workers * scratch_len * sizeof(double)),
+        .di = malloc(workers * scratch_len * sizeof(int32_t)),
+    };
+
+    // The transform is separable: first along every column, then along every row
+    pool_parallel_for(pool, field.width, 16, edt_columns, &ctx);
+    pool_parallel_for(pool, field.height, 16, edt_rows, &ctx);
+
+    free(ctx.d2);
+    free(ctx.f);
+    free(ctx.fi);
+    free(ctx.v);
+    free(ctx.z);
+    free(ctx.d);
+    free(ctx.di);
+
+    return field;
+}
+
+void fire_field_free(FireField* field)
+{
+    free(field->dst);
+    free(field->nearest);
+    free(field->fires);
+    *field = (FireField){0};
+}
+
+int32_t fire_field_nearest(const FireField* field, MCoord p)
+{
+    const size_t x = cell_of(p.x, field->bounds.min_x, field->cell_size, field->width);
+    const size_t y = cell_of(p.y, field->bounds.min_y, field->cell_size, field->height);
+    return field->nearest[y * field->width + x];
+}
+
+double fire_field_dst(const FireField* field, MCoord p)
+{
+    const int32_t fire = fire_field_nearest(field, p);
+    if (fire < 0)
+        return INFINITY;
+
+    return mcoord_dst(p, field->fires[fire]);
+}
+
+double fire_field_road_dst(const FireField* field, RoadSeg road)
+{
+    double best = INFINITY;
+    for (size_t i = 0; i + 1 < road.nodes.len; i++)
+    {
+        const MCoord a = mcoord_load(road.nodes.items[i].mcoords);
+        const MCoord b = mcoord_load(road.nodes.items[i + 1].mcoords);
+
+        const size_t steps = (size_t)ceil(mcoord_dst(a, b) / (field->cell_size / 2)) + 1;
+        int32_t last = -1;
+        for (size_t s = 0; s <= steps; s++)
+        {
+            const double t = (double)s / (double)steps;
+            const MCoord p = {.x = a.x + (b.x - a.x) * t, .y = a.y + (b.y - a.y) * t};
+
+            // Neighbouring cells mostly share their nearest fire
+            const int32_t fire = fire_field_nearest(field, p);
+            if (fire < 0)
+                return INFINITY;
+            if (fire == last)
+                continue;
+            last = fire;
+
+            const MCoord firePoint = field->fires[fire];
+            best = MIN(best, mcoord_dst(firePoint, closest_point_on_segment(a, b, firePoint)));
+        }
+    }
+
+    return best;
+}
+
+typedef struct
+{
+    const FireField* field;
+    RoadSegSlice roads;
+    double* dst_out;
+} RoadDstCtx;
+
+static void road_dst_range(void* ctx, size_t start, size_t end, size_t worker)
+{
+    (void)worker;
+    RoadDstCtx* c = ctx;
+    for (size_t i = start; i < end; i++)
+        c->dst_out[i] = fire_field_road_dst(c->field, c->roads.items[i]);
+}
+
+void fire_field_road_dsts(const FireField* field, RoadSegSlice roads, double* dst_out,
+                          ThreadPool* pool)
+{
+    RoadDstCtx ctx = {.field = field, .roads = roads, .dst_out = dst_out};
+    pool_parallel_for(pool, roads.len, ROAD_DST_CHUNK, road_dst_range, &ctx);
+}
@@ -0,0 +1,69 @@
+#ifndef FIRE_FIELD_H
+#define FIRE_FIELD_H
+
+#include "../models/fire.h"
+#include "../models/geo.h"
+#include "../models/road.h"
+#include "../threading/pool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// The distance to the nearest fire over a grid of square cells on the local plane.
+///
+/// Built with an exact Euclidean distance transform (Felzenszwalb and Huttenlocher, "Distance
+/// Transforms of Sampled Functions"), which takes linear time in the amount of cells whatever the
+/// amount of fires. The transform also keeps which fire is the nearest to each cell, so distances
+/// are measured exactly to that fire rather than to the cell it is in. The fires themselves are
+/// snapped to their cells during the transform, so the fire picked for a cell can be one that is up
+/// to about a cell further away than the true nearest one.
+/// https://cs.brown.edu/people/pfelzens/papers/dt-final.pdf
+///
+/// Row 0 is the southern edge of the bounds, and column 0 the western edge.
+typedef struct
+{
+    /// The distance in metres from the center of each cell to the nearest fire, row after row.
+    /// INFINITY if there are no fires
+    float* dst;
+    /// The index of the nearest fire of each cell, or -1 if there are no fires
+    int32_t* nearest;
+    size_t width;
+    size_t height;
+    /// The width and height of a cell in metres
+    double cell_size;
+    /// The local plane area covered by the grid
+    MRect bounds;
+    /// The projected coordinates of the fires, by index
+    MCoord* fires;
+    size_t fire_count;
+} FireField;
+
+/// Build the field over the bounds, with cells of `cell_size` metres. Fires outside the bounds are
+/// placed in the cell at the border closest to them. The fires must have been projected with
+/// `project_fires()` beforehand.
+/// The caller is responsible for freeing the field with `fire_field_free()`
+FireField fire_field_create(FireSlice fires, MRect bounds, double cell_size, ThreadPool* pool);
+
+void fire_field_free(FireField* field);
+
+/// Get the index of the nearest fire to a point, by the cell the point is in. Points outside the
+/// bounds use the closest cell at the border. -1 if there are no fires
+int32_t fire_field_nearest(const FireField* field, MCoord p);
+
+/// Get the distance in metres from a point to the nearest fire of its cell
+double fire_field_dst(const FireField* field, MCoord p);
+
+/// Get the distance in metres from a road to the nearest fire, by walking along the road in steps
+/// of half a cell and measuring the exact distance from the segment to the nearest fire of each
+/// cell it passes. INFINITY if there are no fires or the road has no segments.
+///
+/// This can only be too high where the true nearest fire is not the nearest fire of any cell along
+/// the road, which takes fires that are almost the same distance away.
+double fire_field_road_dst(const FireField* field, RoadSeg road);
+
+/// Get the distance to the nearest fire of every road, see `fire_field_road_dst()`.
+/// `dst_out` must have room for `roads.len` items
+void fire_field_road_dsts(const FireField* field, RoadSegSlice roads, double* dst_out,
+                          ThreadPool* pool);
+
+#endif // FIRE_FIELD_H
@@ -1,127 +1,680 @@
 #include "risk.h"
 
+#include "../Debug/Logger.h"
 #include "../models/road.h"
-#include "../visual/visual.h"
+#include "../models/road_geom.h"
+#include "../routing/road_graph.h"
+#include "../routing/route.h"
+#include "../spatial/fire_index.h"
+#include "../spatial/rtree.h"
 
+#include <assert.h>
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 static const float nearbyFireThreshold = 20000;
 static const double decayConstant = 100;
+static const double avgFireSpeed = 6.14;
+/// The time to safety that roads with no way out of the area are scored with
+static const double maxEscapeTime = 3600;
+/// The distance in metres within which the heat of a fire can soften and melt an asphalt road
+static const double asphaltMeltDistance = 100;
 
+/// The amount of segments the impact kernel scores in one pass
+#define IMPACT_CHUNK 256
 
-void assess_roads(RoadSegSlice* roads, FireSlice* fires, VegSlice* vegetation)
+static RoadRisk set_road_risk(RoadSeg* road, double totalImpactScore, double vulnerability,
+                              double nearestFireDst);
+static bool road_is_asphalt(const RoadSeg* road);
+static double road_vulnerability(const RoadSeg* road);
+
+
+static int cmp_fire_idx(const void* i1, const void* i2)
+{
+    size_t c1 = *(const size_t*)i1;
+    size_t c2 = *(const size_t*)i2;
+    return (c1 > c2) - (c1 < c2);
+}
+
+// The assessment runs in three phases. First everything that only depends on a fire is worked out
+// once per fire, and everything that only depends on a road once per road (and once per node).
+// Only then are the pairs of roads and nearby fires scored, reading those from arrays.
+
+/// The vegetation risk multiplier at a coordinate, or 0 if no polygon has it
+static double vegetation_multiplier_at(GCoord coord, const VegIndex* vegetation)
+{
+    VegType vegType = VEG_NONE;
+    if (!veg_index_lookup_gcoord(vegetation, coord, &vegType))
+        return 0;
+
+    return get_vegetation_risk_multiplier(vegType);
+}
+
+/// The per fire phase
+static FireAttrs fire_attrs(const FireArea* fire, const VegIndex* vegetation,
+                            const FireArrival* arrival)
+{
+    return (FireAttrs){
+        .vegetation = vegetation_multiplier_at(fire->gcoord, vegetation),
+        .on_arrival_map = arrival != NULL && fire_arrival_covers(arrival, fire->gcoord),
+    };
+}
+
+/// The per road phase. The caller is responsible for freeing the attributes
+static RoadAttrs* road_attrs_create(RoadSegSlice roads)
+{
+    RoadAttrs* attrs = malloc(MAX(roads.len, 1) * sizeof(RoadAttrs));
+    for (size_t i = 0; i < roads.len; i++)
+    {
+        MRect reach = get_road_bounds(roads.items[i]);
+        reach.min_x -= nearbyFireThreshold;
+        reach.min_y -= nearbyFireThreshold;
+        reach.max_x += nearbyFireThreshold;
+        reach.max_y += nearbyFireThreshold;
+
+        attrs[i] = (RoadAttrs){
+            .reach = reach,
+            .vulnerability = road_vulnerability(&roads.items[i]),
+        };
+    }
+
+    return attrs;
+}
+
+/// The per node part of the road phase: the vegetation multiplier under every node of the roads,
+/// laid out like the nodes of a `RoadGeom`. The caller is responsible for freeing the array
+static double* node_vegetation(RoadSegSlice roads, const VegIndex* vegetation)
+{
+    size_t nodeCount = 0;
+    for (size_t i = 0; i < roads.len; i++)
+        nodeCount += roads.items[i].nodes.len;
+
+    double* nodeVeg = malloc(MAX(nodeCount, 1) * sizeof(double));
+    size_t idx = 0;
+    for (size_t i = 0; i < roads.len; i++)
+    {
+        const NodeSlice nodes = roads.items[i].nodes;
+        for (size_t j = 0; j < nodes.len; j++)
+        {
+            const GCoord coord = gcoord_load(nodes.items[j].coords);
+            nodeVeg[idx++] = vegetation_multiplier_at(coord, vegetation);
+        }
+    }
+
+    return nodeVeg;
+}
+
+double* road_segment_escape(RoadSegSlice roads, BoundBox bbox)
 {
-    for (int i = 0; i < roads->len; i++)
+    RoadGraph graph = road_graph_from_roads(roads, bbox);
+    double* timeToSafety = malloc(MAX(graph.vertex_count, 1) * sizeof(double));
+    route_time_to_safety(&graph, timeToSafety, NULL);
+
+    double* escape = road_segment_escape_times(&graph, roads, timeToSafety);
+    free(timeToSafety);
+    road_graph_free(&graph);
+    return escape;
+}
+
+double* road_segment_escape_times(const RoadGraph* graph, RoadSegSlice roads,
+                                  const double* time_to_safety)
+{
+    double* escape = malloc(MAX(graph->node_count, 1) * sizeof(double));
+    size_t first = 0;
+    for (size_t r = 0; r < roads.len; r++)
     {
-        RoadSeg road = roads->items[i];
+        const size_t last = first + roads.items[r].nodes.len;
+        const double roadLength = GetRoadLength(roads.items[r]);
 
-        // Get nearby fires
-        FireVec nearbyFires = {0};
-        for (int fi = 0; fi < fires->len; fi++)
+        for (size_t s = first; s < last; s++)
         {
-            if (get_fire_dst_to_road(road, fires->items[fi]) > nearbyFireThreshold)
+            escape[s] = 0;
+            if (s + 1 == last || roadLength <= 0)
                 continue;
 
-            vec_push(&nearbyFires, fires->items[fi]);
+            // Whoever is on the segment leaves through the end that is closest to safety
+            const double length = mcoord_dst(graph->coords[graph->node_vertex[s]],
+                                             graph->coords[graph->node_vertex[s + 1]]);
+            const double time = MIN(time_to_safety[graph->node_vertex[s]],
+                                    time_to_safety[graph->node_vertex[s + 1]]);
+            escape[s] = length / roadLength * MIN(time, maxEscapeTime);
         }
+        first = last;
+    }
+
+    return escape;
+}
+
+RoadPhase road_phase_create(RoadSegSlice roads, const VegIndex* vegetation, BoundBox bbox,
+                            const double* segment_escape)
+{
+    RoadPhase phase = {
+        .geom = road_geom_from_roads(roads),
+        .road_attrs = road_attrs_create(roads),
+        .node_vegetation = node_vegetation(roads, vegetation),
+        .own_segment_escape = segment_escape == NULL ? road_segment_escape(roads, bbox) : NULL,
+    };
+    phase.segment_escape = segment_escape != NULL ? segment_escape : phase.own_segment_escape;
+    return phase;
+}
+
+void road_phase_free(RoadPhase* phase)
+{
+    free(phase->road_attrs);
+    free(phase->node_vegetation);
+    free(phase->own_segment_escape);
+    road_geom_free(&phase->geom);
+    *phase = (RoadPhase){0};
+}
 
-        assess_road(&road, &nearbyFires, vegetation);
-        // printf("Road with id '%zu' rated with a risk value of %d\n", road.id, road.risk);
-        debug_log(MESSAGE, "Road with id '%llu' rated with a risk value of %d", road.id, road.risk);
-        vec_free(nearbyFires);
-        roads->items[i] = road;
+/// The pair phase: the impact of one fire on a road, summed over the segments of the road. Every
+/// segment is scored on its own: the hazard falls off with the distance from the fire to the
+/// segment, and the exposure is the time it takes to get from the segment out of the area over
+/// the time until the fire reaches the segment. Segments further than nearbyFireThreshold from the
+/// fire add nothing.
+///
+/// `segEscape` is the weighted time to safety of each segment, see `road_segment_escape()`.
+/// `fireEta` is the seconds until the fire reaches the road, or negative to estimate it from the
+/// distance to each segment. If `segImpact` is not NULL, the impact on each segment is added to it
+/// at the index of the node the segment starts at. `minDstOut` gets the distance from the fire to
+/// the road, which is INFINITY for roads without segments.
+static double road_fire_impact(const RoadGeom* geom, const double* nodeVeg,
+                               const double* segEscape, size_t road, const FireArea* fire,
+                               double fireVeg, double fireEta, double* segImpact,
+                               double* minDstOut)
+{
+    // The ETA is either fixed or grows with the distance. Picking which up front keeps the loop
+    // below free of branches, so it can be vectorized
+    const double etaBase = fireEta < 0 ? 0 : fireEta;
+    const double etaPerMetre = fireEta < 0 ? 1 / avgFireSpeed : 0;
+    const double px = fire->mcoord.x * MCOORD_STORE_SCALE;
+    const double py = fire->mcoord.y * MCOORD_STORE_SCALE;
+
+    const size_t first = geom->offsets[road];
+    const size_t last = geom->offsets[road + 1];
+
+    double dst[IMPACT_CHUNK];
+    double impact[IMPACT_CHUNK];
+    double totalImpact = 0;
+    double minDst = INFINITY;
+    for (size_t start = first; start + 1 < last; start += IMPACT_CHUNK)
+    {
+        const size_t len = MIN(IMPACT_CHUNK, last - 1 - start);
+        road_geom_seg_dst(geom, start, len, fire->mcoord, dst);
+
+        for (size_t k = 0; k < len; k++)
+        {
+            const size_t s = start + k;
+
+            // The vegetation of the road is taken at the end of the segment closest to the fire
+            const double ax = (double)geom->xs[s] - px;
+            const double ay = (double)geom->ys[s] - py;
+            const double bx = (double)geom->xs[s + 1] - px;
+            const double by = (double)geom->ys[s + 1] - py;
+            const double roadVeg = ax * ax + ay * ay <= bx * bx + by * by ? nodeVeg[s]
+                                                                            : nodeVeg[s + 1];
+
+            const double hazard =
+                fire->frp * exp(-dst[k] / decayConstant) * (fireVeg + roadVeg) + 1;
+            const double segFireEta = etaBase + dst[k] * etaPerMetre;
+            const double exposure = segEscape[s] / MAX(1, segFireEta);
+            impact[k] = dst[k] <= nearbyFireThreshold ? hazard * exposure : 0;
+        }
+
+        for (size_t k = 0; k < len; k++)
+        {
+            totalImpact += impact[k];
+            minDst = dst[k] < minDst ? dst[k] : minDst;
+        }
+        if (segImpact != NULL)
+        {
+            for (size_t k = 0; k < len; k++)
+                segImpact[start + k] += impact[k];
+        }
     }
+
+    *minDstOut = minDst;
+    return totalImpact;
 }
 
-RoadRisk assess_road(RoadSeg* road, FireVec* fires, VegSlice* vegetation)
+/// The amount of roads a worker takes at a time. Small enough that a few roads near many fires
+/// do not leave one thread working alone at the end
+#define ASSESS_CHUNK 64
+
+typedef struct
 {
-    double totalImpactScore = 0;
-    const double avgCarSpeed = road->speed_limit;
-    const double avgFireSpeed = 6.14;
+    RoadSegSlice* roads;
+    FireSlice* fires;
+    const FireIndex* fireIndex;
+    /// The results of the per road and per fire phases
+    const RoadPhase* phase;
+    const FireAttrs* fireAttrs;
+    /// If not NULL, the fire ETAs are read off this map
+    const FireArrival* arrival;
+    /// Scratch memory for each worker
+    FireIdxVec* candidates;
+    /// If not NULL, the impact of each nearby fire is kept here for every road
+    FireContributionVec* contributions;
+    /// If not NULL, the impact on each segment is summed here, see `road_fire_impact()`
+    double* segImpact;
+} AssessCtx;
 
-    double roadLength = GetRoadLength(*road);
-    for (int i = 0; i < fires->len; i++)
+static void assess_road_range(void* ctx, size_t start, size_t end, size_t worker)
+{
+    AssessCtx* c = ctx;
+    const RoadPhase* phase = c->phase;
+    FireIdxVec* candidates = &c->candidates[worker];
+
+    for (size_t i = start; i < end; i++)
     {
-        // Get the fire area at index i
-        FireArea fire = fires->items[i];
+        RoadSeg* road = &c->roads->items[i];
+
+        // Get nearby fires. The index gives the fires in reach of the bounds of the road, and the
+        // kernel measures them exactly. They are sorted so the fires keep their original order
+        vec_empty(candidates);
+        fire_index_query_rect(c->fireIndex, phase->road_attrs[i].reach, candidates);
+        qsort(candidates->items, candidates->len, sizeof(size_t), cmp_fire_idx);
+
+        // Only read off the arrival map once, and only for roads that have fires around them
+        double roadEta = -1;
+        if (c->arrival != NULL && candidates->len > 0)
+            roadEta = fire_arrival_road_eta(c->arrival, *road);
+
+        double totalImpactScore = 0;
+        double nearestFireDst = INFINITY;
+        for (size_t j = 0; j < candidates->len; j++)
+        {
+            const size_t fireIdx = candidates->items[j];
+            const FireAttrs attrs = c->fireAttrs[fireIdx];
+
+            double dst;
+            const double impact =
+                road_fire_impact(&phase->geom, phase->node_vegetation, phase->segment_escape, i,
+                                 &c->fires->items[fireIdx], attrs.vegetation,
+                                 attrs.on_arrival_map ? roadEta : -1, c->segImpact, &dst);
+            if (dst > nearbyFireThreshold)
+                continue;
+
+            if (c->contributions != NULL)
+            {
+                const FireContribution contribution = {
+                    .fire = fireIdx,
+                    .impact = impact,
+                    .dst = dst,
+                };
+                vec_push(&c->contributions[i], contribution);
+            }
+            totalImpactScore += impact;
+            nearestFireDst = MIN(nearestFireDst, dst);
+        }
+        set_road_risk(road, totalImpactScore, phase->road_attrs[i].vulnerability, nearestFireDst);
+        LOG_TRACE("Road with id '%zu' rated with a risk value of %d", road->id, road->risk);
+    }
+}
+
+void assess_roads(RoadSegSlice* roads, FireSlice* fires, const VegIndex* vegetation,
+                  BoundBox bbox)
+{
+    assess_roads_parallel(roads, fires, vegetation, bbox, NULL);
+}
+
+void assess_scratch_free(AssessScratch* scratch)
+{
+    for (size_t w = 0; w < scratch->candidate_count; w++)
+        vec_free(scratch->candidates[w]);
+    free(scratch->candidates);
+    free(scratch->fire_attrs);
+    fire_index_free(&scratch->fire_index);
+    *scratch = (AssessScratch){0};
+}
+
+/// Run the per fire and pair phases over roads that have been through the per road phase, in the
+/// memory of `scratch`. Keep the impact of each nearby fire in `contributions` and the impact on
+/// each segment in `segImpact` if they are not NULL
+static void assess_roads_with(RoadSegSlice* roads, FireSlice* fires, const VegIndex* vegetation,
+                              const RoadPhase* phase, const FireArrival* arrival,
+                              ThreadPool* pool, AssessScratch* scratch,
+                              FireContributionVec* contributions, double* segImpact)
+{
+    fire_index_rebuild(&scratch->fire_index, *fires);
+
+    scratch->fire_attrs = realloc(scratch->fire_attrs, MAX(fires->len, 1) * sizeof(FireAttrs));
+    for (size_t i = 0; i < fires->len; i++)
+        scratch->fire_attrs[i] = fire_attrs(&fires->items[i], vegetation, arrival);
+
+    const size_t workers = pool_thread_count(pool);
+    if (scratch->candidate_count < workers)
+    {
+        scratch->candidates = realloc(scratch->candidates, workers * sizeof(FireIdxVec));
+        for (size_t w = scratch->candidate_count; w < workers; w++)
+            scratch->candidates[w] = (FireIdxVec){0};
+        scratch->candidate_count = workers;
+    }
+
+    AssessCtx ctx = {
+        .roads = roads,
+        .fires = fires,
+        .fireIndex = &scratch->fire_index,
+        .phase = phase,
+        .fireAttrs = scratch->fire_attrs,
+        .arrival = arrival,
+        .candidates = scratch->candidates,
+        .contributions = contributions,
+        .segImpact = segImpact,
+    };
 
-        // Calculate the distance from the fire to the road
-        const double dst = get_fire_dst_to_road(*road, fire);
-        if (dst == INFINITY)
+    pool_parallel_for(pool, roads->len, ASSESS_CHUNK, assess_road_range, &ctx);
+}
+
+void assess_roads_phased(RoadSegSlice* roads, FireSlice* fires, const VegIndex* vegetation,
+                         const RoadPhase* phase, const FireArrival* arrival, ThreadPool* pool,
+                         AssessScratch* scratch)
+{
+    assess_roads_with(roads, fires, vegetation, phase, arrival, pool, scratch, NULL, NULL);
+}
+
+/// Run all three phases, see `assess_roads_with()`. The time to safety of the segments is worked
+/// out over the roads of the bbox if `segEscape` is NULL
+static void assess_roads_all(RoadSegSlice* roads, FireSlice* fires, const VegIndex* vegetation,
+                             BoundBox bbox, const double* segEscape, const FireArrival* arrival,
+                             ThreadPool* pool, RoadRisk* segmentRisk)
+{
+    RoadPhase phase = road_phase_create(*roads, vegetation, bbox, segEscape);
+    double* segImpact =
+        segmentRisk != NULL ? calloc(MAX(phase.geom.node_count, 1), sizeof(double)) : NULL;
+
+    AssessScratch scratch = {0};
+    assess_roads_with(roads, fires, vegetation, &phase, arrival, pool, &scratch, NULL, segImpact);
+    assess_scratch_free(&scratch);
+
+    if (segmentRisk != NULL)
+    {
+        // The impact of a segment is its share of the impact on the road, which is weighted by
+        // its share of the length. Undoing the weight gives the risk the road would have if all of
+        // it were like the segment, so the segments are on the same scale as the roads
+        for (size_t r = 0; r < roads->len; r++)
         {
-            debug_log(ERROR, "get_fire_dst_to_road: Length is infinite!");
-            assert(dst == INFINITY);
+            const NodeSlice nodes = roads->items[r].nodes;
+            const double roadLength = GetRoadLength(roads->items[r]);
+            for (size_t j = 0; j < nodes.len; j++)
+            {
+                const size_t s = phase.geom.offsets[r] + j;
+                segmentRisk[s] = 0;
+                if (j + 1 == nodes.len)
+                    continue;
+
+                const double length = mcoord_dst(mcoord_load(nodes.items[j].mcoords),
+                                                 mcoord_load(nodes.items[j + 1].mcoords));
+                if (length > 0)
+                    segmentRisk[s] = (RoadRisk)(segImpact[s] * roadLength / length *
+                                                phase.road_attrs[r].vulnerability);
+            }
         }
+    }
 
-        // Calculate Estimated Time Of Arrival (ETA) for both the fire and a car going the speed
-        // limit
-        const double fireEta = dst / avgFireSpeed;
-        const double carEta = roadLength / avgCarSpeed;
-        const double firstToReachModifier = carEta / MAX(1, fireEta);
+    free(segImpact);
+    road_phase_free(&phase);
+}
 
-        // Calculate a vegetation impact score
-        double vegetationImpactScore = calc_vegetation_impact_score(road, &fire, *vegetation);
+void assess_roads_parallel(RoadSegSlice* roads, FireSlice* fires, const VegIndex* vegetation,
+                           BoundBox bbox, ThreadPool* pool)
+{
+    assess_roads_all(roads, fires, vegetation, bbox, NULL, NULL, pool, NULL);
+}
 
-        // Calculate a hazard score
-        double hazardScore = fire.frp * exp(-dst / decayConstant) * vegetationImpactScore + 1;
+void assess_roads_arrival(RoadSegSlice* roads, FireSlice* fires, const VegIndex* vegetation,
+                          BoundBox bbox, const double* segment_escape,
+                          const FireArrival* arrival, ThreadPool* pool)
+{
+    assess_roads_all(roads, fires, vegetation, bbox, segment_escape, arrival, pool, NULL);
+}
 
-        // Calculate an exposure score
-        double exposureScore = firstToReachModifier; // 1 / (1 + dst);
+void assess_road_segments(RoadSegSlice* roads, FireSlice* fires, const VegIndex* vegetation,
+                          BoundBox bbox, const double* segment_escape,
+                          const FireArrival* arrival, ThreadPool* pool,
+                          RoadRisk* segment_risk_out)
+{
+    assess_roads_all(roads, fires, vegetation, bbox, segment_escape, arrival, pool,
+                     segment_risk_out);
+}
 
-        // Multiply hazard and exposure score
-        double impactScore = hazardScore * exposureScore;
-        debug_log(MESSAGE, "check1: %lf", hazardScore);
-        debug_log(MESSAGE, "check2: %lf", impactScore);
+RiskState risk_state_create(RoadSegSlice* roads, FireSlice fires, const VegIndex* vegetation,
+                            BoundBox bbox, const double* segment_escape,
+                            const FireArrival* arrival, ThreadPool* pool)
+{
+    RiskState state = {
+        .roads = roads,
+        .vegetation = vegetation,
+        .phase = road_phase_create(*roads, vegetation, bbox, segment_escape),
+        .road_tree = rtree_from_roads(*roads),
+        .arrival = arrival,
+        .road_eta = malloc(MAX(roads->len, 1) * sizeof(double)),
+        .contributions = calloc(MAX(roads->len, 1), sizeof(FireContributionVec)),
+        .is_dirty = calloc(MAX(roads->len, 1), sizeof(bool)),
+        .last_seen = calloc(MAX(roads->len, 1), sizeof(size_t)),
+    };
+    for (size_t i = 0; i < roads->len; i++)
+        state.road_eta[i] = NAN;
 
-        // Add the final score to the risk value
-        totalImpactScore += impactScore;
+    for (size_t i = 0; i < fires.len; i++)
+    {
+        const TrackedFire tracked = {
+            .fire = fires.items[i],
+            .attrs = fire_attrs(&fires.items[i], vegetation, arrival),
+            .active = true,
+        };
+        vec_push(&state.fires, tracked);
     }
 
-    // Calculate a vulnerability weight based on the type of material of the road
-    double vulnerabilityWeight = 1;
+    AssessScratch scratch = {0};
+    assess_roads_with(roads, &fires, vegetation, &state.phase, arrival, pool, &scratch,
+                      state.contributions, NULL);
+    assess_scratch_free(&scratch);
+    return state;
+}
 
-    if (road->material != NULL && strcmp(road->material, "asphalt") == 0)
-        vulnerabilityWeight = 0.8;
-    if (road->material != NULL && strcmp(road->material, "concrete") == 0)
-        vulnerabilityWeight = 0.55;
+void risk_state_free(RiskState* state)
+{
+    for (size_t i = 0; i < state->roads->len; i++)
+        vec_free(state->contributions[i]);
+    free(state->contributions);
+    free(state->is_dirty);
+    free(state->last_seen);
+    free(state->road_eta);
+    vec_free(state->dirty);
+    vec_free(state->fires);
+    vec_free(state->query_buf);
+    rtree_free(&state->road_tree);
+    road_phase_free(&state->phase);
+    *state = (RiskState){0};
+}
 
-    // Multiply risk by vulnerabilityWeight
-    const double risk = totalImpactScore * vulnerabilityWeight;
+/// Call `visit` for every road with a segment whose bounds are within nearbyFireThreshold of the
+/// fire, each road once. Whether the road itself is in reach is left to `visit`
+static void for_each_road_near(RiskState* state, size_t fire,
+                               void (*visit)(RiskState* state, size_t road, size_t fire))
+{
+    const MCoord fireCoord = state->fires.items[fire].fire.mcoord;
 
-    // Set the risk value of the road to the calculated risk and return the risk value
-    road->risk = (RoadRisk)risk;
-    return (RoadRisk)risk;
+    vec_empty(&state->query_buf);
+    rtree_query_rect(&state->road_tree, mrect_around(fireCoord, nearbyFireThreshold),
+                     &state->query_buf);
+
+    // A road can have many segments around the fire, so each visit is stamped
+    state->visit_stamp++;
+    for (size_t i = 0; i < state->query_buf.len; i++)
+    {
+        const size_t road = state->query_buf.items[i].road;
+        if (state->last_seen[road] == state->visit_stamp)
+            continue;
+        state->last_seen[road] = state->visit_stamp;
+
+        visit(state, road, fire);
+    }
 }
 
-double calc_vegetation_impact_score(RoadSeg* road, FireArea* fire, VegSlice vegetation)
+static void mark_dirty(RiskState* state, size_t road)
 {
-    double impactScore = 0;
+    if (state->is_dirty[road])
+        return;
+
+    state->is_dirty[road] = true;
+    vec_push(&state->dirty, road);
+}
 
-    VegType veg_type = VEG_NONE;
+static void add_contribution(RiskState* state, size_t road, size_t fire)
+{
+    const TrackedFire* tracked = &state->fires.items[fire];
 
-    // Fire vegetation multiplier
-    LCoord lCoord = global_to_local(fire->gcoord, globalBounds, VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
-    if (coord_has_vegetation(lCoord, &veg_type, vegetation, 1, globalBounds, VIEWPORT_WIDTH,
-                             VIEWPORT_HEIGHT))
+    // The arrival map is read once per road, the first time a fire on the map is near it
+    double fireEta = -1;
+    if (tracked->attrs.on_arrival_map)
     {
-        impactScore += get_vegetation_risk_multiplier(veg_type);
+        double* roadEta = &state->road_eta[road];
+        if (isnan(*roadEta))
+            *roadEta = fire_arrival_road_eta(state->arrival, state->roads->items[road]);
+        fireEta = *roadEta;
     }
 
+    // The same kernel and test as assess_roads, so both agree on which fires are nearby
+    double dst;
+    const double impact =
+        road_fire_impact(&state->phase.geom, state->phase.node_vegetation,
+                         state->phase.segment_escape, road, &tracked->fire,
+                         tracked->attrs.vegetation, fireEta, NULL, &dst);
+    if (dst > nearbyFireThreshold)
+        return;
+    const FireContribution contribution = {.fire = fire, .impact = impact, .dst = dst};
 
-    // Road vegetation multiplier
-    veg_type = VEG_NONE;
+    // Keep the contributions in the order of the fires, so they are summed in the same order as
+    // a full assessment would
+    FireContributionVec* contributions = &state->contributions[road];
+    vec_push(contributions, contribution);
+    size_t j = contributions->len - 1;
+    for (; j > 0 && contributions->items[j - 1].fire > fire; j--)
+        contributions->items[j] = contributions->items[j - 1];
+    contributions->items[j] = contribution;
 
-    lCoord = global_to_local(get_closest_road_node(*road, fire->gcoord)->coords, globalBounds,
-                             VIEWPORT_WIDTH, VIEWPORT_HEIGHT);
+    mark_dirty(state, road);
+}
 
-    if (coord_has_vegetation(lCoord, &veg_type, vegetation, 1, globalBounds, VIEWPORT_WIDTH,
-                             VIEWPORT_HEIGHT))
+/// Roads that were out of reach of the fire have no contribution of it, and are left alone
+static void remove_contribution(RiskState* state, size_t road, size_t fire)
+{
+    FireContributionVec* contributions = &state->contributions[road];
+    for (size_t j = 0; j < contributions->len; j++)
     {
-        impactScore += get_vegetation_risk_multiplier(veg_type);
+        if (contributions->items[j].fire != fire)
+            continue;
+
+        memmove(&contributions->items[j], &contributions->items[j + 1],
+                (contributions->len - j - 1) * sizeof(FireContribution));
+        contributions->len--;
+        mark_dirty(state, road);
+        return;
     }
+}
+
+size_t risk_add_fire(RiskState* state, FireArea fire)
+{
+    const TrackedFire tracked = {
+        .fire = fire,
+        .attrs = fire_attrs(&fire, state->vegetation, state->arrival),
+        .active = true,
+    };
+    vec_push(&state->fires, tracked);
+    const size_t id = state->fires.len - 1;
+
+    for_each_road_near(state, id, add_contribution);
+    return id;
+}
+
+void risk_remove_fire(RiskState* state, size_t id)
+{
+    assert(id < state->fires.len && "risk_remove_fire: unknown fire");
+    if (!state->fires.items[id].active)
+        return;
+
+    for_each_road_near(state, id, remove_contribution);
+    state->fires.items[id].active = false;
+}
+
+void risk_update_fire(RiskState* state, size_t id, FireArea fire)
+{
+    assert(id < state->fires.len && "risk_update_fire: unknown fire");
+
+    if (state->fires.items[id].active)
+        for_each_road_near(state, id, remove_contribution);
+
+    state->fires.items[id] = (TrackedFire){
+        .fire = fire,
+        .attrs = fire_attrs(&fire, state->vegetation, state->arrival),
+        .active = true,
+    };
+    for_each_road_near(state, id, add_contribution);
+}
+
+size_t risk_rescore(RiskState* state)
+{
+    const size_t count = state->dirty.len;
+    for (size_t i = 0; i < state->dirty.len; i++)
+    {
+        const size_t road = state->dirty.items[i];
+        const FireContributionVec contributions = state->contributions[road];
+
+        double totalImpactScore = 0;
+        double nearestFireDst = INFINITY;
+        for (size_t j = 0; j < contributions.len; j++)
+        {
+            totalImpactScore += contributions.items[j].impact;
+            nearestFireDst = MIN(nearestFireDst, contributions.items[j].dst);
+        }
+        set_road_risk(&state->roads->items[road], totalImpactScore,
+                      state->phase.road_attrs[road].vulnerability, nearestFireDst);
+
+        state->is_dirty[road] = false;
+    }
+    vec_empty(&state->dirty);
+
+    return count;
+}
+
+/// Turn the summed impact of the nearby fires into the risk of the road, and give the reasons for
+/// it from the distance to the nearest of them, INFINITY if there are none
+static RoadRisk set_road_risk(RoadSeg* road, double totalImpactScore, double vulnerability,
+                              double nearestFireDst)
+{
+    // Multiply risk by the vulnerability weight of the road, see road_vulnerability()
+    const double risk = totalImpactScore * vulnerability;
+
+    road->risk_reason = 0;
+    if (nearestFireDst <= nearbyFireThreshold)
+        road->risk_reason |= RISK_NEAR_FIRE;
+    if (nearestFireDst <= asphaltMeltDistance && road_is_asphalt(road))
+        road->risk_reason |= RISK_ASPHALT_MELT;
+
+    // Set the risk value of the road to the calculated risk and return the risk value
+    road->risk = (RoadRisk)risk;
+    return (RoadRisk)risk;
+}
+
+static bool road_is_asphalt(const RoadSeg* road)
+{
+    return road->material != NULL && strcmp(road->material, "asphalt") == 0;
+}
+
+/// A vulnerability weight based on the type of material of the road
+static double road_vulnerability(const RoadSeg* road)
+{
+    double vulnerabilityWeight = 1;
+
+    if (road_is_asphalt(road))
+        vulnerabilityWeight = 0.8;
+    if (road->material != NULL && strcmp(road->material, "concrete") == 0)
+        vulnerabilityWeight = 0.55;
 
-    return impactScore;
+    return vulnerabilityWeight;
 }
 
 double get_vegetation_risk_multiplier(VegType veg_type)
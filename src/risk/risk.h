@@ -3,16 +3,208 @@
 
 #include "../models/fire.h"
 #include "../models/road.h"
+#include "../models/road_geom.h"
 #include "../models/vegetation.h"
+#include "../routing/road_graph.h"
+#include "../simulation/fire_arrival.h"
+#include "../spatial/fire_index.h"
+#include "../spatial/rtree.h"
+#include "../spatial/veg_index.h"
+#include "../threading/pool.h"
 
-/// Assesses the risk of a road. Putting the risk into road.risk and returning it
-RoadRisk assess_road(RoadSeg* road, FireVec* fire, VegSlice* vegetation);
+#include <stdbool.h>
 
-/// Assesses all roads in a list, putting their risk into their data
-void assess_roads(RoadSegSlice* roads, FireSlice* fires, VegSlice* vegetation);
+/// Assesses all roads in a list, putting their risk into their data.
+///
+/// The risk is built up per segment (the line between two consecutive nodes), so a long road only
+/// gets risk from the parts of it that are close to a fire. Every segment scores the time it takes
+/// to get out of the area from it over the road network against the time until the fire reaches
+/// it, and how hot the fire and the vegetation around them are.
+///
+/// `bbox` is the area being assessed: the roads leave it at its edges, see `RoadGraph`. The roads
+/// and fires must have been projected on its projection.
+void assess_roads(RoadSegSlice* roads, FireSlice* fires, const VegIndex* vegetation,
+                  BoundBox bbox);
 
-// Calculates the impact score of the vegetation surrounding a road
-double calc_vegetation_impact_score(RoadSeg* road, FireArea* fire, VegSlice vegetation);
+/// Same as `assess_roads()`, with the roads split between the threads of the pool. Every road is
+/// assessed on its own, so the result is the same for any amount of threads
+void assess_roads_parallel(RoadSegSlice* roads, FireSlice* fires, const VegIndex* vegetation,
+                           BoundBox bbox, ThreadPool* pool);
+
+/// Same as `assess_roads_parallel()`, with the time it takes a fire to reach a road read off the
+/// arrival map, so it follows the vegetation and wind between them. Fires outside the map keep the
+/// estimate from the straight line distance.
+/// `segment_escape` is the result of `road_segment_escape()` for the roads, so it can be shared
+/// between assessments of the same roads, or NULL to work it out
+void assess_roads_arrival(RoadSegSlice* roads, FireSlice* fires, const VegIndex* vegetation,
+                          BoundBox bbox, const double* segment_escape,
+                          const FireArrival* arrival, ThreadPool* pool);
+
+/// Same as `assess_roads_arrival()`, and also get the risk of every segment of every road, such as
+/// for `road_graph_set_risk()`. `segment_risk_out` must have room for one risk per node of the
+/// roads. The risk of the segment from node `j` to node `j + 1` of a road is at the index of node
+/// `j` among the nodes of all roads in order, and the last node of every road gets 0.
+///
+/// The risk of a segment is the risk its road would have if all of the road were like it, so the
+/// risk of a road is about the average of the risks of its segments, weighted by their length
+void assess_road_segments(RoadSegSlice* roads, FireSlice* fires, const VegIndex* vegetation,
+                          BoundBox bbox, const double* segment_escape,
+                          const FireArrival* arrival, ThreadPool* pool,
+                          RoadRisk* segment_risk_out);
+
+/// Work out the seconds it takes to get out of the bbox from every segment of the roads, driving
+/// over the road network to the nearest exit with a single search (see `route_time_to_safety()`).
+/// Roads with no way out get an hour.
+///
+/// The time of each segment is weighted by its share of the length of its road, so the times of a
+/// road sum to its average time to safety. They are laid out like the risks of
+/// `assess_road_segments()`, with 0 for the last node of every road.
+/// The caller is responsible for freeing the array
+double* road_segment_escape(RoadSegSlice roads, BoundBox bbox);
+
+/// Same as `road_segment_escape()`, with the time to safety of every vertex of a graph of the
+/// roads given, such as the congested times of `traffic_times_to_safety()`
+double* road_segment_escape_times(const RoadGraph* graph, RoadSegSlice roads,
+                                  const double* time_to_safety);
+
+/// The impact of one fire on the risk of one road
+typedef struct
+{
+    /// The id of the fire in the `RiskState`
+    size_t fire;
+    double impact;
+    /// The distance from the fire to the road in metres, which decides the reason for the risk
+    double dst;
+} FireContribution;
+
+typedef VecDef(FireContribution) FireContributionVec;
+
+/// What scoring needs to know about a fire besides its `FireArea`, worked out once per fire
+/// instead of once for every road near it
+typedef struct
+{
+    /// The vegetation risk multiplier under the fire
+    double vegetation;
+    /// Whether the fire is on the arrival map, so its ETAs can be read off it
+    bool on_arrival_map;
+} FireAttrs;
+
+/// What scoring needs to know about a road, worked out once per road instead of once for every
+/// fire near it
+typedef struct
+{
+    /// The bounds of the road grown by the distance a fire has to be within to affect it
+    MRect reach;
+    /// The weight of the risk of the road, from the material of the road
+    double vulnerability;
+} RoadAttrs;
+
+/// The per road phase of an assessment, which only depends on the roads. Assessments of the same
+/// roads with different fires, like the scenarios of an ensemble, can share it read-only
+typedef struct
+{
+    RoadGeom geom;
+    RoadAttrs* road_attrs;
+    /// The vegetation multiplier under each node of the roads
+    double* node_vegetation;
+    /// The weighted time to safety of each segment of the roads, see `road_segment_escape()`, and
+    /// the times the phase worked out itself if it was not given any, which it frees
+    const double* segment_escape;
+    double* own_segment_escape;
+} RoadPhase;
+
+/// Work out the per road phase of the roads. `segment_escape` is like `assess_roads_arrival()`
+/// takes it, and must outlive the phase if it is not NULL.
+/// The caller is responsible for freeing the phase with `road_phase_free()`
+RoadPhase road_phase_create(RoadSegSlice roads, const VegIndex* vegetation, BoundBox bbox,
+                            const double* segment_escape);
+
+void road_phase_free(RoadPhase* phase);
+
+/// The memory the per fire and pair phases work in, which can be kept between assessments so
+/// they do not allocate it again. Start from a zeroed one
+typedef struct
+{
+    FireIndex fire_index;
+    FireAttrs* fire_attrs;
+    /// The nearby fires of the road each thread is on
+    FireIdxVec* candidates;
+    size_t candidate_count;
+} AssessScratch;
+
+void assess_scratch_free(AssessScratch* scratch);
+
+/// Same as `assess_roads_arrival()`, with the per road phase worked out beforehand. Only the per
+/// fire and pair phases run, in the memory of `scratch`
+void assess_roads_phased(RoadSegSlice* roads, FireSlice* fires, const VegIndex* vegetation,
+                         const RoadPhase* phase, const FireArrival* arrival, ThreadPool* pool,
+                         AssessScratch* scratch);
+
+typedef struct
+{
+    FireArea fire;
+    FireAttrs attrs;
+    /// False once the fire has been removed. Its id is not reused
+    bool active;
+} TrackedFire;
+
+typedef VecDef(TrackedFire) TrackedFireVec;
+typedef VecDef(size_t) RoadIdxVec;
+
+/// The risk of a set of roads, kept up to date as fires are added, removed and moved.
+///
+/// Every road keeps the impact of each nearby fire, so a change to a fire only recomputes the
+/// impact on the roads within reach of it, and the risk of those roads is summed again on the next
+/// `risk_rescore()`. The impacts are summed in the order of the fire ids, so a road ends up with
+/// exactly the risk `assess_roads()` would give it for the active fires in that order.
+typedef struct
+{
+    /// The roads being scored, not owned by the state
+    RoadSegSlice* roads;
+    const VegIndex* vegetation;
+    RoadPhase phase;
+    RTree road_tree;
+    /// If not NULL, the ETAs of the fires on it are read off this map, not owned by the state
+    const FireArrival* arrival;
+    /// The ETA of each road read off the arrival map, NAN until a fire on the map first needs it
+    double* road_eta;
+    /// Every fire ever added, indexed by id
+    TrackedFireVec fires;
+    /// The nearby fires of each road, ordered by fire id
+    FireContributionVec* contributions;
+    /// The roads whose risk is out of date, and a flag per road for whether it is in there
+    RoadIdxVec dirty;
+    bool* is_dirty;
+
+    // Scratch memory for finding the roads around a fire
+    RTreeSegVec query_buf;
+    size_t* last_seen;
+    size_t visit_stamp;
+} RiskState;
+
+/// Assess the roads like `assess_roads_arrival()`, and keep what is needed to update them as the
+/// fires change. Fire `i` of the slice gets id `i`. The fires added later are scored against the
+/// same escape times and arrival map.
+/// The roads, and the escape times and the arrival map if they are not NULL, must outlive the
+/// state. The caller is responsible for freeing the state with `risk_state_free()`
+RiskState risk_state_create(RoadSegSlice* roads, FireSlice fires, const VegIndex* vegetation,
+                            BoundBox bbox, const double* segment_escape,
+                            const FireArrival* arrival, ThreadPool* pool);
+
+void risk_state_free(RiskState* state);
+
+/// Add a fire, which must have been projected with `project_fires()`, and get its id
+size_t risk_add_fire(RiskState* state, FireArea fire);
+
+/// Remove a fire by its id
+void risk_remove_fire(RiskState* state, size_t id);
+
+/// Replace the data of a fire by its id, for example when it has moved or changed intensity
+void risk_update_fire(RiskState* state, size_t id, FireArea fire);
+
+/// Recompute the risk of every road affected by the changes since the last call, and get how many
+/// roads were recomputed
+size_t risk_rescore(RiskState* state);
 
 // Get the risk multiplier for a given vegetation type
 double get_vegetation_risk_multiplier(VegType veg_type);
@@ -0,0 +1,543 @@
+#include "contraction.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+/// The amount of vertices a witness search settles before giving up and keeping the shortcut.
+/// Lower limits build faster but leave more shortcuts
+#define WITNESS_SETTLE_LIMIT 64
+
+typedef struct
+{
+    double key;
+    uint32_t vertex;
+} HeapItem;
+
+typedef VecDef(HeapItem) HeapItemVec;
+typedef VecDef(uint32_t) ArcIdxVec;
+typedef VecDef(RouteArc) RouteArcVec;
+
+/// A neighbour of the vertex being taken out, over the cheapest arc to it
+typedef struct
+{
+    uint32_t vertex;
+    uint32_t arc;
+    double cost;
+} Neighbour;
+
+typedef VecDef(Neighbour) NeighbourVec;
+
+/// The state of the hierarchy while the vertices are taken out
+typedef struct
+{
+    size_t vertexCount;
+    uint32_t exitVertex;
+    RouteArcVec arcs;
+    /// The arcs of every vertex to the vertices still in the graph
+    ArcIdxVec* adjacency;
+    bool* contracted;
+    /// The amount of neighbours of each vertex that were taken out, which spreads the order out
+    /// over the graph
+    uint32_t* deleted;
+
+    // Witness search scratch memory
+    double* dist;
+    uint32_t* reached;
+    uint32_t stamp;
+    HeapItemVec heap;
+
+    /// The shortcuts the last vertex looked at would take
+    RouteArcVec shortcuts;
+
+    // Neighbour scratch memory
+    NeighbourVec neighbours;
+    uint32_t* neighbourSlot;
+    uint32_t* neighbourStamp;
+    uint32_t neighbourQuery;
+} Contraction;
+
+static void heap_push(HeapItemVec* heap, HeapItem item)
+{
+    vec_push(heap, item);
+
+    size_t i = heap->len - 1;
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+        if (heap->items[parent].key <= item.key)
+            break;
+
+        heap->items[i] = heap->items[parent];
+        i = parent;
+    }
+    heap->items[i] = item;
+}
+
+static HeapItem heap_pop(HeapItemVec* heap)
+{
+    HeapItem top = heap->items[0];
+    HeapItem last = heap->items[--heap->len];
+
+    size_t i = 0;
+    while (true)
+    {
+        size_t child = 2 * i + 1;
+        if (child >= heap->len)
+            break;
+        if (child + 1 < heap->len && heap->items[child + 1].key < heap->items[child].key)
+            child++;
+        if (last.key <= heap->items[child].key)
+            break;
+
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+    if (heap->len > 0)
+        heap->items[i] = last;
+
+    return top;
+}
+
+static uint32_t arc_other(const RouteArc* arc, uint32_t vertex)
+{
+    return arc->a == vertex ? arc->b : arc->a;
+}
+
+static void add_arc(Contraction* c, RouteArc arc)
+{
+    const uint32_t idx = (uint32_t)c->arcs.len;
+    vec_push(&c->arcs, arc);
+    vec_push(&c->adjacency[arc.a], idx);
+    vec_push(&c->adjacency[arc.b], idx);
+}
+
+/// Drop the arcs to a vertex that was taken out from the arcs of its neighbours, so the searches
+/// do not have to skip over them
+static void remove_arcs_to(Contraction* c, uint32_t vertex)
+{
+    for (size_t i = 0; i < c->neighbours.len; i++)
+    {
+        ArcIdxVec* arcs = &c->adjacency[c->neighbours.items[i].vertex];
+        size_t kept = 0;
+        for (size_t j = 0; j < arcs->len; j++)
+        {
+            const RouteArc* arc = &c->arcs.items[arcs->items[j]];
+            if (arc->a != vertex && arc->b != vertex)
+                arcs->items[kept++] = arcs->items[j];
+        }
+        arcs->len = kept;
+    }
+}
+
+/// Gather the neighbours of a vertex that are still in the graph, each over its cheapest arc.
+/// The exit vertex is put last, so the witness searches never have to start from it
+static void gather_neighbours(Contraction* c, uint32_t vertex)
+{
+    vec_empty(&c->neighbours);
+    c->neighbourQuery++;
+
+    const ArcIdxVec arcs = c->adjacency[vertex];
+    for (size_t i = 0; i < arcs.len; i++)
+    {
+        const RouteArc* arc = &c->arcs.items[arcs.items[i]];
+        const uint32_t other = arc_other(arc, vertex);
+        if (c->contracted[other] || other == vertex)
+            continue;
+
+        if (c->neighbourStamp[other] == c->neighbourQuery)
+        {
+            Neighbour* known = &c->neighbours.items[c->neighbourSlot[other]];
+            if (arc->cost < known->cost)
+            {
+                known->cost = arc->cost;
+                known->arc = arcs.items[i];
+            }
+            continue;
+        }
+
+        c->neighbourStamp[other] = c->neighbourQuery;
+        c->neighbourSlot[other] = (uint32_t)c->neighbours.len;
+        Neighbour neighbour = {.vertex = other, .arc = arcs.items[i], .cost = arc->cost};
+        vec_push(&c->neighbours, neighbour);
+    }
+
+    for (size_t i = 0; i + 1 < c->neighbours.len; i++)
+    {
+        if (c->neighbours.items[i].vertex != c->exitVertex)
+            continue;
+
+        const size_t last = c->neighbours.len - 1;
+        const Neighbour exit = c->neighbours.items[i];
+        c->neighbours.items[i] = c->neighbours.items[last];
+        c->neighbours.items[last] = exit;
+        c->neighbourSlot[c->neighbours.items[i].vertex] = (uint32_t)i;
+        c->neighbourSlot[exit.vertex] = (uint32_t)last;
+        break;
+    }
+}
+
+static double witness_dist(const Contraction* c, uint32_t vertex)
+{
+    return c->reached[vertex] == c->stamp ? c->dist[vertex] : INFINITY;
+}
+
+/// Search the graph without `skip` from neighbour `from` of it, until the neighbours after `from`
+/// are settled, or up to a cost of `maxCost` or the settle limit.
+/// The exit vertex is only ever reached and never searched from, so the exits are not joined
+/// to each other through it
+static void witness_search(Contraction* c, size_t from, uint32_t skip, double maxCost)
+{
+    const uint32_t start = c->neighbours.items[from].vertex;
+    size_t targetsLeft = c->neighbours.len - from - 1;
+
+    c->stamp++;
+    if (c->stamp == 0)
+    {
+        memset(c->reached, 0, c->vertexCount * sizeof(uint32_t));
+        c->stamp = 1;
+    }
+    vec_empty(&c->heap);
+
+    c->dist[start] = 0;
+    c->reached[start] = c->stamp;
+    heap_push(&c->heap, (HeapItem){.key = 0, .vertex = start});
+
+    size_t settled = 0;
+    while (c->heap.len > 0 && settled < WITNESS_SETTLE_LIMIT)
+    {
+        const HeapItem item = heap_pop(&c->heap);
+        if (item.key > c->dist[item.vertex])
+            continue;
+        if (item.key > maxCost)
+            break;
+        settled++;
+
+        if (c->neighbourStamp[item.vertex] == c->neighbourQuery &&
+            c->neighbourSlot[item.vertex] > from && --targetsLeft == 0)
+            break;
+        if (item.vertex == c->exitVertex)
+            continue;
+
+        const ArcIdxVec arcs = c->adjacency[item.vertex];
+        for (size_t i = 0; i < arcs.len; i++)
+        {
+            const RouteArc* arc = &c->arcs.items[arcs.items[i]];
+            const uint32_t other = arc_other(arc, item.vertex);
+            if (other == skip || c->contracted[other])
+                continue;
+
+            const double dist = item.key + arc->cost;
+            if (dist < witness_dist(c, other))
+            {
+                c->dist[other] = dist;
+                c->reached[other] = c->stamp;
+                heap_push(&c->heap, (HeapItem){.key = dist, .vertex = other});
+            }
+        }
+    }
+}
+
+/// Work out the shortcuts that taking a vertex out of the graph would take, into `shortcuts`
+static void find_shortcuts(Contraction* c, uint32_t vertex)
+{
+    gather_neighbours(c, vertex);
+    vec_empty(&c->shortcuts);
+    const size_t count = c->neighbours.len;
+
+    for (size_t i = 0; i + 1 < count; i++)
+    {
+        const Neighbour from = c->neighbours.items[i];
+        double maxCost = 0;
+        for (size_t j = i + 1; j < count; j++)
+            maxCost = MAX(maxCost, from.cost + c->neighbours.items[j].cost);
+        witness_search(c, i, vertex, maxCost);
+
+        for (size_t j = i + 1; j < count; j++)
+        {
+            const Neighbour to = c->neighbours.items[j];
+            const double via = from.cost + to.cost;
+            if (witness_dist(c, to.vertex) <= via)
+                continue;
+
+            RouteArc shortcut = {
+                .a = from.vertex,
+                .b = to.vertex,
+                .cost = via,
+                .middle = vertex,
+                .first = from.arc,
+                .second = to.arc,
+                .edge = SIZE_MAX,
+            };
+            vec_push(&c->shortcuts, shortcut);
+        }
+    }
+}
+
+/// How late a vertex should be taken out: the shortcuts it adds (counted twice, which keeps the
+/// hierarchy smaller) less the arcs it removes, and how many of its neighbours are already gone
+static double contraction_priority(Contraction* c, uint32_t vertex)
+{
+    find_shortcuts(c, vertex);
+    return 2.0 * c->shortcuts.len - (double)c->neighbours.len + c->deleted[vertex];
+}
+
+RouteHierarchy route_hierarchy_build(const RoadGraph* graph)
+{
+    const size_t vertexCount = graph->vertex_count + 1;
+    const uint32_t exitVertex = (uint32_t)graph->vertex_count;
+
+    Contraction c = {
+        .vertexCount = vertexCount,
+        .exitVertex = exitVertex,
+        .adjacency = calloc(vertexCount, sizeof(ArcIdxVec)),
+        .contracted = calloc(vertexCount, sizeof(bool)),
+        .deleted = calloc(vertexCount, sizeof(uint32_t)),
+        .dist = malloc(vertexCount * sizeof(double)),
+        .reached = calloc(vertexCount, sizeof(uint32_t)),
+        .neighbourSlot = malloc(vertexCount * sizeof(uint32_t)),
+        .neighbourStamp = calloc(vertexCount, sizeof(uint32_t)),
+    };
+
+    // Every open road once, as the edge in the direction of the higher vertex
+    for (size_t v = 0; v < graph->vertex_count; v++)
+    {
+        for (size_t e = graph->offsets[v]; e < graph->offsets[v + 1]; e++)
+        {
+            if (graph->targets[e] <= v || graph->closed[e])
+                continue;
+
+            add_arc(&c, (RouteArc){
+                            .a = (uint32_t)v,
+                            .b = graph->targets[e],
+                            .cost = graph->costs[e],
+                            .middle = UINT32_MAX,
+                            .first = UINT32_MAX,
+                            .second = UINT32_MAX,
+                            .edge = e,
+                        });
+        }
+    }
+    for (size_t i = 0; i < graph->exit_count; i++)
+    {
+        add_arc(&c, (RouteArc){
+                        .a = (uint32_t)graph->exits[i],
+                        .b = exitVertex,
+                        .cost = 0,
+                        .middle = UINT32_MAX,
+                        .first = UINT32_MAX,
+                        .second = UINT32_MAX,
+                        .edge = SIZE_MAX,
+                    });
+    }
+    const size_t graphArcCount = c.arcs.len;
+
+    HeapItemVec order = {0};
+    for (uint32_t v = 0; v < exitVertex; v++)
+        heap_push(&order, (HeapItem){.key = contraction_priority(&c, v), .vertex = v});
+
+    RouteHierarchy hierarchy = {
+        .graph = graph,
+        .vertex_count = vertexCount,
+        .exit_vertex = exitVertex,
+        .rank = malloc(vertexCount * sizeof(uint32_t)),
+    };
+
+    // Taking out a vertex changes the priorities of its neighbours, so a vertex is checked again
+    // when it comes out of the queue, and put back if it is no longer the least important
+    uint32_t nextRank = 0;
+    while (order.len > 0)
+    {
+        const HeapItem item = heap_pop(&order);
+        const double priority = contraction_priority(&c, item.vertex);
+        if (order.len > 0 && priority > order.items[0].key)
+        {
+            heap_push(&order, (HeapItem){.key = priority, .vertex = item.vertex});
+            continue;
+        }
+
+        for (size_t i = 0; i < c.shortcuts.len; i++)
+            add_arc(&c, c.shortcuts.items[i]);
+        c.contracted[item.vertex] = true;
+        remove_arcs_to(&c, item.vertex);
+        hierarchy.rank[item.vertex] = nextRank++;
+        for (size_t i = 0; i < c.neighbours.len; i++)
+            c.deleted[c.neighbours.items[i].vertex]++;
+    }
+    hierarchy.rank[exitVertex] = nextRank;
+    vec_free(order);
+
+    hierarchy.arcs = c.arcs.items;
+    hierarchy.arc_count = c.arcs.len;
+    hierarchy.shortcut_count = c.arcs.len - graphArcCount;
+
+    // Keep every arc at the end with the lower rank
+    hierarchy.up_offsets = calloc(vertexCount + 1, sizeof(size_t));
+    for (size_t i = 0; i < hierarchy.arc_count; i++)
+    {
+        const RouteArc* arc = &hierarchy.arcs[i];
+        const uint32_t low = hierarchy.rank[arc->a] < hierarchy.rank[arc->b] ? arc->a : arc->b;
+        hierarchy.up_offsets[low + 1]++;
+    }
+    for (size_t v = 0; v < vertexCount; v++)
+        hierarchy.up_offsets[v + 1] += hierarchy.up_offsets[v];
+
+    const size_t upCount = MAX(hierarchy.arc_count, 1);
+    hierarchy.up_targets = malloc(upCount * sizeof(uint32_t));
+    hierarchy.up_costs = malloc(upCount * sizeof(double));
+    hierarchy.up_arcs = malloc(upCount * sizeof(uint32_t));
+    size_t* fill = malloc(vertexCount * sizeof(size_t));
+    memcpy(fill, hierarchy.up_offsets, vertexCount * sizeof(size_t));
+    for (size_t i = 0; i < hierarchy.arc_count; i++)
+    {
+        const RouteArc* arc = &hierarchy.arcs[i];
+        const bool aLow = hierarchy.rank[arc->a] < hierarchy.rank[arc->b];
+        const uint32_t low = aLow ? arc->a : arc->b;
+        const size_t slot = fill[low]++;
+        hierarchy.up_targets[slot] = aLow ? arc->b : arc->a;
+        hierarchy.up_costs[slot] = arc->cost;
+        hierarchy.up_arcs[slot] = (uint32_t)i;
+    }
+    free(fill);
+
+    hierarchy.dist = malloc(vertexCount * sizeof(double));
+    hierarchy.parent_arc = malloc(vertexCount * sizeof(uint32_t));
+    hierarchy.reached = calloc(vertexCount, sizeof(uint32_t));
+    hierarchy.settled = calloc(vertexCount, sizeof(uint32_t));
+
+    for (size_t v = 0; v < vertexCount; v++)
+        vec_free(c.adjacency[v]);
+    free(c.adjacency);
+    free(c.contracted);
+    free(c.deleted);
+    free(c.dist);
+    free(c.reached);
+    vec_free(c.heap);
+    vec_free(c.shortcuts);
+    vec_free(c.neighbours);
+    free(c.neighbourSlot);
+    free(c.neighbourStamp);
+
+    debug_log(MESSAGE, "Built a route hierarchy over %zu vertices with %zu shortcuts",
+              graph->vertex_count, hierarchy.shortcut_count);
+    return hierarchy;
+}
+
+void route_hierarchy_free(RouteHierarchy* hierarchy)
+{
+    free(hierarchy->rank);
+    free(hierarchy->arcs);
+    free(hierarchy->up_offsets);
+    free(hierarchy->up_targets);
+    free(hierarchy->up_costs);
+    free(hierarchy->up_arcs);
+    free(hierarchy->dist);
+    free(hierarchy->parent_arc);
+    free(hierarchy->reached);
+    free(hierarchy->settled);
+    *hierarchy = (RouteHierarchy){0};
+}
+
+/// Push the vertices an arc passes through when driven from `from`, not counting `from` itself.
+/// The exit vertex is left out, so a path ends at the exit it left the area through
+static void unpack_arc(const RouteHierarchy* hierarchy, uint32_t arcIdx, uint32_t from,
+                       VertexVec* out)
+{
+    const RouteArc* arc = &hierarchy->arcs[arcIdx];
+    if (arc->middle == UINT32_MAX)
+    {
+        const uint32_t to = arc_other(arc, from);
+        if (to != hierarchy->exit_vertex)
+        {
+            vec_push(out, to);
+        }
+        return;
+    }
+
+    if (from == arc->a)
+    {
+        unpack_arc(hierarchy, arc->first, arc->a, out);
+        unpack_arc(hierarchy, arc->second, arc->middle, out);
+    }
+    else
+    {
+        unpack_arc(hierarchy, arc->second, arc->b, out);
+        unpack_arc(hierarchy, arc->first, arc->middle, out);
+    }
+}
+
+bool route_hierarchy_safest_exit(RouteHierarchy* hierarchy, size_t start, RoutePath* path)
+{
+    vec_empty(&path->vertices);
+    path->cost = path->time = path->length = 0;
+    path->settled = 0;
+    if (start >= hierarchy->graph->vertex_count)
+        return false;
+
+    hierarchy->query++;
+    if (hierarchy->query == 0)
+    {
+        memset(hierarchy->reached, 0, hierarchy->vertex_count * sizeof(uint32_t));
+        memset(hierarchy->settled, 0, hierarchy->vertex_count * sizeof(uint32_t));
+        hierarchy->query = 1;
+    }
+    const uint32_t query = hierarchy->query;
+    const uint32_t exitVertex = (uint32_t)hierarchy->exit_vertex;
+
+    HeapItemVec heap = {0};
+    hierarchy->dist[start] = 0;
+    hierarchy->parent_arc[start] = UINT32_MAX;
+    hierarchy->reached[start] = query;
+    heap_push(&heap, (HeapItem){.key = 0, .vertex = (uint32_t)start});
+
+    // Only arcs up the hierarchy are followed, and the exit vertex is at the top, so the search
+    // is done once nothing in the queue is cheaper than the best route to it
+    while (heap.len > 0)
+    {
+        const HeapItem item = heap_pop(&heap);
+        if (hierarchy->settled[item.vertex] == query)
+            continue;
+        if (hierarchy->reached[exitVertex] == query && item.key >= hierarchy->dist[exitVertex])
+            break;
+        hierarchy->settled[item.vertex] = query;
+        path->settled++;
+
+        for (size_t i = hierarchy->up_offsets[item.vertex];
+             i < hierarchy->up_offsets[item.vertex + 1]; i++)
+        {
+            const uint32_t target = hierarchy->up_targets[i];
+            const double dist = item.key + hierarchy->up_costs[i];
+            if (hierarchy->reached[target] == query && dist >= hierarchy->dist[target])
+                continue;
+
+            hierarchy->dist[target] = dist;
+            hierarchy->parent_arc[target] = hierarchy->up_arcs[i];
+            hierarchy->reached[target] = query;
+            heap_push(&heap, (HeapItem){.key = dist, .vertex = target});
+        }
+    }
+    vec_free(heap);
+
+    if (hierarchy->reached[exitVertex] != query)
+        return false;
+
+    // The arcs from the exit vertex back to the start, which are then unpacked from the start on
+    ArcIdxVec arcs = {0};
+    for (uint32_t v = exitVertex; hierarchy->parent_arc[v] != UINT32_MAX;)
+    {
+        const uint32_t arcIdx = hierarchy->parent_arc[v];
+        vec_push(&arcs, arcIdx);
+        v = arc_other(&hierarchy->arcs[arcIdx], v);
+    }
+
+    vec_push(&path->vertices, start);
+    uint32_t from = (uint32_t)start;
+    for (size_t i = arcs.len; i-- > 0;)
+    {
+        unpack_arc(hierarchy, arcs.items[i], from, &path->vertices);
+        from = arc_other(&hierarchy->arcs[arcs.items[i]], from);
+    }
+    vec_free(arcs);
+
+    route_path_measure(hierarchy->graph, path);
+    return true;
+}
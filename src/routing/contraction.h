@@ -0,0 +1,80 @@
+#ifndef CONTRACTION_H
+#define CONTRACTION_H
+
+#include "road_graph.h"
+#include "route.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// A road or a shortcut between two vertices of a `RouteHierarchy`, which can be driven both ways
+typedef struct
+{
+    uint32_t a;
+    uint32_t b;
+    double cost;
+    /// For a shortcut, the vertex it skips and the arcs from `a` to it and from it to `b`.
+    /// UINT32_MAX for the arcs of the graph
+    uint32_t middle;
+    uint32_t first;
+    uint32_t second;
+    /// For the arcs of the graph, the edge from `a` to `b`. SIZE_MAX for the arcs to the exit
+    /// vertex and for shortcuts
+    size_t edge;
+} RouteArc;
+
+/// A contraction hierarchy over a road graph, which answers `route_safest_exit()` for many starts
+/// by searching far less of the graph.
+///
+/// Every exit is joined to one extra vertex, so routes to the nearest exit become routes to that
+/// vertex. The vertices are then taken out of the graph one by one, least important first. When a
+/// vertex is taken out, the cheapest route between two of its neighbours that went through it is
+/// replaced with a shortcut, unless a short search finds another route that is as cheap. A query
+/// only has to follow arcs towards more important vertices, and the exit vertex is the most
+/// important of all.
+/// https://en.wikipedia.org/wiki/Contraction_hierarchies
+///
+/// The hierarchy is built for the costs and closed roads of the graph at the time, and has to be
+/// built again after `road_graph_set_risk()` or `road_graph_set_road_closed()`. Building it takes
+/// about as long as a thousand `route_safest_exit()` queries, so it pays off when many routes are
+/// asked for between risk updates.
+typedef struct
+{
+    const RoadGraph* graph;
+    /// The vertices of the graph, and the exit vertex after them
+    size_t vertex_count;
+    size_t exit_vertex;
+    /// The order each vertex was taken out in
+    uint32_t* rank;
+
+    RouteArc* arcs;
+    size_t arc_count;
+    size_t shortcut_count;
+
+    /// The arcs of vertex `v` towards vertices of a higher rank are at the indices `up_offsets[v]`
+    /// up to (but not including) `up_offsets[v + 1]`
+    size_t* up_offsets;
+    uint32_t* up_targets;
+    double* up_costs;
+    uint32_t* up_arcs;
+
+    // Scratch memory for the queries, so queries on one hierarchy must not run at the same time
+    double* dist;
+    uint32_t* parent_arc;
+    uint32_t* reached;
+    uint32_t* settled;
+    uint32_t query;
+} RouteHierarchy;
+
+/// Build the hierarchy for the current costs of a graph, which must outlive it.
+/// The caller is responsible for freeing the hierarchy with `route_hierarchy_free()`
+RouteHierarchy route_hierarchy_build(const RoadGraph* graph);
+
+void route_hierarchy_free(RouteHierarchy* hierarchy);
+
+/// Same as `route_safest_exit()`, searching the hierarchy instead of the graph. Finds a route
+/// with the same cost, and the path is made up of the vertices of the graph
+bool route_hierarchy_safest_exit(RouteHierarchy* hierarchy, size_t start, RoutePath* path);
+
+#endif // CONTRACTION_H
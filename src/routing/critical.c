@@ -0,0 +1,149 @@
+#include "critical.h"
+
+#include <stdlib.h>
+
+/// The parent edge of the vertices the search starts at, which hang off the extra exit vertex
+#define NO_EDGE UINT32_MAX
+
+typedef VecDef(uint32_t) VertexStack;
+
+RoadCriticality road_criticality_find(const RoadGraph* graph)
+{
+    const size_t vertexCount = graph->vertex_count;
+    RoadCriticality criticality = {
+        .edge_trapped = calloc(MAX(graph->edge_count, 1), sizeof(uint32_t)),
+        .vertex_trapped = calloc(MAX(vertexCount, 1), sizeof(uint32_t)),
+    };
+
+    // The order each vertex was found in, where 0 is not found yet and the extra exit vertex
+    // would have been found first. The lowest order reachable from the subtree of a vertex over
+    // at most one edge that is not part of the tree. The amount of vertices in the subtree
+    uint32_t* order = calloc(MAX(vertexCount, 1), sizeof(uint32_t));
+    uint32_t* low = malloc(MAX(vertexCount, 1) * sizeof(uint32_t));
+    uint32_t* subtree = malloc(MAX(vertexCount, 1) * sizeof(uint32_t));
+    // The edge each vertex was found over, and the next of its edges to look at
+    uint32_t* parentEdge = malloc(MAX(vertexCount, 1) * sizeof(uint32_t));
+    size_t* nextEdge = malloc(MAX(vertexCount, 1) * sizeof(size_t));
+    VertexStack stack = {0};
+    uint32_t found = 0;
+
+    // The search is kept on a stack instead of recursing, as long roads make for deep trees
+    for (size_t i = 0; i < graph->exit_count; i++)
+    {
+        const uint32_t root = (uint32_t)graph->exits[i];
+        if (order[root] != 0)
+            continue;
+
+        order[root] = ++found;
+        low[root] = 0;
+        subtree[root] = 1;
+        parentEdge[root] = NO_EDGE;
+        nextEdge[root] = graph->offsets[root];
+        vec_push(&stack, root);
+
+        while (stack.len > 0)
+        {
+            const uint32_t vertex = stack.items[stack.len - 1];
+            if (nextEdge[vertex] < graph->offsets[vertex + 1])
+            {
+                const size_t e = nextEdge[vertex]++;
+                // Only the edge back along the same segment is the tree edge, so a second road
+                // between the same two vertices still counts as a way around
+                if (graph->closed[e] ||
+                    (parentEdge[vertex] != NO_EDGE && e == graph->twins[parentEdge[vertex]]))
+                    continue;
+
+                const uint32_t target = graph->targets[e];
+                if (order[target] != 0)
+                {
+                    low[vertex] = MIN(low[vertex], order[target]);
+                    continue;
+                }
+
+                order[target] = ++found;
+                // Every exit is joined to the extra exit vertex, which comes before all others
+                low[target] = graph->is_exit[target] ? 0 : order[target];
+                subtree[target] = 1;
+                parentEdge[target] = (uint32_t)e;
+                nextEdge[target] = graph->offsets[target];
+                vec_push(&stack, target);
+                continue;
+            }
+
+            stack.len--;
+            const uint32_t edge = parentEdge[vertex];
+            if (edge == NO_EDGE)
+                continue;
+
+            const uint32_t parent = graph->targets[graph->twins[edge]];
+            low[parent] = MIN(low[parent], low[vertex]);
+            subtree[parent] += subtree[vertex];
+
+            // Nothing in the subtree reaches the parent or above without the edge, or the parent
+            if (low[vertex] > order[parent])
+            {
+                criticality.edge_trapped[edge] = subtree[vertex];
+                criticality.edge_trapped[graph->twins[edge]] = subtree[vertex];
+                criticality.bridge_count++;
+            }
+            if (low[vertex] >= order[parent])
+                criticality.vertex_trapped[parent] += subtree[vertex];
+        }
+    }
+
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        if (criticality.vertex_trapped[v] > 0)
+            criticality.cut_vertex_count++;
+        if (order[v] == 0)
+            criticality.stranded_count++;
+    }
+
+    free(order);
+    free(low);
+    free(subtree);
+    free(parentEdge);
+    free(nextEdge);
+    vec_free(stack);
+    return criticality;
+}
+
+void road_criticality_free(RoadCriticality* criticality)
+{
+    free(criticality->edge_trapped);
+    free(criticality->vertex_trapped);
+    *criticality = (RoadCriticality){0};
+}
+
+static int cmp_critical_road(const void* r1, const void* r2)
+{
+    const size_t trapped1 = ((const CriticalRoad*)r1)->trapped;
+    const size_t trapped2 = ((const CriticalRoad*)r2)->trapped;
+    return (trapped2 > trapped1) - (trapped2 < trapped1);
+}
+
+CriticalRoadVec road_criticality_risky_roads(const RoadCriticality* criticality,
+                                             const RoadGraph* graph, RoadSegSlice roads,
+                                             RoadRisk min_risk)
+{
+    size_t* roadTrapped = calloc(MAX(roads.len, 1), sizeof(size_t));
+    for (size_t e = 0; e < graph->edge_count; e++)
+    {
+        const size_t road = graph->roads[e];
+        roadTrapped[road] = MAX(roadTrapped[road], criticality->edge_trapped[e]);
+    }
+
+    CriticalRoadVec critical = {0};
+    for (size_t r = 0; r < roads.len; r++)
+    {
+        if (roadTrapped[r] > 0 && roads.items[r].risk > min_risk)
+        {
+            vec_push(&critical, ((CriticalRoad){.road = r, .trapped = roadTrapped[r]}));
+        }
+    }
+    free(roadTrapped);
+
+    if (critical.len > 0)
+        qsort(critical.items, critical.len, sizeof(CriticalRoad), cmp_critical_road);
+    return critical;
+}
@@ -0,0 +1,60 @@
+#ifndef CRITICAL_H
+#define CRITICAL_H
+
+#include "../dyn.h"
+#include "../models/road.h"
+#include "road_graph.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// The segments and crossings of a road graph whose closure cuts part of it off from every exit.
+///
+/// A segment is a bridge if it is the only way between the two sides of it, and a vertex is an
+/// articulation point if it is the only way between two of its neighbours. Only the ones that
+/// leave a side without an exit are counted: a bridge between two parts that each have their own
+/// way out traps no one.
+typedef struct
+{
+    /// For every edge of the graph, how many vertices closing its segment cuts off from every exit.
+    /// 0 if there is a way around it. Both edges of a segment have the same amount
+    uint32_t* edge_trapped;
+    /// For every vertex of the graph, how many other vertices closing it cuts off from every exit
+    uint32_t* vertex_trapped;
+    /// The amount of segments and vertices that trap at least one vertex
+    size_t bridge_count;
+    size_t cut_vertex_count;
+    /// The amount of vertices that have no way out to begin with
+    size_t stranded_count;
+} RoadCriticality;
+
+/// A road that is risky and that part of the road network has no other way out than
+typedef struct
+{
+    size_t road;
+    /// The most vertices closing any one segment of the road cuts off from every exit
+    size_t trapped;
+} CriticalRoad;
+
+typedef VecDef(CriticalRoad) CriticalRoadVec;
+
+/// Find the segments and vertices whose closure traps part of the graph, in time linear in the
+/// size of the graph. Closed roads are no way out. The result only depends on the roads and on
+/// which of them are closed, so it can be kept while the risk of the roads changes.
+/// The caller is responsible for freeing the result with `road_criticality_free()`
+///
+/// Uses Tarjan's bridge finding on a depth first search from an extra vertex joined to all exits,
+/// so a part is only cut off when it loses its way to every exit.
+/// https://en.wikipedia.org/wiki/Bridge_(graph_theory)#Tarjan's_bridge-finding_algorithm
+RoadCriticality road_criticality_find(const RoadGraph* graph);
+
+void road_criticality_free(RoadCriticality* criticality);
+
+/// Get the roads with a risk above `min_risk` that have a segment closing which traps part of the
+/// graph, with the ones that trap the most first. The graph must have been built from the roads.
+/// The caller is responsible for freeing the list with `vec_free()`
+CriticalRoadVec road_criticality_risky_roads(const RoadCriticality* criticality,
+                                             const RoadGraph* graph, RoadSegSlice roads,
+                                             RoadRisk min_risk);
+
+#endif // CRITICAL_H
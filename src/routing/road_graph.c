@@ -0,0 +1,252 @@
+#include "road_graph.h"
+
+#include "../dyn.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+/// Mix the bits of a node id, so that consecutive ids spread out over the table
+static size_t hash_node_id(size_t id)
+{
+    uint64_t x = id;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (size_t)x;
+}
+
+/// Give every distinct node id a vertex, numbered in the order the ids first show up, and fill in
+/// the vertex of each node. Returns the amount of vertices.
+///
+/// The ids are looked up in an open addressing hash table of at least twice the amount of nodes,
+/// so a lookup takes a probe or two
+static size_t assign_vertices(RoadSegSlice roads, size_t nodeCount, uint32_t* nodeVertex)
+{
+    size_t capacity = 16;
+    while (capacity < nodeCount * 2)
+        capacity *= 2;
+    size_t* ids = malloc(capacity * sizeof(size_t));
+    uint32_t* vertices = malloc(capacity * sizeof(uint32_t));
+    bool* used = calloc(capacity, sizeof(bool));
+
+    size_t vertexCount = 0;
+    size_t node = 0;
+    for (size_t r = 0; r < roads.len; r++)
+    {
+        for (size_t j = 0; j < roads.items[r].nodes.len; j++, node++)
+        {
+            const size_t id = roads.items[r].nodes.items[j].id;
+            size_t slot = hash_node_id(id) & (capacity - 1);
+            while (used[slot] && ids[slot] != id)
+                slot = (slot + 1) & (capacity - 1);
+
+            if (!used[slot])
+            {
+                used[slot] = true;
+                ids[slot] = id;
+                vertices[slot] = (uint32_t)vertexCount++;
+            }
+            nodeVertex[node] = vertices[slot];
+        }
+    }
+
+    free(ids);
+    free(vertices);
+    free(used);
+    return vertexCount;
+}
+
+RoadGraph road_graph_from_roads(RoadSegSlice roads, BoundBox bbox)
+{
+    size_t nodeCount = 0;
+    for (size_t r = 0; r < roads.len; r++)
+        nodeCount += roads.items[r].nodes.len;
+    // Every node has at most two edges, one each way to the next node
+    assert(nodeCount < UINT32_MAX / 2 && "Too many road nodes for the graph");
+
+    const Projection proj = projection_from_bbox(bbox);
+    const MCoord corner1 = project_coord(bbox.c1, proj);
+    const MCoord corner2 = project_coord(bbox.c2, proj);
+
+    RoadGraph graph = {
+        .node_vertex = malloc(MAX(nodeCount, 1) * sizeof(uint32_t)),
+        .node_count = nodeCount,
+        .road_nodes = malloc((roads.len + 1) * sizeof(size_t)),
+        .road_count = roads.len,
+        .area =
+            {
+                .min_x = MIN(corner1.x, corner2.x),
+                .min_y = MIN(corner1.y, corner2.y),
+                .max_x = MAX(corner1.x, corner2.x),
+                .max_y = MAX(corner1.y, corner2.y),
+            },
+        .max_speed = ROAD_GRAPH_DEFAULT_SPEED,
+    };
+    const size_t vertexCount = assign_vertices(roads, nodeCount, graph.node_vertex);
+    graph.vertex_count = vertexCount;
+    graph.coords = malloc(MAX(vertexCount, 1) * sizeof(MCoord));
+    graph.node_ids = malloc(MAX(vertexCount, 1) * sizeof(size_t));
+    graph.is_exit = malloc(MAX(vertexCount, 1) * sizeof(bool));
+    graph.offsets = calloc(vertexCount + 1, sizeof(size_t));
+
+    // Count the edges of every vertex, skipping segments between two copies of the same node
+    size_t node = 0;
+    for (size_t r = 0; r < roads.len; r++)
+    {
+        NodeSlice nodes = roads.items[r].nodes;
+        for (size_t j = 0; j < nodes.len; j++, node++)
+        {
+            const uint32_t vertex = graph.node_vertex[node];
+            graph.coords[vertex] = mcoord_load(nodes.items[j].mcoords);
+            graph.node_ids[vertex] = nodes.items[j].id;
+
+            if (j + 1 < nodes.len && graph.node_vertex[node + 1] != vertex)
+            {
+                graph.offsets[vertex + 1]++;
+                graph.offsets[graph.node_vertex[node + 1] + 1]++;
+            }
+        }
+    }
+    for (size_t v = 0; v < vertexCount; v++)
+        graph.offsets[v + 1] += graph.offsets[v];
+
+    const size_t edgeCount = graph.offsets[vertexCount];
+    graph.edge_count = edgeCount;
+    graph.targets = malloc(MAX(edgeCount, 1) * sizeof(uint32_t));
+    graph.twins = malloc(MAX(edgeCount, 1) * sizeof(uint32_t));
+    graph.lengths = malloc(MAX(edgeCount, 1) * sizeof(double));
+    graph.times = malloc(MAX(edgeCount, 1) * sizeof(double));
+    graph.costs = malloc(MAX(edgeCount, 1) * sizeof(double));
+    graph.roads = malloc(MAX(edgeCount, 1) * sizeof(uint32_t));
+    graph.segments = malloc(MAX(edgeCount, 1) * sizeof(uint32_t));
+    graph.closed = calloc(MAX(edgeCount, 1), sizeof(bool));
+
+    // The next free edge of every vertex
+    size_t* fill = malloc(MAX(vertexCount, 1) * sizeof(size_t));
+    memcpy(fill, graph.offsets, vertexCount * sizeof(size_t));
+
+    node = 0;
+    for (size_t r = 0; r < roads.len; r++)
+    {
+        const RoadSeg* road = &roads.items[r];
+        graph.road_nodes[r] = node;
+        const double speed = road->speed_limit > 0 ? road->speed_limit : ROAD_GRAPH_DEFAULT_SPEED;
+        graph.max_speed = MAX(graph.max_speed, speed);
+
+        for (size_t j = 0; j + 1 < road->nodes.len; j++)
+        {
+            const size_t seg = node + j;
+            const uint32_t from = graph.node_vertex[seg];
+            const uint32_t to = graph.node_vertex[seg + 1];
+            if (from == to)
+                continue;
+
+            const double length = mcoord_dst(graph.coords[from], graph.coords[to]);
+            const size_t forward = fill[from]++;
+            const size_t backward = fill[to]++;
+
+            graph.targets[forward] = to;
+            graph.targets[backward] = from;
+            graph.twins[forward] = (uint32_t)backward;
+            graph.twins[backward] = (uint32_t)forward;
+            graph.lengths[forward] = graph.lengths[backward] = length;
+            graph.times[forward] = graph.times[backward] = length / speed;
+            graph.costs[forward] = graph.costs[backward] = length / speed;
+            graph.roads[forward] = graph.roads[backward] = (uint32_t)r;
+            graph.segments[forward] = graph.segments[backward] = (uint32_t)seg;
+        }
+        node += road->nodes.len;
+    }
+    graph.road_nodes[roads.len] = node;
+    free(fill);
+
+    VecDef(size_t) exits = {0};
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        graph.is_exit[v] = road_graph_exit_dst_bound(&graph, graph.coords[v]) <= 0;
+        if (graph.is_exit[v])
+        {
+            vec_push(&exits, v);
+        }
+    }
+    graph.exits = exits.items;
+    graph.exit_count = exits.len;
+
+    return graph;
+}
+
+void road_graph_free(RoadGraph* graph)
+{
+    free(graph->coords);
+    free(graph->node_ids);
+    free(graph->is_exit);
+    free(graph->exits);
+    free(graph->offsets);
+    free(graph->targets);
+    free(graph->twins);
+    free(graph->lengths);
+    free(graph->times);
+    free(graph->costs);
+    free(graph->roads);
+    free(graph->segments);
+    free(graph->closed);
+    free(graph->node_vertex);
+    free(graph->road_nodes);
+    *graph = (RoadGraph){0};
+}
+
+void road_graph_set_risk(RoadGraph* graph, RoadSegSlice roads, const RoadRisk* segment_risk,
+                         double risk_weight)
+{
+    for (size_t e = 0; e < graph->edge_count; e++)
+    {
+        const RoadRisk risk = segment_risk != NULL ? segment_risk[graph->segments[e]]
+                                                   : roads.items[graph->roads[e]].risk;
+        graph->costs[e] = graph->times[e] * (1 + risk_weight * MAX(risk, 0));
+    }
+}
+
+size_t road_graph_set_road_closed(RoadGraph* graph, size_t road, bool closed)
+{
+    size_t changed = 0;
+    for (size_t seg = graph->road_nodes[road]; seg + 1 < graph->road_nodes[road + 1]; seg++)
+    {
+        // The edges of the segment leave the vertex of its first node
+        const uint32_t from = graph->node_vertex[seg];
+        for (size_t e = graph->offsets[from]; e < graph->offsets[from + 1]; e++)
+        {
+            if (graph->segments[e] != seg || graph->closed[e] == closed)
+                continue;
+
+            graph->closed[e] = graph->closed[graph->twins[e]] = closed;
+            changed += 2;
+        }
+    }
+    return changed;
+}
+
+size_t road_graph_nearest_vertex(const RoadGraph* graph, MCoord p)
+{
+    size_t best = SIZE_MAX;
+    double bestDst2 = INFINITY;
+    for (size_t v = 0; v < graph->vertex_count; v++)
+    {
+        const double dx = graph->coords[v].x - p.x;
+        const double dy = graph->coords[v].y - p.y;
+        const double dst2 = dx * dx + dy * dy;
+        if (dst2 < bestDst2)
+        {
+            bestDst2 = dst2;
+            best = v;
+        }
+    }
+    return best;
+}
+
+double road_graph_exit_dst_bound(const RoadGraph* graph, MCoord p)
+{
+    const MRect area = graph->area;
+    const double edgeDst = MIN(MIN(p.x - area.min_x, area.max_x - p.x),
+                               MIN(p.y - area.min_y, area.max_y - p.y));
+    return MAX(edgeDst - ROAD_GRAPH_EXIT_MARGIN, 0);
+}
@@ -0,0 +1,110 @@
+#ifndef ROAD_GRAPH_H
+#define ROAD_GRAPH_H
+
+#include "../models/geo.h"
+#include "../models/road.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// How close in metres a node has to be to the edge of the bbox to count as a way out of it
+#define ROAD_GRAPH_EXIT_MARGIN 50
+/// The speed in m/s that roads without a speed limit are driven at, 50 km/h
+#define ROAD_GRAPH_DEFAULT_SPEED 13.89
+/// How much longer driving a road seems to routing per point of risk, see `road_graph_set_risk()`
+#define ROAD_GRAPH_RISK_WEIGHT 0.5
+
+/// The roads of a bbox as a graph to route over.
+///
+/// Roads that share an OSM node are connected there, and every node is a vertex. Every segment of
+/// a road (the line between two consecutive nodes) is a pair of edges, one in each direction, as
+/// oneway tags are not parsed. The edges of a vertex are stored next to each other.
+///
+/// The nodes outside the bbox, or within ROAD_GRAPH_EXIT_MARGIN of its edge, are the exits: the
+/// places a route has left the area at. Overpass returns every node of a road that crosses the
+/// bbox, so every road that leaves the area has one.
+///
+/// Vertices, edges, roads and segments are counted with 32 bits, which keeps the edges small.
+///
+/// Roads can be closed with `road_graph_set_road_closed()`, and every search skips the edges of
+/// closed roads.
+typedef struct
+{
+    /// The projected coordinate of each vertex
+    MCoord* coords;
+    /// The OSM id of the node of each vertex
+    size_t* node_ids;
+    /// Whether each vertex is an exit
+    bool* is_exit;
+    size_t vertex_count;
+    /// The vertices that are exits
+    size_t* exits;
+    size_t exit_count;
+
+    /// The edges of vertex `v` are at the indices `offsets[v]` up to (but not including)
+    /// `offsets[v + 1]`. Has `vertex_count + 1` entries
+    size_t* offsets;
+    /// The vertex each edge leads to
+    uint32_t* targets;
+    /// The edge going the other way along the same segment
+    uint32_t* twins;
+    /// The length of each edge in metres
+    double* lengths;
+    /// The seconds it takes to drive each edge at the speed limit
+    double* times;
+    /// The weight routes are picked by: the driving time, made longer on risky roads. See
+    /// `road_graph_set_risk()`
+    double* costs;
+    /// The road each edge is part of
+    uint32_t* roads;
+    /// The segment of each edge, as the index of its first node among the nodes of all roads in
+    /// order. This is the node index of `RoadGeom` and `assess_road_segments()`
+    uint32_t* segments;
+    /// Whether each edge is part of a closed road
+    bool* closed;
+    size_t edge_count;
+
+    /// The vertex of every node of every road, in the node order of `RoadGeom`
+    uint32_t* node_vertex;
+    size_t node_count;
+    /// The nodes of road `r` are at the node indices `road_nodes[r]` up to (but not including)
+    /// `road_nodes[r + 1]`. Has `road_count + 1` entries
+    size_t* road_nodes;
+    size_t road_count;
+
+    /// The projected bbox
+    MRect area;
+    /// The fastest speed of any edge in m/s, so a straight line distance can be turned into a time
+    /// that no route beats
+    double max_speed;
+} RoadGraph;
+
+/// Build the graph of the roads of a bbox, with the costs set to the driving times. The roads must
+/// have been projected with `project_roads()` on the projection of the same bbox.
+/// The caller is responsible for freeing the graph with `road_graph_free()`
+RoadGraph road_graph_from_roads(RoadSegSlice roads, BoundBox bbox);
+
+void road_graph_free(RoadGraph* graph);
+
+/// Set the cost of every edge to its driving time multiplied by `1 + risk_weight * risk`, so
+/// routes avoid risky roads unless the detour is long. `segment_risk` has the risk of every
+/// segment like `assess_road_segments()` gives it, or is NULL to use the risk of the whole road
+/// for all of its segments
+void road_graph_set_risk(RoadGraph* graph, RoadSegSlice roads, const RoadRisk* segment_risk,
+                         double risk_weight);
+
+/// Close every segment of a road to all searches, or open it again. Routes, times to safety and
+/// hierarchies found before have to be found again, `SafetyTimes` keeps the times up to date.
+/// Get the amount of edges that were changed
+size_t road_graph_set_road_closed(RoadGraph* graph, size_t road, bool closed);
+
+/// Get the vertex closest to a point, or SIZE_MAX if the graph has no vertices.
+/// Looks at every vertex, so it is meant for a handful of queries and not for loops
+size_t road_graph_nearest_vertex(const RoadGraph* graph, MCoord p);
+
+/// A lower bound for the distance in metres from a point to the nearest exit: the distance to the
+/// edge of the bbox, less the exit margin
+double road_graph_exit_dst_bound(const RoadGraph* graph, MCoord p);
+
+#endif // ROAD_GRAPH_H
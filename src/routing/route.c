@@ -0,0 +1,327 @@
+#include "route.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define FORWARD 0
+#define BACKWARD 1
+
+typedef struct
+{
+    double key;
+    uint32_t vertex;
+} HeapItem;
+
+typedef VecDef(HeapItem) HeapItemVec;
+
+struct RouteSearch
+{
+    const RoadGraph* graph;
+    /// The cost from the start (forward) or to the nearest exit (backward) of every reached vertex
+    double* dist[2];
+    /// The edge each reached vertex was reached over, pointing back towards where the search
+    /// started. SIZE_MAX for the vertices the search started at
+    size_t* parent[2];
+    /// The query a vertex was last reached and settled in, so nothing has to be cleared between
+    /// queries
+    uint32_t* reached[2];
+    uint32_t* settled[2];
+    uint32_t query;
+    HeapItemVec heap[2];
+};
+
+static void heap_push(HeapItemVec* heap, HeapItem item)
+{
+    vec_push(heap, item);
+
+    size_t i = heap->len - 1;
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+        if (heap->items[parent].key <= item.key)
+            break;
+
+        heap->items[i] = heap->items[parent];
+        i = parent;
+    }
+    heap->items[i] = item;
+}
+
+static HeapItem heap_pop(HeapItemVec* heap)
+{
+    HeapItem top = heap->items[0];
+    HeapItem last = heap->items[--heap->len];
+
+    size_t i = 0;
+    while (true)
+    {
+        size_t child = 2 * i + 1;
+        if (child >= heap->len)
+            break;
+        if (child + 1 < heap->len && heap->items[child + 1].key < heap->items[child].key)
+            child++;
+        if (last.key <= heap->items[child].key)
+            break;
+
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+    if (heap->len > 0)
+        heap->items[i] = last;
+
+    return top;
+}
+
+RouteSearch* route_search_create(const RoadGraph* graph)
+{
+    RouteSearch* search = calloc(1, sizeof(RouteSearch));
+    search->graph = graph;
+    const size_t count = MAX(graph->vertex_count, 1);
+    for (size_t side = 0; side < 2; side++)
+    {
+        search->dist[side] = malloc(count * sizeof(double));
+        search->parent[side] = malloc(count * sizeof(size_t));
+        search->reached[side] = calloc(count, sizeof(uint32_t));
+        search->settled[side] = calloc(count, sizeof(uint32_t));
+    }
+    return search;
+}
+
+void route_search_free(RouteSearch* search)
+{
+    if (search == NULL)
+        return;
+
+    for (size_t side = 0; side < 2; side++)
+    {
+        free(search->dist[side]);
+        free(search->parent[side]);
+        free(search->reached[side]);
+        free(search->settled[side]);
+        vec_free(search->heap[side]);
+    }
+    free(search);
+}
+
+/// Start a new query, clearing the marks of the old ones when the query counter wraps around
+static void begin_query(RouteSearch* search)
+{
+    search->query++;
+    if (search->query == 0)
+    {
+        const size_t count = MAX(search->graph->vertex_count, 1);
+        for (size_t side = 0; side < 2; side++)
+        {
+            memset(search->reached[side], 0, count * sizeof(uint32_t));
+            memset(search->settled[side], 0, count * sizeof(uint32_t));
+        }
+        search->query = 1;
+    }
+    vec_empty(&search->heap[FORWARD]);
+    vec_empty(&search->heap[BACKWARD]);
+}
+
+static double reached_dist(const RouteSearch* search, size_t side, size_t vertex)
+{
+    return search->reached[side][vertex] == search->query ? search->dist[side][vertex] : INFINITY;
+}
+
+/// The potential of a vertex for the forward search, the backward search uses its negative.
+///
+/// Half the difference between a lower bound for the cost to an exit and one for the cost from
+/// the start. Both bounds change by at most the cost of any edge between two vertices, so the
+/// costs less the change in potential stay positive in both directions, and both searches are
+/// plain Dijkstra on those reduced costs.
+static double potential(const RoadGraph* graph, MCoord start, size_t vertex)
+{
+    const MCoord coord = graph->coords[vertex];
+    const double toExit = road_graph_exit_dst_bound(graph, coord);
+    const double fromStart = mcoord_dst(start, coord);
+    return (toExit - fromStart) / (2 * graph->max_speed);
+}
+
+bool route_safest_exit(RouteSearch* search, size_t start, RoutePath* path)
+{
+    const RoadGraph* graph = search->graph;
+    vec_empty(&path->vertices);
+    path->cost = path->time = path->length = 0;
+    path->settled = 0;
+    if (start >= graph->vertex_count)
+        return false;
+
+    begin_query(search);
+    const uint32_t query = search->query;
+    const MCoord startCoord = graph->coords[start];
+
+    search->dist[FORWARD][start] = 0;
+    search->parent[FORWARD][start] = SIZE_MAX;
+    search->reached[FORWARD][start] = query;
+    heap_push(&search->heap[FORWARD],
+              (HeapItem){.key = potential(graph, startCoord, start), .vertex = (uint32_t)start});
+
+    for (size_t i = 0; i < graph->exit_count; i++)
+    {
+        const size_t exit = graph->exits[i];
+        search->dist[BACKWARD][exit] = 0;
+        search->parent[BACKWARD][exit] = SIZE_MAX;
+        search->reached[BACKWARD][exit] = query;
+        heap_push(&search->heap[BACKWARD],
+                  (HeapItem){.key = -potential(graph, startCoord, exit), .vertex = (uint32_t)exit});
+    }
+
+    // The cheapest route seen so far, and the vertex where its two halves meet
+    double best = graph->is_exit[start] ? 0 : INFINITY;
+    size_t meet = graph->is_exit[start] ? start : SIZE_MAX;
+
+    HeapItemVec* heaps = search->heap;
+    while (heaps[FORWARD].len > 0 && heaps[BACKWARD].len > 0)
+    {
+        // With the averaged potentials, no route through an unsettled vertex of either search can
+        // beat the best one once the smallest keys add up to it
+        const double forwardKey = heaps[FORWARD].items[0].key;
+        const double backwardKey = heaps[BACKWARD].items[0].key;
+        if (forwardKey + backwardKey >= best)
+            break;
+
+        const size_t side = forwardKey <= backwardKey ? FORWARD : BACKWARD;
+        const size_t other = 1 - side;
+        const double sign = side == FORWARD ? 1 : -1;
+        const size_t vertex = heap_pop(&heaps[side]).vertex;
+        if (search->settled[side][vertex] == query)
+            continue;
+        search->settled[side][vertex] = query;
+        path->settled++;
+
+        const double vertexDist = search->dist[side][vertex];
+        for (size_t e = graph->offsets[vertex]; e < graph->offsets[vertex + 1]; e++)
+        {
+            if (graph->closed[e])
+                continue;
+
+            const size_t target = graph->targets[e];
+            const double dist = vertexDist + graph->costs[e];
+            if (dist >= reached_dist(search, side, target))
+                continue;
+
+            search->dist[side][target] = dist;
+            // The way back towards where this search started is the edge in the other direction
+            search->parent[side][target] = graph->twins[e];
+            search->reached[side][target] = query;
+            heap_push(&heaps[side],
+                      (HeapItem){
+                          .key = dist + sign * potential(graph, startCoord, target),
+                          .vertex = (uint32_t)target,
+                      });
+
+            const double total = dist + reached_dist(search, other, target);
+            if (total < best)
+            {
+                best = total;
+                meet = target;
+            }
+        }
+    }
+
+    if (meet == SIZE_MAX)
+        return false;
+
+    // Walk back from the meeting vertex to the start, then on to the exit
+    for (size_t v = meet; search->parent[FORWARD][v] != SIZE_MAX;
+         v = graph->targets[search->parent[FORWARD][v]])
+    {
+        vec_push(&path->vertices, v);
+    }
+    vec_push(&path->vertices, start);
+    for (size_t i = 0; i < path->vertices.len / 2; i++)
+    {
+        const size_t tmp = path->vertices.items[i];
+        path->vertices.items[i] = path->vertices.items[path->vertices.len - 1 - i];
+        path->vertices.items[path->vertices.len - 1 - i] = tmp;
+    }
+    for (size_t v = meet; search->parent[BACKWARD][v] != SIZE_MAX;)
+    {
+        v = graph->targets[search->parent[BACKWARD][v]];
+        vec_push(&path->vertices, v);
+    }
+
+    route_path_measure(graph, path);
+    return true;
+}
+
+void route_time_to_safety(const RoadGraph* graph, double* time_out, size_t* next_out)
+{
+    for (size_t v = 0; v < graph->vertex_count; v++)
+        time_out[v] = INFINITY;
+    if (next_out != NULL)
+    {
+        for (size_t v = 0; v < graph->vertex_count; v++)
+            next_out[v] = SIZE_MAX;
+    }
+
+    HeapItemVec heap = {0};
+    for (size_t i = 0; i < graph->exit_count; i++)
+    {
+        time_out[graph->exits[i]] = 0;
+        heap_push(&heap, (HeapItem){.key = 0, .vertex = (uint32_t)graph->exits[i]});
+    }
+
+    // The edges are the same both ways, so searching out from the exits gives the times towards
+    // them. Vertices come out of the heap in order of time, so the first time a vertex comes out is
+    // final
+    while (heap.len > 0)
+    {
+        const HeapItem item = heap_pop(&heap);
+        if (item.key > time_out[item.vertex])
+            continue;
+
+        for (size_t e = graph->offsets[item.vertex]; e < graph->offsets[item.vertex + 1]; e++)
+        {
+            if (graph->closed[e])
+                continue;
+
+            const uint32_t target = graph->targets[e];
+            const double time = item.key + graph->times[e];
+            if (time >= time_out[target])
+                continue;
+
+            time_out[target] = time;
+            if (next_out != NULL)
+                next_out[target] = graph->twins[e];
+            heap_push(&heap, (HeapItem){.key = time, .vertex = target});
+        }
+    }
+
+    vec_free(heap);
+}
+
+void route_path_measure(const RoadGraph* graph, RoutePath* path)
+{
+    path->cost = path->time = path->length = 0;
+    for (size_t i = 0; i + 1 < path->vertices.len; i++)
+    {
+        const size_t from = path->vertices.items[i];
+        const size_t to = path->vertices.items[i + 1];
+
+        size_t best = SIZE_MAX;
+        for (size_t e = graph->offsets[from]; e < graph->offsets[from + 1]; e++)
+        {
+            if (graph->targets[e] != to || graph->closed[e])
+                continue;
+            if (best == SIZE_MAX || graph->costs[e] < graph->costs[best])
+                best = e;
+        }
+        if (best == SIZE_MAX)
+            continue;
+
+        path->cost += graph->costs[best];
+        path->time += graph->times[best];
+        path->length += graph->lengths[best];
+    }
+}
+
+void route_path_free(RoutePath* path)
+{
+    vec_free(path->vertices);
+    *path = (RoutePath){0};
+}
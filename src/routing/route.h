@@ -0,0 +1,59 @@
+#ifndef ROUTE_H
+#define ROUTE_H
+
+#include "../dyn.h"
+#include "road_graph.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef VecDef(size_t) VertexVec;
+
+/// A route over the road graph
+typedef struct
+{
+    /// The vertices along the route, from the start to the end
+    VertexVec vertices;
+    /// The sum of the costs of the edges
+    double cost;
+    /// The seconds it takes to drive the route
+    double time;
+    /// The length of the route in metres
+    double length;
+    /// The amount of vertices the search settled to find the route, to see how much of the graph
+    /// it had to look at
+    size_t settled;
+} RoutePath;
+
+/// The memory for searching routes on one graph, kept between queries so that a query only
+/// touches the vertices it visits. A search is used by one thread at a time.
+typedef struct RouteSearch RouteSearch;
+
+/// Create a search over a graph, which must outlive it.
+/// The caller is responsible for freeing the search with `route_search_free()`
+RouteSearch* route_search_create(const RoadGraph* graph);
+
+void route_search_free(RouteSearch* search);
+
+/// Find the route with the lowest cost from a vertex to any exit of the graph, and get whether
+/// there is one. The path is cleared before it is filled in.
+///
+/// Uses bidirectional A*: one search from the start, and one from all exits at once. Both are
+/// guided by the straight line distance to the start and to the edge of the bbox at the fastest
+/// speed of the graph, averaged so the two searches agree and can stop as soon as they meet.
+/// The costs must be at least the driving times, which `road_graph_set_risk()` keeps them at.
+bool route_safest_exit(RouteSearch* search, size_t start, RoutePath* path);
+
+/// Work out the seconds it takes to drive from every vertex to its nearest exit, with one search
+/// from all exits at once. `time_out` must have room for one time per vertex, and gets INFINITY
+/// for the vertices with no way out. If `next_out` is not NULL it gets the edge to take from each
+/// vertex towards its exit, or SIZE_MAX at the exits and at the vertices with no way out
+void route_time_to_safety(const RoadGraph* graph, double* time_out, size_t* next_out);
+
+/// Fill in the cost, time and length of a path from its vertices, picking the cheapest edge
+/// between every two consecutive vertices
+void route_path_measure(const RoadGraph* graph, RoutePath* path);
+
+void route_path_free(RoutePath* path);
+
+#endif // ROUTE_H
@@ -0,0 +1,251 @@
+#include "safety.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+typedef struct
+{
+    double key;
+    uint32_t vertex;
+} HeapItem;
+
+typedef VecDef(HeapItem) HeapItemVec;
+
+static void heap_push(HeapItemVec* heap, HeapItem item)
+{
+    vec_push(heap, item);
+
+    size_t i = heap->len - 1;
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+        if (heap->items[parent].key <= item.key)
+            break;
+
+        heap->items[i] = heap->items[parent];
+        i = parent;
+    }
+    heap->items[i] = item;
+}
+
+static HeapItem heap_pop(HeapItemVec* heap)
+{
+    HeapItem top = heap->items[0];
+    HeapItem last = heap->items[--heap->len];
+
+    size_t i = 0;
+    while (true)
+    {
+        size_t child = 2 * i + 1;
+        if (child >= heap->len)
+            break;
+        if (child + 1 < heap->len && heap->items[child + 1].key < heap->items[child].key)
+            child++;
+        if (last.key <= heap->items[child].key)
+            break;
+
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+    if (heap->len > 0)
+        heap->items[i] = last;
+
+    return top;
+}
+
+SafetyTimes safety_times_create(RoadGraph* graph)
+{
+    const size_t count = MAX(graph->vertex_count, 1);
+    SafetyTimes safety = {
+        .graph = graph,
+        .times = malloc(count * sizeof(double)),
+        .next = malloc(count * sizeof(size_t)),
+        .before = malloc(count * sizeof(double)),
+        .marked = calloc(count, sizeof(uint32_t)),
+    };
+    route_time_to_safety(graph, safety.times, safety.next);
+    return safety;
+}
+
+void safety_times_free(SafetyTimes* safety)
+{
+    free(safety->times);
+    free(safety->next);
+    free(safety->before);
+    free(safety->marked);
+    vec_free(safety->touched);
+    *safety = (SafetyTimes){0};
+}
+
+/// Start a new update, clearing the marks of the old ones when the stamp wraps around
+static void begin_update(SafetyTimes* safety)
+{
+    safety->stamp++;
+    if (safety->stamp == 0)
+    {
+        memset(safety->marked, 0, MAX(safety->graph->vertex_count, 1) * sizeof(uint32_t));
+        safety->stamp = 1;
+    }
+    vec_empty(&safety->touched);
+}
+
+/// Remember the time a vertex had before the update, the first time the update touches it
+static void touch(SafetyTimes* safety, size_t vertex)
+{
+    if (safety->marked[vertex] == safety->stamp)
+        return;
+
+    safety->marked[vertex] = safety->stamp;
+    safety->before[vertex] = safety->times[vertex];
+    vec_push(&safety->touched, vertex);
+}
+
+/// Drive from a vertex over one of its edges, and queue the vertex at the other end if that is
+/// faster than the way out it has
+static void relax(SafetyTimes* safety, HeapItemVec* heap, size_t from, size_t edge)
+{
+    const RoadGraph* graph = safety->graph;
+    if (graph->closed[edge])
+        return;
+
+    const uint32_t target = graph->targets[edge];
+    const double time = safety->times[from] + graph->times[edge];
+    if (time >= safety->times[target])
+        return;
+
+    touch(safety, target);
+    safety->times[target] = time;
+    // The edges are the same both ways, so the way out is back along the edge
+    safety->next[target] = graph->twins[edge];
+    heap_push(heap, (HeapItem){.key = time, .vertex = target});
+}
+
+/// Run Dijkstra from the queued vertices, until nothing more gets faster
+static void propagate(SafetyTimes* safety, HeapItemVec* heap)
+{
+    const RoadGraph* graph = safety->graph;
+    while (heap->len > 0)
+    {
+        const HeapItem item = heap_pop(heap);
+        if (item.key > safety->times[item.vertex])
+            continue;
+
+        for (size_t e = graph->offsets[item.vertex]; e < graph->offsets[item.vertex + 1]; e++)
+            relax(safety, heap, item.vertex, e);
+    }
+}
+
+/// Compare the times of the vertices the update touched to the ones they had before it
+static SafetyChange measure_change(const SafetyTimes* safety)
+{
+    SafetyChange change = {0};
+    for (size_t i = 0; i < safety->touched.len; i++)
+    {
+        const size_t vertex = safety->touched.items[i];
+        const double before = safety->before[vertex];
+        const double after = safety->times[vertex];
+        if (before == after)
+            continue;
+
+        change.changed++;
+        if (isinf(after))
+            change.lost_exit++;
+        else if (isinf(before))
+            change.gained_exit++;
+        else
+        {
+            const double delay = after - before;
+            change.total_delay += delay;
+            if (fabs(delay) > fabs(change.max_delay))
+                change.max_delay = delay;
+        }
+    }
+    return change;
+}
+
+SafetyChange safety_times_close_road(SafetyTimes* safety, size_t road)
+{
+    RoadGraph* graph = safety->graph;
+    begin_update(safety);
+
+    // The vertices that drive out over the road, in either direction
+    for (size_t seg = graph->road_nodes[road]; seg + 1 < graph->road_nodes[road + 1]; seg++)
+    {
+        const uint32_t from = graph->node_vertex[seg];
+        for (size_t e = graph->offsets[from]; e < graph->offsets[from + 1]; e++)
+        {
+            if (graph->segments[e] != seg || graph->closed[e])
+                continue;
+
+            if (safety->next[from] == e)
+                touch(safety, from);
+            if (safety->next[graph->targets[e]] == graph->twins[e])
+                touch(safety, graph->targets[e]);
+        }
+    }
+    road_graph_set_road_closed(graph, road, true);
+
+    // And every vertex whose way out goes through one of them. The vertices that drive out over
+    // an edge to a touched vertex are the ones whose next edge is the twin of it
+    for (size_t i = 0; i < safety->touched.len; i++)
+    {
+        const size_t vertex = safety->touched.items[i];
+        for (size_t e = graph->offsets[vertex]; e < graph->offsets[vertex + 1]; e++)
+        {
+            if (safety->next[graph->targets[e]] == graph->twins[e])
+                touch(safety, graph->targets[e]);
+        }
+    }
+
+    for (size_t i = 0; i < safety->touched.len; i++)
+    {
+        safety->times[safety->touched.items[i]] = INFINITY;
+        safety->next[safety->touched.items[i]] = SIZE_MAX;
+    }
+
+    // Nothing outside of the subtree gets slower or faster, so the new times come in from its
+    // edge. Every vertex of it takes the best way through a neighbour outside of it to start with
+    HeapItemVec heap = {0};
+    const size_t subtreeSize = safety->touched.len;
+    for (size_t i = 0; i < subtreeSize; i++)
+    {
+        const size_t vertex = safety->touched.items[i];
+        for (size_t e = graph->offsets[vertex]; e < graph->offsets[vertex + 1]; e++)
+        {
+            if (safety->marked[graph->targets[e]] != safety->stamp)
+                relax(safety, &heap, graph->targets[e], graph->twins[e]);
+        }
+    }
+    propagate(safety, &heap);
+    vec_free(heap);
+
+    return measure_change(safety);
+}
+
+SafetyChange safety_times_open_road(SafetyTimes* safety, size_t road)
+{
+    RoadGraph* graph = safety->graph;
+    begin_update(safety);
+    if (road_graph_set_road_closed(graph, road, false) == 0)
+        return (SafetyChange){0};
+
+    // Only the vertices that get a faster way out over the road change, and their neighbours
+    // after them
+    HeapItemVec heap = {0};
+    for (size_t seg = graph->road_nodes[road]; seg + 1 < graph->road_nodes[road + 1]; seg++)
+    {
+        const uint32_t from = graph->node_vertex[seg];
+        for (size_t e = graph->offsets[from]; e < graph->offsets[from + 1]; e++)
+        {
+            if (graph->segments[e] != seg)
+                continue;
+
+            relax(safety, &heap, from, e);
+            relax(safety, &heap, graph->targets[e], graph->twins[e]);
+        }
+    }
+    propagate(safety, &heap);
+    vec_free(heap);
+
+    return measure_change(safety);
+}
@@ -0,0 +1,61 @@
+#ifndef SAFETY_H
+#define SAFETY_H
+
+#include "route.h"
+#include "road_graph.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// How the times to safety changed when a road was closed or opened
+typedef struct
+{
+    /// The amount of vertices whose time changed
+    size_t changed;
+    /// The amount of vertices that lost their last way out, and that got a way out again
+    size_t lost_exit;
+    size_t gained_exit;
+    /// The sum of the changes in seconds over the vertices that had a way out before and after,
+    /// positive when the times got longer
+    double total_delay;
+    /// The change in seconds with the largest size out of those
+    double max_delay;
+} SafetyChange;
+
+/// The seconds it takes to drive from every vertex of a graph to its nearest exit, kept up to date
+/// as roads are closed and opened.
+///
+/// The edges every vertex takes towards its exit make up a tree hanging off the exits. Closing a
+/// road only changes the times of the vertices below its edges in the tree, so only those are
+/// searched again, starting from their neighbours outside of it. Opening a road only makes times
+/// shorter, so the search starts at the ends of the road and stops where nothing gets faster.
+typedef struct
+{
+    RoadGraph* graph;
+    /// The time of each vertex, INFINITY for the vertices with no way out
+    double* times;
+    /// The edge to take from each vertex towards its exit, or SIZE_MAX at the exits and at the
+    /// vertices with no way out
+    size_t* next;
+
+    // Scratch memory for the updates, so updates on one tree must not run at the same time
+    /// The time each vertex had before the update, valid where `marked` is the current stamp
+    double* before;
+    uint32_t* marked;
+    uint32_t stamp;
+    VertexVec touched;
+} SafetyTimes;
+
+/// Work out the times to safety of every vertex of a graph, which must outlive them.
+/// The caller is responsible for freeing the times with `safety_times_free()`
+SafetyTimes safety_times_create(RoadGraph* graph);
+
+void safety_times_free(SafetyTimes* safety);
+
+/// Close a road of the graph and update the times, and get how they changed
+SafetyChange safety_times_close_road(SafetyTimes* safety, size_t road);
+
+/// Open a road of the graph again and update the times, and get how they changed
+SafetyChange safety_times_open_road(SafetyTimes* safety, size_t road);
+
+#endif // SAFETY_H
@@ -0,0 +1,220 @@
+#include "fire_arrival.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define NEIGHBOUR_COUNT 16
+
+/// The offsets of the neighbours of a cell: the 8 cells around it, then the 8 knight's moves
+static const int neighbourX[NEIGHBOUR_COUNT] = {-1, 0, 1, -1, 1, -1, 0, 1,
+                                                -2, -2, -1, 1, 2, 2, 1, -1};
+static const int neighbourY[NEIGHBOUR_COUNT] = {-1, -1, -1, 0, 0, 1, 1, 1,
+                                                -1, 1, 2, 2, 1, -1, -2, -2};
+
+typedef struct
+{
+    float time;
+    uint32_t cell;
+} HeapItem;
+
+typedef VecDef(HeapItem) HeapItemVec;
+
+static void heap_push(HeapItemVec* heap, HeapItem item)
+{
+    vec_push(heap, item);
+
+    size_t i = heap->len - 1;
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+        if (heap->items[parent].time <= item.time)
+            break;
+
+        heap->items[i] = heap->items[parent];
+        i = parent;
+    }
+    heap->items[i] = item;
+}
+
+static HeapItem heap_pop(HeapItemVec* heap)
+{
+    HeapItem top = heap->items[0];
+    HeapItem last = heap->items[--heap->len];
+
+    size_t i = 0;
+    while (true)
+    {
+        size_t child = 2 * i + 1;
+        if (child >= heap->len)
+            break;
+        if (child + 1 < heap->len && heap->items[child + 1].time < heap->items[child].time)
+            child++;
+        if (last.time <= heap->items[child].time)
+            break;
+
+        heap->items[i] = heap->items[child];
+        i = child;
+    }
+    if (heap->len > 0)
+        heap->items[i] = last;
+
+    return top;
+}
+
+/// Check if the fire can take the neighbour `d` of a cell. A knight's move passes between two
+/// cells, and is only taken if both of them burn, so fires do not jump over firebreaks
+static bool can_move(const uint8_t* fuel, size_t width, size_t x, size_t y, size_t d)
+{
+    if (d < 8)
+        return true;
+
+    // The move passes between the cell halfway along its long side, and the one diagonal to it
+    const int dx = neighbourX[d];
+    const int dy = neighbourY[d];
+    const int halfX = abs(dx) == 2 ? dx / 2 : 0;
+    const int halfY = abs(dy) == 2 ? dy / 2 : 0;
+    const size_t straight = (y + halfY) * width + x + halfX;
+    const size_t diagonal = (y + (halfY != 0 ? halfY : dy)) * width + x + (halfX != 0 ? halfX : dx);
+    return fire_spread_rate(fuel[straight]) > 0 && fire_spread_rate(fuel[diagonal]) > 0;
+}
+
+FireArrival fire_arrival_create(VegSlice vegetation, BoundBox bbox, double cell_size)
+{
+    FireArrival arrival = {.grid = fire_grid_from_bbox(bbox, cell_size)};
+    const size_t cellCount = arrival.grid.width * arrival.grid.height;
+
+    VegGrid fuel = veg_grid_from_vegetation(vegetation, bbox, arrival.grid.width,
+                                            arrival.grid.height);
+    arrival.fuel = malloc(cellCount * sizeof(uint8_t));
+    for (size_t i = 0; i < cellCount; i++)
+        arrival.fuel[i] = (uint8_t)fuel.cells[i];
+    veg_grid_free(&fuel);
+
+    arrival.time = malloc(cellCount * sizeof(float));
+    for (size_t i = 0; i < cellCount; i++)
+        arrival.time[i] = INFINITY;
+
+    return arrival;
+}
+
+void fire_arrival_solve(FireArrival* arrival, FireSlice fires, Vec2 wind, double rate_scale)
+{
+    const size_t width = arrival->grid.width;
+    const size_t height = arrival->grid.height;
+    const uint8_t* fuel = arrival->fuel;
+
+    // The seconds it takes to move to a neighbour, by the vegetation of the neighbour
+    float moveTimes[VEG_TYPE_COUNT][NEIGHBOUR_COUNT];
+    for (size_t d = 0; d < NEIGHBOUR_COUNT; d++)
+    {
+        const MCoord dir = {
+            .x = neighbourX[d] * arrival->grid.step_x.x + neighbourY[d] * arrival->grid.step_y.x,
+            .y = neighbourX[d] * arrival->grid.step_x.y + neighbourY[d] * arrival->grid.step_y.y,
+        };
+        const double dst = sqrt(dir.x * dir.x + dir.y * dir.y);
+        const double windFactor = fire_wind_factor(wind, dir);
+
+        for (size_t t = 0; t < VEG_TYPE_COUNT; t++)
+        {
+            const double rate = fire_spread_rate(t) * rate_scale;
+            moveTimes[t][d] = rate > 0 ? (float)(dst / (rate * windFactor)) : INFINITY;
+        }
+    }
+
+    float* arrivalTime = arrival->time;
+    for (size_t i = 0; i < width * height; i++)
+        arrivalTime[i] = INFINITY;
+
+    HeapItemVec heap = {0};
+    for (size_t i = 0; i < fires.len; i++)
+    {
+        size_t x, y;
+        if (!fire_grid_cell_of(&arrival->grid, fires.items[i].gcoord, &x, &y))
+            continue;
+
+        arrivalTime[y * width + x] = 0;
+        heap_push(&heap, (HeapItem){.time = 0, .cell = (uint32_t)(y * width + x)});
+    }
+
+    // Cells come out of the heap in order of arrival, so the first time a cell comes out is final.
+    // Cells are pushed again instead of moved up when they get an earlier time, and the stale
+    // entries are skipped
+    while (heap.len > 0)
+    {
+        const HeapItem item = heap_pop(&heap);
+        if (item.time > arrivalTime[item.cell])
+            continue;
+
+        const size_t x = item.cell % width;
+        const size_t y = item.cell / width;
+        for (size_t d = 0; d < NEIGHBOUR_COUNT; d++)
+        {
+            const ptrdiff_t nx = (ptrdiff_t)x + neighbourX[d];
+            const ptrdiff_t ny = (ptrdiff_t)y + neighbourY[d];
+            if (nx < 0 || ny < 0 || nx >= (ptrdiff_t)width || ny >= (ptrdiff_t)height)
+                continue;
+
+            const size_t neighbour = (size_t)ny * width + (size_t)nx;
+            const float time = item.time + moveTimes[fuel[neighbour]][d];
+            if (time >= arrivalTime[neighbour] || !can_move(fuel, width, x, y, d))
+                continue;
+
+            arrivalTime[neighbour] = time;
+            heap_push(&heap, (HeapItem){.time = time, .cell = (uint32_t)neighbour});
+        }
+    }
+
+    vec_free(heap);
+}
+
+void fire_arrival_free(FireArrival* arrival)
+{
+    free(arrival->fuel);
+    free(arrival->time);
+    *arrival = (FireArrival){0};
+}
+
+bool fire_arrival_covers(const FireArrival* arrival, GCoord coord)
+{
+    size_t x, y;
+    return fire_grid_cell_of(&arrival->grid, coord, &x, &y);
+}
+
+double fire_arrival_time(const FireArrival* arrival, GCoord coord)
+{
+    size_t x, y;
+    if (!fire_grid_cell_of(&arrival->grid, coord, &x, &y))
+        return INFINITY;
+
+    return arrival->time[y * arrival->grid.width + x];
+}
+
+double fire_arrival_road_eta(const FireArrival* arrival, RoadSeg road)
+{
+    const FireGrid* grid = &arrival->grid;
+
+    double best = INFINITY;
+    for (size_t i = 0; i + 1 < road.nodes.len; i++)
+    {
+        const LCoord a = global_to_local_exact(gcoord_load(road.nodes.items[i].coords), grid->bbox,
+                                               grid->height, grid->width);
+        const LCoord b = global_to_local_exact(gcoord_load(road.nodes.items[i + 1].coords),
+                                               grid->bbox, grid->height, grid->width);
+
+        const double len = sqrt((b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y));
+        const size_t steps = (size_t)ceil(len * 2) + 1;
+        for (size_t s = 0; s <= steps; s++)
+        {
+            const double t = (double)s / (double)steps;
+            const double x = a.x + (b.x - a.x) * t;
+            const double y = a.y + (b.y - a.y) * t;
+            if (x < 0 || y < 0 || x >= (double)grid->width || y >= (double)grid->height)
+                continue;
+
+            best = MIN(best, arrival->time[(size_t)y * grid->width + (size_t)x]);
+        }
+    }
+
+    return best;
+}
@@ -0,0 +1,52 @@
+#ifndef FIRE_ARRIVAL_H
+#define FIRE_ARRIVAL_H
+
+#include "../models/fire.h"
+#include "../models/geo.h"
+#include "../models/road.h"
+#include "../models/vegetation.h"
+#include "fire_behaviour.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// The time it takes the fires to reach every cell of a grid over the vegetation of a bbox.
+///
+/// Solved in one pass with Dijkstra's algorithm over the cells, which is the fast marching idea
+/// with the grid edges as the only directions. Moving to a neighbour takes the distance divided by
+/// the spread rate of the neighbour's vegetation and the wind factor of the direction, the same
+/// rates the spread simulation uses. Besides the 8 neighbours, the 8 cells a knight's move away
+/// are linked too, which brings the error of the grid directions from about 8% down to about 3%.
+typedef struct
+{
+    FireGrid grid;
+    /// The vegetation of each cell, row after row
+    uint8_t* fuel;
+    /// The seconds until the fire reaches each cell, row after row. INFINITY if it never does
+    float* time;
+} FireArrival;
+
+/// Set up a map over the vegetation of the bbox with cells of about `cell_size` metres, that no
+/// fire reaches until `fire_arrival_solve()` is called.
+/// The caller is responsible for freeing the map with `fire_arrival_free()`
+FireArrival fire_arrival_create(VegSlice vegetation, BoundBox bbox, double cell_size);
+
+/// Work out the arrival times from the fires inside the bbox, with a constant wind in metres per
+/// second (x towards the east and y towards the north). Every spread rate is multiplied by
+/// `rate_scale`. Can be called again with other fires or wind, replacing the previous times
+void fire_arrival_solve(FireArrival* arrival, FireSlice fires, Vec2 wind, double rate_scale);
+
+void fire_arrival_free(FireArrival* arrival);
+
+/// Check if a coordinate is inside the grid, so a fire there was used for the arrival times
+bool fire_arrival_covers(const FireArrival* arrival, GCoord coord);
+
+/// Get the seconds until the fire reaches a coordinate. INFINITY if it never does or the
+/// coordinate is outside the grid
+double fire_arrival_time(const FireArrival* arrival, GCoord coord);
+
+/// Get the seconds until the fire first reaches a road, by walking along the road in steps of half
+/// a cell. INFINITY if it never does or the road is outside the grid
+double fire_arrival_road_eta(const FireArrival* arrival, RoadSeg road);
+
+#endif // FIRE_ARRIVAL_H
@@ -0,0 +1,115 @@
+#include "fire_behaviour.h"
+
+#include <math.h>
+
+/// The wind coefficients c1 and c2 of Alexandridis et al., for wind speeds in metres per second
+#define WIND_C1 0.045
+#define WIND_C2 0.131
+
+FireGrid fire_grid_from_bbox(BoundBox bbox, double cell_size)
+{
+    const Projection proj = projection_from_bbox(bbox);
+    const MCoord corner1 = project_coord(bbox.c1, proj);
+    const MCoord corner2 = project_coord(bbox.c2, proj);
+    const double width = ceil(fabs(corner2.x - corner1.x) / cell_size);
+    const double height = ceil(fabs(corner2.y - corner1.y) / cell_size);
+
+    FireGrid grid = {
+        .width = (size_t)MIN(MAX(width, 2), FIRE_GRID_MAX_SIDE),
+        .height = (size_t)MIN(MAX(height, 2), FIRE_GRID_MAX_SIDE),
+        .bbox = bbox,
+    };
+
+    const MCoord localOrigin =
+        project_coord(local_to_global((LCoord){0, 0}, bbox, grid.height, grid.width), proj);
+    const MCoord localX =
+        project_coord(local_to_global((LCoord){1, 0}, bbox, grid.height, grid.width), proj);
+    const MCoord localY =
+        project_coord(local_to_global((LCoord){0, 1}, bbox, grid.height, grid.width), proj);
+    grid.step_x = (MCoord){.x = localX.x - localOrigin.x, .y = localX.y - localOrigin.y};
+    grid.step_y = (MCoord){.x = localY.x - localOrigin.x, .y = localY.y - localOrigin.y};
+    grid.origin = (MCoord){
+        .x = localOrigin.x + 0.5 * (grid.step_x.x + grid.step_y.x),
+        .y = localOrigin.y + 0.5 * (grid.step_x.y + grid.step_y.y),
+    };
+
+    return grid;
+}
+
+MCoord fire_grid_point(const FireGrid* grid, double x, double y)
+{
+    return (MCoord){
+        .x = grid->origin.x + x * grid->step_x.x + y * grid->step_y.x,
+        .y = grid->origin.y + x * grid->step_x.y + y * grid->step_y.y,
+    };
+}
+
+bool fire_grid_cell_of(const FireGrid* grid, GCoord coord, size_t* x, size_t* y)
+{
+    const LCoord local = global_to_local_exact(coord, grid->bbox, grid->height, grid->width);
+    if (local.x < 0 || local.y < 0 || local.x >= (double)grid->width ||
+        local.y >= (double)grid->height)
+        return false;
+
+    *x = (size_t)local.x;
+    *y = (size_t)local.y;
+    return true;
+}
+
+double fire_spread_rate(VegType veg_type)
+{
+    switch (veg_type)
+    {
+        case VEG_GRASS:
+            return 0.5;
+        case VEG_SHRUBLAND:
+            return 0.35;
+        case VEG_FARMLAND:
+            return 0.3;
+        case VEG_FOREST:
+            return 0.15;
+        case VEG_NONE: // No data, so something in between
+            return 0.05;
+        case VEG_WETLAND:
+            return 0.02;
+        case VEG_BUILDINGS:
+            return 0.01;
+        case VEG_ROCK:
+        case VEG_SAND:
+        case VEG_WATER:
+        default:
+            return 0;
+    }
+}
+
+double fire_burn_time(VegType veg_type)
+{
+    switch (veg_type)
+    {
+        case VEG_GRASS:
+            return 60;
+        case VEG_FARMLAND:
+            return 120;
+        case VEG_SHRUBLAND:
+        case VEG_WETLAND:
+            return 300;
+        case VEG_FOREST:
+            return 1200;
+        case VEG_BUILDINGS:
+            return 1800;
+        case VEG_NONE:
+        default:
+            return 120;
+    }
+}
+
+double fire_wind_factor(Vec2 wind, MCoord dir)
+{
+    const double windSpeed = sqrt(wind.x * wind.x + wind.y * wind.y);
+    if (windSpeed <= 0)
+        return 1;
+
+    const double cosAngle =
+        (wind.x * dir.x + wind.y * dir.y) / (windSpeed * sqrt(dir.x * dir.x + dir.y * dir.y));
+    return exp(windSpeed * (WIND_C1 + WIND_C2 * (cosAngle - 1)));
+}
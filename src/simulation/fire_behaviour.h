@@ -0,0 +1,52 @@
+#ifndef FIRE_BEHAVIOUR_H
+#define FIRE_BEHAVIOUR_H
+
+#include "../models/geo.h"
+#include "../models/vegetation.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// The amount of vegetation types, VegType runs from 0 up to this
+#define VEG_TYPE_COUNT (VEG_FOREST + 1)
+
+/// A grid of cells over a bbox, laid out like the local grid of a `VegGrid`: cell (x, y) covers
+/// the local coordinates from (x, y) up to (x + 1, y + 1).
+typedef struct
+{
+    size_t width;
+    size_t height;
+    BoundBox bbox;
+    /// The projected coordinate of the center of cell (0, 0), and the step to the next cell along
+    /// the x and y axis of the grid
+    MCoord origin;
+    MCoord step_x;
+    MCoord step_y;
+} FireGrid;
+
+/// The largest amount of cells a fire grid has along each side
+#define FIRE_GRID_MAX_SIDE 4000
+
+/// Get a grid over the bbox with cells of about `cell_size` metres, capped at FIRE_GRID_MAX_SIDE
+/// cells along each side
+FireGrid fire_grid_from_bbox(BoundBox bbox, double cell_size);
+
+/// Get the projected coordinate of a point of the grid, in cells from the center of cell (0, 0)
+MCoord fire_grid_point(const FireGrid* grid, double x, double y);
+
+/// Get the cell of a coordinate. Returns false if it is outside the grid
+bool fire_grid_cell_of(const FireGrid* grid, GCoord coord, size_t* x, size_t* y);
+
+/// How fast a fire moves through the vegetation without wind, in metres per second.
+/// 0 if it does not burn at all
+double fire_spread_rate(VegType veg_type);
+
+/// How long the vegetation burns in seconds
+double fire_burn_time(VegType veg_type);
+
+/// How much the wind (in metres per second, x towards the east and y towards the north) speeds up
+/// a fire moving in direction `dir` on the local plane. From Alexandridis et al., "A cellular
+/// automata model for forest fire spread prediction" (2008)
+double fire_wind_factor(Vec2 wind, MCoord dir);
+
+#endif // FIRE_BEHAVIOUR_H
@@ -0,0 +1,370 @@
+#include "fire_spread.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/// The fire radiative power in MW per square metre of burning cells, used for the road risk
+#define FRP_PER_M2 0.0003
+
+/// The offsets of the 8 neighbours of a cell
+static const int neighbourX[8] = {-1, 0, 1, -1, 1, -1, 0, 1};
+static const int neighbourY[8] = {-1, -1, -1, 0, 0, 1, 1, 1};
+
+FireSpread fire_spread_create(VegSlice vegetation, BoundBox bbox, double cell_size)
+{
+    FireSpread spread = {.grid = fire_grid_from_bbox(bbox, cell_size)};
+    const size_t width = spread.grid.width;
+    const size_t height = spread.grid.height;
+    const size_t cellCount = width * height;
+    const size_t paddedCount = (width + 2) * (height + 2);
+
+    VegGrid fuel = veg_grid_from_vegetation(vegetation, bbox, width, height);
+    spread.fuel = malloc(cellCount * sizeof(uint8_t));
+    for (size_t i = 0; i < cellCount; i++)
+        spread.fuel[i] = (uint8_t)fuel.cells[i];
+    veg_grid_free(&fuel);
+
+    spread.state = calloc(paddedCount, sizeof(uint8_t));
+    spread.next_state = calloc(paddedCount, sizeof(uint8_t));
+    spread.progress = calloc(cellCount, sizeof(float));
+    spread.burn_left = calloc(cellCount, sizeof(float));
+
+    spread.block_width = (width + FIRE_SPREAD_BLOCK - 1) / FIRE_SPREAD_BLOCK;
+    spread.block_height = (height + FIRE_SPREAD_BLOCK - 1) / FIRE_SPREAD_BLOCK;
+    spread.blocks = malloc(spread.block_width * spread.block_height * sizeof(FireSpreadBlock));
+    for (size_t i = 0; i < spread.block_width * spread.block_height; i++)
+        spread.blocks[i] = (FireSpreadBlock){.fire = SIZE_MAX};
+
+    return spread;
+}
+
+void fire_spread_free(FireSpread* spread)
+{
+    free(spread->fuel);
+    free(spread->state);
+    free(spread->next_state);
+    free(spread->progress);
+    free(spread->burn_left);
+    free(spread->blocks);
+    *spread = (FireSpread){0};
+}
+
+bool fire_spread_ignite(FireSpread* spread, GCoord coord)
+{
+    size_t x, y;
+    if (!fire_grid_cell_of(&spread->grid, coord, &x, &y))
+        return false;
+
+    const size_t cell = y * spread->grid.width + x;
+    const size_t paddedCell = (y + 1) * (spread->grid.width + 2) + x + 1;
+
+    if (spread->state[paddedCell] == FIRE_CELL_BURNING)
+        return true;
+    if (spread->state[paddedCell] == FIRE_CELL_BURNT || fire_spread_rate(spread->fuel[cell]) <= 0)
+        return false;
+
+    // Both buffers are set, so the cell does not count as changed
+    spread->state[paddedCell] = FIRE_CELL_BURNING;
+    spread->next_state[paddedCell] = FIRE_CELL_BURNING;
+    spread->burn_left[cell] = (float)fire_burn_time(spread->fuel[cell]);
+    spread->burning++;
+
+    if (spread->min_x >= spread->max_x || spread->min_y >= spread->max_y)
+    {
+        spread->min_x = x;
+        spread->min_y = y;
+        spread->max_x = x + 1;
+        spread->max_y = y + 1;
+    }
+    else
+    {
+        spread->min_x = MIN(spread->min_x, x);
+        spread->min_y = MIN(spread->min_y, y);
+        spread->max_x = MAX(spread->max_x, x + 1);
+        spread->max_y = MAX(spread->max_y, y + 1);
+    }
+
+    return true;
+}
+
+FireCellState fire_spread_cell(const FireSpread* spread, size_t x, size_t y)
+{
+    return spread->state[(y + 1) * (spread->grid.width + 2) + x + 1];
+}
+
+/// What a worker saw of the cells it stepped, merged after the step
+typedef struct
+{
+    size_t burning;
+    size_t min_x;
+    size_t min_y;
+    size_t max_x;
+    size_t max_y;
+    size_t changed_min_x;
+    size_t changed_min_y;
+    size_t changed_max_x;
+    size_t changed_max_y;
+} StepStats;
+
+typedef struct
+{
+    FireSpread* spread;
+    /// How far a cell gets towards igniting in one step, by vegetation and by the neighbour the
+    /// fire comes from
+    float rates[VEG_TYPE_COUNT][8];
+    float burnTimes[VEG_TYPE_COUNT];
+    float dt;
+    /// The columns that are stepped, the rows are handed out by the pool from min_y
+    size_t min_x;
+    size_t max_x;
+    size_t min_y;
+    StepStats* stats;
+} StepCtx;
+
+static void step_rows(void* ctx, size_t start, size_t end, size_t worker)
+{
+    StepCtx* c = ctx;
+    FireSpread* spread = c->spread;
+    StepStats* stats = &c->stats[worker];
+    const size_t paddedWidth = spread->grid.width + 2;
+
+    ptrdiff_t offsets[8];
+    for (size_t d = 0; d < 8; d++)
+        offsets[d] = neighbourY[d] * (ptrdiff_t)paddedWidth + neighbourX[d];
+
+    for (size_t y = c->min_y + start; y < c->min_y + end; y++)
+    {
+        const uint8_t* state = spread->state + (y + 1) * paddedWidth + 1;
+        uint8_t* next = spread->next_state + (y + 1) * paddedWidth + 1;
+        const uint8_t* fuel = spread->fuel + y * spread->grid.width;
+        float* progress = spread->progress + y * spread->grid.width;
+        float* burnLeft = spread->burn_left + y * spread->grid.width;
+
+        for (size_t x = c->min_x; x < c->max_x; x++)
+        {
+            uint8_t cellState = state[x];
+
+            if (cellState == FIRE_CELL_UNBURNT)
+            {
+                const float* rates = c->rates[fuel[x]];
+                if (rates[0] <= 0)
+                {
+                    next[x] = cellState;
+                    continue;
+                }
+
+                // The fire comes in from whichever burning neighbour brings it the fastest
+                float best = 0;
+                for (size_t d = 0; d < 8; d++)
+                {
+                    if (state[x + offsets[d]] == FIRE_CELL_BURNING)
+                        best = MAX(best, rates[d]);
+                }
+                if (best > 0)
+                {
+                    progress[x] += best;
+                    if (progress[x] >= 1)
+                    {
+                        cellState = FIRE_CELL_BURNING;
+                        burnLeft[x] = c->burnTimes[fuel[x]];
+                    }
+                }
+            }
+            else if (cellState == FIRE_CELL_BURNING)
+            {
+                burnLeft[x] -= c->dt;
+                if (burnLeft[x] <= 0)
+                    cellState = FIRE_CELL_BURNT;
+            }
+
+            if (cellState != state[x])
+            {
+                stats->changed_min_x = MIN(stats->changed_min_x, x);
+                stats->changed_min_y = MIN(stats->changed_min_y, y);
+                stats->changed_max_x = MAX(stats->changed_max_x, x + 1);
+                stats->changed_max_y = MAX(stats->changed_max_y, y + 1);
+            }
+            if (cellState == FIRE_CELL_BURNING)
+            {
+                stats->burning++;
+                stats->min_x = MIN(stats->min_x, x);
+                stats->min_y = MIN(stats->min_y, y);
+                stats->max_x = MAX(stats->max_x, x + 1);
+                stats->max_y = MAX(stats->max_y, y + 1);
+            }
+            next[x] = cellState;
+        }
+    }
+}
+
+size_t fire_spread_step(FireSpread* spread, Vec2 wind, double dt, ThreadPool* pool)
+{
+    StepCtx ctx = {.spread = spread, .dt = (float)dt};
+
+    // The rates only depend on the vegetation and the direction, so they are worked out once
+    for (size_t d = 0; d < 8; d++)
+    {
+        // The direction the fire moves in, from the neighbour to the cell
+        const MCoord dir = {
+            .x = -(neighbourX[d] * spread->grid.step_x.x + neighbourY[d] * spread->grid.step_y.x),
+            .y = -(neighbourX[d] * spread->grid.step_x.y + neighbourY[d] * spread->grid.step_y.y),
+        };
+        const double dst = sqrt(dir.x * dir.x + dir.y * dir.y);
+        const double windFactor = fire_wind_factor(wind, dir);
+
+        for (size_t t = 0; t < VEG_TYPE_COUNT; t++)
+            ctx.rates[t][d] = (float)(fire_spread_rate(t) * windFactor * dt / dst);
+    }
+    for (size_t t = 0; t < VEG_TYPE_COUNT; t++)
+        ctx.burnTimes[t] = (float)fire_burn_time(t);
+
+    // Visit the cells next to the fire, and the cells that changed last step so both buffers agree
+    // on them again
+    size_t minX = spread->changed_min_x;
+    size_t minY = spread->changed_min_y;
+    size_t maxX = spread->changed_max_x;
+    size_t maxY = spread->changed_max_y;
+    if (spread->min_x < spread->max_x && spread->min_y < spread->max_y)
+    {
+        const size_t fireMinX = spread->min_x > 0 ? spread->min_x - 1 : 0;
+        const size_t fireMinY = spread->min_y > 0 ? spread->min_y - 1 : 0;
+        const size_t fireMaxX = MIN(spread->max_x + 1, spread->grid.width);
+        const size_t fireMaxY = MIN(spread->max_y + 1, spread->grid.height);
+        if (minX < maxX && minY < maxY)
+        {
+            minX = MIN(minX, fireMinX);
+            minY = MIN(minY, fireMinY);
+            maxX = MAX(maxX, fireMaxX);
+            maxY = MAX(maxY, fireMaxY);
+        }
+        else
+        {
+            minX = fireMinX;
+            minY = fireMinY;
+            maxX = fireMaxX;
+            maxY = fireMaxY;
+        }
+    }
+
+    spread->time += dt;
+    if (minX >= maxX || minY >= maxY)
+        return 0;
+
+    const size_t workers = pool_thread_count(pool);
+    ctx.stats = malloc(workers * sizeof(StepStats));
+    for (size_t i = 0; i < workers; i++)
+    {
+        ctx.stats[i] = (StepStats){
+            .min_x = SIZE_MAX,
+            .min_y = SIZE_MAX,
+            .changed_min_x = SIZE_MAX,
+            .changed_min_y = SIZE_MAX,
+        };
+    }
+    ctx.min_x = minX;
+    ctx.max_x = maxX;
+    ctx.min_y = minY;
+
+    // Bands of rows, a few per thread so a band full of fire does not hold up the others
+    const size_t rows = maxY - minY;
+    pool_parallel_for(pool, rows, MAX(rows / (workers * 4), 1), step_rows, &ctx);
+
+    StepStats total = ctx.stats[0];
+    for (size_t i = 1; i < workers; i++)
+    {
+        total.burning += ctx.stats[i].burning;
+        total.min_x = MIN(total.min_x, ctx.stats[i].min_x);
+        total.min_y = MIN(total.min_y, ctx.stats[i].min_y);
+        total.max_x = MAX(total.max_x, ctx.stats[i].max_x);
+        total.max_y = MAX(total.max_y, ctx.stats[i].max_y);
+        total.changed_min_x = MIN(total.changed_min_x, ctx.stats[i].changed_min_x);
+        total.changed_min_y = MIN(total.changed_min_y, ctx.stats[i].changed_min_y);
+        total.changed_max_x = MAX(total.changed_max_x, ctx.stats[i].changed_max_x);
+        total.changed_max_y = MAX(total.changed_max_y, ctx.stats[i].changed_max_y);
+    }
+    free(ctx.stats);
+
+    spread->burning = total.burning;
+    spread->min_x = total.min_x;
+    spread->min_y = total.min_y;
+    spread->max_x = total.max_x;
+    spread->max_y = total.max_y;
+    spread->changed_min_x = total.changed_min_x;
+    spread->changed_min_y = total.changed_min_y;
+    spread->changed_max_x = total.changed_max_x;
+    spread->changed_max_y = total.changed_max_y;
+
+    uint8_t* tmp = spread->state;
+    spread->state = spread->next_state;
+    spread->next_state = tmp;
+
+    return spread->burning;
+}
+
+void fire_spread_sync_risk(FireSpread* spread, RiskState* risk)
+{
+    const Projection proj = projection_from_bbox(spread->grid.bbox);
+    const double cellArea = fabs(spread->grid.step_x.x * spread->grid.step_y.y -
+                                 spread->grid.step_x.y * spread->grid.step_y.x);
+
+    for (size_t by = 0; by < spread->block_height; by++)
+    {
+        for (size_t bx = 0; bx < spread->block_width; bx++)
+        {
+            FireSpreadBlock* block = &spread->blocks[by * spread->block_width + bx];
+            const size_t minX = bx * FIRE_SPREAD_BLOCK;
+            const size_t minY = by * FIRE_SPREAD_BLOCK;
+            const size_t maxX = MIN(minX + FIRE_SPREAD_BLOCK, spread->grid.width);
+            const size_t maxY = MIN(minY + FIRE_SPREAD_BLOCK, spread->grid.height);
+
+            // Blocks away from the fire have nothing burning, and only need their fire removed
+            uint32_t burning = 0;
+            double sumX = 0;
+            double sumY = 0;
+            if (minX < spread->max_x && spread->min_x < maxX && minY < spread->max_y &&
+                spread->min_y < maxY)
+            {
+                for (size_t y = minY; y < maxY; y++)
+                {
+                    for (size_t x = minX; x < maxX; x++)
+                    {
+                        if (fire_spread_cell(spread, x, y) != FIRE_CELL_BURNING)
+                            continue;
+
+                        burning++;
+                        sumX += (double)x;
+                        sumY += (double)y;
+                    }
+                }
+            }
+
+            if (burning == 0)
+            {
+                if (block->burning > 0)
+                    risk_remove_fire(risk, block->fire);
+                block->burning = 0;
+                continue;
+            }
+
+            const MCoord center = fire_grid_point(&spread->grid, sumX / burning, sumY / burning);
+            if (burning == block->burning && center.x == block->center.x &&
+                center.y == block->center.y)
+                continue;
+
+            const FireArea fire = {
+                .gcoord = unproject_coord(center, proj),
+                .mcoord = center,
+                .frp = burning * cellArea * FRP_PER_M2,
+                .category = "SIM",
+            };
+            if (block->fire == SIZE_MAX)
+                block->fire = risk_add_fire(risk, fire);
+            else
+                risk_update_fire(risk, block->fire, fire);
+
+            block->burning = burning;
+            block->center = center;
+        }
+    }
+}
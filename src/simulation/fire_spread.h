@@ -0,0 +1,108 @@
+#ifndef FIRE_SPREAD_H
+#define FIRE_SPREAD_H
+
+#include "../models/fire.h"
+#include "../models/geo.h"
+#include "../models/vegetation.h"
+#include "../risk/risk.h"
+#include "../threading/pool.h"
+#include "fire_behaviour.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// The side in cells of the square blocks that burning cells are grouped into for road risk
+#define FIRE_SPREAD_BLOCK 16
+
+typedef enum
+{
+    FIRE_CELL_UNBURNT,
+    FIRE_CELL_BURNING,
+    FIRE_CELL_BURNT,
+} FireCellState;
+
+/// The cells of a block that are burning, as a single fire for the road risk
+typedef struct
+{
+    /// The id of the fire in the `RiskState`, or SIZE_MAX if the block has not had one yet
+    size_t fire;
+    /// The amount of burning cells when the fire was last updated
+    uint32_t burning;
+    /// The average projected coordinate of those cells
+    MCoord center;
+} FireSpreadBlock;
+
+/// A cellular automaton of fire spreading over the vegetation of a bbox.
+///
+/// Every cell of the grid is unburnt, burning or burnt. Each step, an unburnt cell next to burning
+/// cells moves towards igniting by the distance the fire covers in the cell's vegetation during the
+/// step, scaled by how much the wind blows from the burning neighbour towards it. A burning cell
+/// burns out after a time that depends on its vegetation. See `fire_behaviour.h` for the rates.
+///
+/// Each step reads the states of one buffer and writes the next states to the other, so the rows
+/// can be split between threads. Only the rows and columns around burning cells are visited.
+typedef struct
+{
+    FireGrid grid;
+    /// The vegetation of each cell, row after row
+    uint8_t* fuel;
+    /// The current and next state of each cell. Both have a border of one unburnt cell with no
+    /// fuel on every side, so the neighbours of a cell can be read without bounds checks
+    uint8_t* state;
+    uint8_t* next_state;
+    /// How far each unburnt cell is towards igniting, from 0 to 1
+    float* progress;
+    /// The seconds left until each burning cell burns out
+    float* burn_left;
+    /// The box around the burning cells, from min up to (but not including) max. Empty if min is
+    /// not below max
+    size_t min_x;
+    size_t min_y;
+    size_t max_x;
+    size_t max_y;
+    /// The box around the cells whose state changed in the last step. These differ between the two
+    /// buffers, so the next step has to visit them to bring them in line
+    size_t changed_min_x;
+    size_t changed_min_y;
+    size_t changed_max_x;
+    size_t changed_max_y;
+    /// The amount of burning cells
+    size_t burning;
+    /// The simulated seconds so far
+    double time;
+
+    /// The blocks of cells, row after row
+    FireSpreadBlock* blocks;
+    size_t block_width;
+    size_t block_height;
+} FireSpread;
+
+/// Set up a simulation over the bbox with cells of about `cell_size` metres, with nothing burning.
+/// The grid is capped at FIRE_GRID_MAX_SIDE cells along each side.
+/// The caller is responsible for freeing the simulation with `fire_spread_free()`
+FireSpread fire_spread_create(VegSlice vegetation, BoundBox bbox, double cell_size);
+
+void fire_spread_free(FireSpread* spread);
+
+/// Set the cell of a coordinate on fire, if it is inside the bbox and has something to burn.
+/// Returns whether the cell is burning afterwards
+bool fire_spread_ignite(FireSpread* spread, GCoord coord);
+
+/// Advance the simulation by `dt` seconds with the given wind in metres per second (x towards the
+/// east and y towards the north), and get the amount of burning cells.
+///
+/// The fire moves at most one cell per step, so `dt` should be small enough that the fastest
+/// spread rate covers less than a cell in it.
+size_t fire_spread_step(FireSpread* spread, Vec2 wind, double dt, ThreadPool* pool);
+
+/// Get the state of a cell
+FireCellState fire_spread_cell(const FireSpread* spread, size_t x, size_t y);
+
+/// Bring the fires of the risk state in line with the simulation. Every block of cells with burning
+/// cells is one fire at the center of those cells, with an intensity that grows with their count.
+/// Only the blocks that changed since the last call are updated, so `risk_rescore()` afterwards
+/// only recomputes the roads near the moving parts of the fire.
+void fire_spread_sync_risk(FireSpread* spread, RiskState* risk);
+
+#endif // FIRE_SPREAD_H
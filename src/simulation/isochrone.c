@@ -0,0 +1,331 @@
+#include "isochrone.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+const double ISOCHRONE_DEFAULT_TIMES[ISOCHRONE_DEFAULT_COUNT] = {15 * 60, 30 * 60, 60 * 60};
+
+/// The key of a place a line crosses the side of a square at, see `side_key()`
+typedef uint64_t SideKey;
+
+#define NO_SIDE UINT64_MAX
+
+/// A piece of line through one square, from the side where the inside is on its right when
+/// walking around the square clockwise, to the side where it comes back in
+typedef struct
+{
+    SideKey from;
+    SideKey to;
+} Piece;
+
+typedef VecDef(Piece) PieceVec;
+
+typedef struct
+{
+    const FireArrival* arrival;
+    const double* times;
+    size_t timeCount;
+    /// The pieces of each tile
+    PieceVec* tiles;
+} TraceCtx;
+
+/// The side between the centers of cell (x, y) and the cell to the right of it, or below it if
+/// `vertical`, at an arrival time. Every side of the grid has a number of its own for every time
+static SideKey side_key(const FireGrid* grid, size_t level, size_t x, size_t y, bool vertical)
+{
+    const SideKey sideCount = 2 * (SideKey)grid->width * grid->height;
+    return level * sideCount + 2 * ((SideKey)y * grid->width + x) + vertical;
+}
+
+/// Trace the squares of a few tiles, for every arrival time
+static void trace_tiles(void* ctx, size_t start, size_t end, size_t worker)
+{
+    (void)worker;
+    const TraceCtx* c = ctx;
+    const FireGrid* grid = &c->arrival->grid;
+    const float* time = c->arrival->time;
+    const size_t width = grid->width;
+
+    for (size_t tile = start; tile < end; tile++)
+    {
+        PieceVec* pieces = &c->tiles[tile];
+        const size_t endY = MIN((tile + 1) * ISOCHRONE_TILE_ROWS, grid->height - 1);
+        for (size_t y = tile * ISOCHRONE_TILE_ROWS; y < endY; y++)
+        {
+            for (size_t x = 0; x + 1 < width; x++)
+            {
+                // The corners clockwise from the top left, as the grid is drawn
+                const float corners[4] = {
+                    time[y * width + x],
+                    time[y * width + x + 1],
+                    time[(y + 1) * width + x + 1],
+                    time[(y + 1) * width + x],
+                };
+                const float low = MIN(MIN(corners[0], corners[1]), MIN(corners[2], corners[3]));
+                const float high = MAX(MAX(corners[0], corners[1]), MAX(corners[2], corners[3]));
+
+                for (size_t level = 0; level < c->timeCount; level++)
+                {
+                    // Most squares are all inside or all outside of a line
+                    const double limit = c->times[level];
+                    if (low >= limit || high < limit)
+                        continue;
+
+                    const SideKey sides[4] = {
+                        side_key(grid, 0, x, y, false),
+                        side_key(grid, 0, x + 1, y, true),
+                        side_key(grid, 0, x, y + 1, false),
+                        side_key(grid, 0, x, y, true),
+                    };
+                    bool inside[4];
+                    for (size_t i = 0; i < 4; i++)
+                        inside[i] = corners[i] < limit;
+
+                    // The sides the line crosses clockwise around the square, and whether the
+                    // walk goes from the inside to the outside over them
+                    const SideKey levelOffset = side_key(grid, level, 0, 0, false);
+                    SideKey crossed[4];
+                    bool leaving[4];
+                    size_t crossedCount = 0;
+                    for (size_t i = 0; i < 4; i++)
+                    {
+                        if (inside[i] == inside[(i + 1) % 4])
+                            continue;
+
+                        crossed[crossedCount] = sides[i] + levelOffset;
+                        leaving[crossedCount] = inside[i];
+                        crossedCount++;
+                    }
+
+                    // With two opposite corners inside, the average of the corners picks
+                    // whether the middle joins the inside corners or the outside ones
+                    const double middle = ((double)corners[0] + corners[1] + corners[2] +
+                                           corners[3]) / 4;
+                    const bool middleInside = middle < limit;
+                    for (size_t i = 0; i < crossedCount; i++)
+                    {
+                        if (!leaving[i])
+                            continue;
+
+                        const size_t back = middleInside ? (i + 1) % crossedCount
+                                                         : (i + crossedCount - 1) % crossedCount;
+                        vec_push(pieces, ((Piece){.from = crossed[i], .to = crossed[back]}));
+                    }
+                }
+            }
+        }
+    }
+}
+
+/// Get where a line crosses a side, in cells from the center of cell (0, 0)
+static LCoord side_point(const FireArrival* arrival, const double* times, SideKey key)
+{
+    const FireGrid* grid = &arrival->grid;
+    const SideKey sideCount = 2 * (SideKey)grid->width * grid->height;
+    const double limit = times[key / sideCount];
+    const SideKey side = key % sideCount;
+    const bool vertical = side & 1;
+    const size_t cell = side / 2;
+    const size_t x = cell % grid->width;
+    const size_t y = cell / grid->width;
+
+    const double a = arrival->time[cell];
+    const double b = arrival->time[vertical ? cell + grid->width : cell + 1];
+    // The fire never reaches one of the cells, so there is no time to go by
+    double along = 0.5;
+    if (!isinf(a) && !isinf(b) && a != b)
+        along = MIN(MAX((limit - a) / (b - a), 0), 1);
+
+    return (LCoord){
+        .x = (double)x + (vertical ? 0 : along),
+        .y = (double)y + (vertical ? along : 0),
+    };
+}
+
+/// The distance from a point to the line through `a` and `b`, or to `a` if they are the same
+static double line_dst(LCoord p, LCoord a, LCoord b)
+{
+    const double dx = b.x - a.x;
+    const double dy = b.y - a.y;
+    const double length = sqrt(dx * dx + dy * dy);
+    if (length == 0)
+        return sqrt((p.x - a.x) * (p.x - a.x) + (p.y - a.y) * (p.y - a.y));
+    return fabs(dx * (a.y - p.y) - dy * (a.x - p.x)) / length;
+}
+
+typedef struct
+{
+    size_t start;
+    size_t end;
+} Span;
+
+typedef VecDef(Span) SpanVec;
+
+/// Mark the points of a line that Douglas-Peucker keeps. The ends are always kept
+static void simplify(const LPoly* line, double tolerance, bool* keep, SpanVec* stack)
+{
+    for (size_t i = 0; i < line->len; i++)
+        keep[i] = false;
+    keep[0] = keep[line->len - 1] = true;
+
+    vec_empty(stack);
+    vec_push(stack, ((Span){.start = 0, .end = line->len - 1}));
+    while (stack->len > 0)
+    {
+        const Span span = stack->items[--stack->len];
+        size_t farthest = span.start;
+        double farthestDst = tolerance;
+        for (size_t i = span.start + 1; i < span.end; i++)
+        {
+            const double dst =
+                line_dst(line->items[i], line->items[span.start], line->items[span.end]);
+            if (dst > farthestDst)
+            {
+                farthest = i;
+                farthestDst = dst;
+            }
+        }
+        if (farthest == span.start)
+            continue;
+
+        keep[farthest] = true;
+        vec_push(stack, ((Span){.start = span.start, .end = farthest}));
+        vec_push(stack, ((Span){.start = farthest, .end = span.end}));
+    }
+}
+
+/// Look up the piece that starts at a side, or SIZE_MAX if no piece does
+static size_t find_piece(const SideKey* keys, const size_t* pieces, size_t capacity, SideKey key)
+{
+    size_t slot = (size_t)((key * 0x9e3779b97f4a7c15ULL) >> 20) & (capacity - 1);
+    while (keys[slot] != NO_SIDE)
+    {
+        if (keys[slot] == key)
+            return pieces[slot];
+        slot = (slot + 1) & (capacity - 1);
+    }
+    return SIZE_MAX;
+}
+
+IsochroneVec isochrones_extract(const FireArrival* arrival, const double* times,
+                                size_t time_count, double tolerance, ThreadPool* pool)
+{
+    const FireGrid* grid = &arrival->grid;
+    const size_t tileCount = (grid->height - 1 + ISOCHRONE_TILE_ROWS - 1) / ISOCHRONE_TILE_ROWS;
+    TraceCtx ctx = {
+        .arrival = arrival,
+        .times = times,
+        .timeCount = time_count,
+        .tiles = calloc(MAX(tileCount, 1), sizeof(PieceVec)),
+    };
+    pool_parallel_for(pool, tileCount, 1, trace_tiles, &ctx);
+
+    // All pieces in one list, and a table from the side each one starts at to it. Every side is
+    // left over by one piece at most, as the square on the other side of it enters over it
+    size_t pieceCount = 0;
+    for (size_t t = 0; t < tileCount; t++)
+        pieceCount += ctx.tiles[t].len;
+    Piece* pieces = malloc(MAX(pieceCount, 1) * sizeof(Piece));
+    pieceCount = 0;
+    for (size_t t = 0; t < tileCount; t++)
+    {
+        memcpy(pieces + pieceCount, ctx.tiles[t].items, ctx.tiles[t].len * sizeof(Piece));
+        pieceCount += ctx.tiles[t].len;
+        vec_free(ctx.tiles[t]);
+    }
+    free(ctx.tiles);
+
+    size_t capacity = 16;
+    while (capacity < pieceCount * 2)
+        capacity *= 2;
+    SideKey* keys = malloc(capacity * sizeof(SideKey));
+    size_t* slots = malloc(capacity * sizeof(size_t));
+    for (size_t i = 0; i < capacity; i++)
+        keys[i] = NO_SIDE;
+    for (size_t p = 0; p < pieceCount; p++)
+    {
+        size_t slot = (size_t)((pieces[p].from * 0x9e3779b97f4a7c15ULL) >> 20) & (capacity - 1);
+        while (keys[slot] != NO_SIDE)
+            slot = (slot + 1) & (capacity - 1);
+        keys[slot] = pieces[p].from;
+        slots[slot] = p;
+    }
+
+    size_t* next = malloc(MAX(pieceCount, 1) * sizeof(size_t));
+    bool* hasPrevious = calloc(MAX(pieceCount, 1), sizeof(bool));
+    bool* used = calloc(MAX(pieceCount, 1), sizeof(bool));
+    for (size_t p = 0; p < pieceCount; p++)
+    {
+        next[p] = find_piece(keys, slots, capacity, pieces[p].to);
+        if (next[p] != SIZE_MAX)
+            hasPrevious[next[p]] = true;
+    }
+    free(keys);
+    free(slots);
+
+    // The lines that run into the edge of the grid start at a piece nothing leads to. The rest
+    // are loops, which are walked once all of the open lines are done
+    const Projection proj = projection_from_bbox(grid->bbox);
+    const bool mirrored = grid->step_x.x * grid->step_y.y - grid->step_x.y * grid->step_y.x > 0;
+    const SideKey sideCount = 2 * (SideKey)grid->width * grid->height;
+    IsochroneVec lines = {0};
+    LPoly traced = {0};
+    VecDef(bool) keep = {0};
+    SpanVec stack = {0};
+    for (size_t pass = 0; pass < 2; pass++)
+    {
+        for (size_t first = 0; first < pieceCount; first++)
+        {
+            if (used[first] || (pass == 0 && hasPrevious[first]))
+                continue;
+
+            vec_empty(&traced);
+            vec_push(&traced, side_point(arrival, times, pieces[first].from));
+            size_t p = first;
+            while (p != SIZE_MAX && !used[p])
+            {
+                used[p] = true;
+                vec_push(&traced, side_point(arrival, times, pieces[p].to));
+                p = next[p];
+            }
+
+            while (keep.len < traced.len)
+            {
+                vec_push(&keep, false);
+            }
+            simplify(&traced, tolerance, keep.items, &stack);
+
+            const size_t level = (size_t)(pieces[first].from / sideCount);
+            Isochrone line = {.level = level, .time = times[level], .closed = pass == 1};
+            for (size_t i = 0; i < traced.len; i++)
+            {
+                // Keep the fire on the right of the line on the map, not just on the grid
+                const size_t idx = mirrored ? traced.len - 1 - i : i;
+                if (!keep.items[idx])
+                    continue;
+
+                const MCoord point =
+                    fire_grid_point(grid, traced.items[idx].x, traced.items[idx].y);
+                vec_push(&line.points, unproject_coord(point, proj));
+            }
+            vec_push(&lines, line);
+        }
+    }
+
+    vec_free(traced);
+    vec_free(keep);
+    vec_free(stack);
+    free(pieces);
+    free(next);
+    free(hasPrevious);
+    free(used);
+    return lines;
+}
+
+void isochrones_free(IsochroneVec* lines)
+{
+    for (size_t i = 0; i < lines->len; i++)
+        vec_free(lines->items[i].points);
+    vec_free(*lines);
+}
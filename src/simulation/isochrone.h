@@ -0,0 +1,52 @@
+#ifndef ISOCHRONE_H
+#define ISOCHRONE_H
+
+#include "../dyn.h"
+#include "../models/geo.h"
+#include "../threading/pool.h"
+#include "fire_arrival.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// The amount of rows of grid squares in each tile the contours are traced in
+#define ISOCHRONE_TILE_ROWS 64
+/// How far in cells a simplified line may stray from the traced one
+#define ISOCHRONE_TOLERANCE 0.5
+/// How many arrival times `ISOCHRONE_DEFAULT_TIMES` has
+#define ISOCHRONE_DEFAULT_COUNT 3
+
+/// The arrival times the console and batch mode draw lines at: in 15, 30 and 60 minutes
+extern const double ISOCHRONE_DEFAULT_TIMES[ISOCHRONE_DEFAULT_COUNT];
+
+typedef VecDef(GCoord) GCoordVec;
+
+/// A line that the fire reaches at the same time all along
+typedef struct
+{
+    /// The index of the arrival time in the list the lines were traced for, and the time in seconds
+    size_t level;
+    double time;
+    /// The points along the line. The fire reaches the right side of it first, looking along the
+    /// line with north up. A closed line ends on the point it starts on
+    GCoordVec points;
+    bool closed;
+} Isochrone;
+
+typedef VecDef(Isochrone) IsochroneVec;
+
+/// Trace the lines the fire reaches at each of the given times, and simplify them to within
+/// `tolerance` cells. The lines of a time fence off the cells the fire reaches before it.
+/// The caller is responsible for freeing the lines with `isochrones_free()`
+///
+/// Uses marching squares over the squares between the centers of four cells, placing the points
+/// by linear interpolation along the sides. The squares are traced in tiles of rows on the pool,
+/// and the pieces are then joined in time linear in their count. The lines are simplified with
+/// Douglas-Peucker.
+/// https://en.wikipedia.org/wiki/Marching_squares
+IsochroneVec isochrones_extract(const FireArrival* arrival, const double* times,
+                                size_t time_count, double tolerance, ThreadPool* pool);
+
+void isochrones_free(IsochroneVec* lines);
+
+#endif // ISOCHRONE_H
@@ -0,0 +1,491 @@
+#include "traffic.h"
+
+#include "../dyn.h"
+#include "../routing/route.h"
+#include "../spatial/rtree.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+#define NO_CELL UINT32_MAX
+
+/// The cars per hour each class of road lets through in one direction
+static const double classCapacity[] = {
+    [ROAD_CLASS_OTHER] = 900,       [ROAD_CLASS_MOTORWAY] = 4000,  [ROAD_CLASS_TRUNK] = 3000,
+    [ROAD_CLASS_PRIMARY] = 1800,    [ROAD_CLASS_SECONDARY] = 1500, [ROAD_CLASS_TERTIARY] = 1200,
+    [ROAD_CLASS_RESIDENTIAL] = 900, [ROAD_CLASS_SERVICE] = 600,    [ROAD_CLASS_PATH] = 300,
+};
+
+/// The lanes each class of road has in one direction
+static const double classLanes[] = {
+    [ROAD_CLASS_OTHER] = 1,       [ROAD_CLASS_MOTORWAY] = 2,  [ROAD_CLASS_TRUNK] = 2,
+    [ROAD_CLASS_PRIMARY] = 1,     [ROAD_CLASS_SECONDARY] = 1, [ROAD_CLASS_TERTIARY] = 1,
+    [ROAD_CLASS_RESIDENTIAL] = 1, [ROAD_CLASS_SERVICE] = 1,   [ROAD_CLASS_PATH] = 1,
+};
+
+typedef VecDef(double) DoubleVec;
+
+/// The last cell of a stretch of road, and the vertex the stretch ends at
+typedef struct
+{
+    uint32_t cell;
+    uint32_t vertex;
+} StretchEnd;
+
+typedef VecDef(StretchEnd) StretchEndVec;
+
+/// Whether a car driving out of a vertex keeps going on the same stretch of road at the vertex it
+/// gets to: the road goes on, and no other road joins it there
+static bool stretch_continues(const TrafficSim* sim, const uint32_t* children, size_t vertex)
+{
+    const RoadGraph* graph = sim->graph;
+    const size_t target = graph->targets[sim->next[vertex]];
+    return children[target] == 1 && sim->next[target] != SIZE_MAX &&
+           graph->roads[sim->next[target]] == graph->roads[sim->next[vertex]];
+}
+
+/// Whether a stretch of road starts at a vertex, as the one vertex driving out through it (if
+/// there is one) does not continue on the same stretch
+static bool stretch_starts(const TrafficSim* sim, const uint32_t* children, size_t vertex)
+{
+    const RoadGraph* graph = sim->graph;
+    if (children[vertex] != 1)
+        return true;
+
+    for (size_t e = graph->offsets[vertex]; e < graph->offsets[vertex + 1]; e++)
+    {
+        const uint32_t from = graph->targets[e];
+        if (sim->next[from] == graph->twins[e])
+            return !stretch_continues(sim, children, from);
+    }
+    return true;
+}
+
+/// Cut the roads of the way out of every vertex into cells, and link every cell to the one it
+/// drives into and the ones that drive into it
+static void build_cells(TrafficSim* sim, RoadSegSlice roads)
+{
+    const RoadGraph* graph = sim->graph;
+    const size_t vertexCount = graph->vertex_count;
+
+    uint32_t* children = calloc(MAX(vertexCount, 1), sizeof(uint32_t));
+    for (size_t v = 0; v < vertexCount; v++)
+    {
+        sim->vertex_cell[v] = NO_CELL;
+        if (sim->next[v] != SIZE_MAX)
+            children[graph->targets[sim->next[v]]]++;
+    }
+
+    // Every edge of the tree is on one stretch of a road that nothing joins halfway. The stretches
+    // are cut into cells that take at least a step to drive through, or into one cell if the whole
+    // stretch takes less
+    DoubleVec freeTimes = {0};
+    DoubleVec capacities = {0};
+    DoubleVec jams = {0};
+    DoubleVec sendShares = {0};
+    DoubleVec receiveShares = {0};
+    VecDef(uint32_t) downs = {0};
+    StretchEndVec ends = {0};
+    for (size_t start = 0; start < vertexCount; start++)
+    {
+        if (sim->next[start] == SIZE_MAX || !stretch_starts(sim, children, start))
+            continue;
+
+        double length = 0;
+        double time = 0;
+        size_t end = start;
+        bool more = true;
+        while (more)
+        {
+            length += graph->lengths[sim->next[end]];
+            time += graph->times[sim->next[end]];
+            more = stretch_continues(sim, children, end);
+            end = graph->targets[sim->next[end]];
+        }
+
+        const RoadClass roadClass = roads.items[graph->roads[sim->next[start]]].road_class;
+        const size_t count = MAX((size_t)(time / sim->step), 1);
+        const size_t first = freeTimes.len;
+        assert(first + count < NO_CELL);
+
+        const double cellLength = length / (double)count;
+        const double cellTime = time / (double)count;
+        const double flow = classCapacity[roadClass] / 3600;
+        const double capacity = flow * sim->step;
+        // Short cells still hold a couple of steps of cars, so they hold back no more than the
+        // road does
+        const double jam = MAX(TRAFFIC_JAM_DENSITY * classLanes[roadClass] * cellLength,
+                               2 * capacity);
+        // The speed a jam moves back up the road at, from the triangle between the free speed, the
+        // capacity and the jam density
+        const double speed = time > 0 ? length / time : 0;
+        const double jamDensity = TRAFFIC_JAM_DENSITY * classLanes[roadClass];
+        double wave = speed;
+        if (speed > 0 && jamDensity > flow / speed)
+            wave = MIN(flow / (jamDensity - flow / speed), speed);
+
+        for (size_t c = 0; c < count; c++)
+        {
+            vec_push(&freeTimes, cellTime);
+            vec_push(&capacities, capacity);
+            vec_push(&jams, jam);
+            vec_push(&sendShares, cellTime > sim->step ? sim->step / cellTime : 1);
+            vec_push(&receiveShares,
+                     cellLength > wave * sim->step ? wave * sim->step / cellLength : 1);
+            vec_push(&downs, (uint32_t)(first + c + 1));
+        }
+        vec_push(&ends, ((StretchEnd){.cell = first + count - 1, .vertex = end}));
+
+        // The cars of a vertex get on in the cell it is in
+        double along = 0;
+        for (size_t v = start; v != end; v = graph->targets[sim->next[v]])
+        {
+            const size_t c = time > 0 ? (size_t)(along / time * (double)count) : 0;
+            sim->vertex_cell[v] = (uint32_t)(first + MIN(c, count - 1));
+            along += graph->times[sim->next[v]];
+        }
+    }
+    free(children);
+
+    // The vertex a stretch ends at starts a stretch of its own, unless it is an exit
+    for (size_t i = 0; i < ends.len; i++)
+        downs.items[ends.items[i].cell] = sim->vertex_cell[ends.items[i].vertex];
+    vec_free(ends);
+
+    const size_t cellCount = freeTimes.len;
+    sim->cell_count = cellCount;
+    sim->free_time = freeTimes.items;
+    sim->capacity = capacities.items;
+    sim->jam = jams.items;
+    sim->send_share = sendShares.items;
+    sim->receive_share = receiveShares.items;
+    sim->down = downs.items;
+
+    sim->up_offsets = calloc(cellCount + 1, sizeof(size_t));
+    sim->up_cells = malloc(MAX(cellCount, 1) * sizeof(uint32_t));
+    for (size_t c = 0; c < cellCount; c++)
+    {
+        if (sim->down[c] != NO_CELL)
+            sim->up_offsets[sim->down[c] + 1]++;
+    }
+    for (size_t c = 0; c < cellCount; c++)
+        sim->up_offsets[c + 1] += sim->up_offsets[c];
+    size_t* fill = malloc(MAX(cellCount, 1) * sizeof(size_t));
+    memcpy(fill, sim->up_offsets, MAX(cellCount, 1) * sizeof(size_t));
+    for (size_t c = 0; c < cellCount; c++)
+    {
+        if (sim->down[c] != NO_CELL)
+            sim->up_cells[fill[sim->down[c]]++] = (uint32_t)c;
+    }
+    free(fill);
+}
+
+/// Whether a projected point is inside a ring, by the even-odd rule
+static bool ring_contains(const MCoord* ring, size_t len, MCoord p)
+{
+    bool inside = false;
+    for (size_t i = 0, j = len - 1; i < len; j = i++)
+    {
+        if ((ring[i].y > p.y) != (ring[j].y > p.y) &&
+            p.x < (ring[j].x - ring[i].x) * (p.y - ring[i].y) / (ring[j].y - ring[i].y) + ring[i].x)
+            inside = !inside;
+    }
+    return inside;
+}
+
+/// Seed the cars of every built up area, split evenly over the vertices in it that have a way
+/// out, or put on the vertex nearest to its middle if it has none
+static void seed_demand(TrafficSim* sim, RoadSegSlice roads, VegSlice vegetation, BoundBox bbox)
+{
+    const RoadGraph* graph = sim->graph;
+    const Projection proj = projection_from_bbox(bbox);
+    RTree tree = rtree_from_roads(roads);
+    RTreeSegVec found = {0};
+    VecDef(MCoord) ring = {0};
+    VecDef(uint32_t) starts = {0};
+    uint32_t* seen = calloc(MAX(graph->vertex_count, 1), sizeof(uint32_t));
+    uint32_t stamp = 0;
+
+    for (size_t i = 0; i < vegetation.len; i++)
+    {
+        const GPoly area = vegetation.items[i].area;
+        if (vegetation.items[i].type != VEG_BUILDINGS || area.len < 3)
+            continue;
+
+        vec_empty(&ring);
+        MRect bounds = {INFINITY, INFINITY, -INFINITY, -INFINITY};
+        MCoord middle = {0};
+        for (size_t p = 0; p < area.len; p++)
+        {
+            const MCoord point = project_coord(gcoord_load(area.items[p]), proj);
+            vec_push(&ring, point);
+            bounds.min_x = MIN(bounds.min_x, point.x);
+            bounds.min_y = MIN(bounds.min_y, point.y);
+            bounds.max_x = MAX(bounds.max_x, point.x);
+            bounds.max_y = MAX(bounds.max_y, point.y);
+            middle.x += point.x / (double)area.len;
+            middle.y += point.y / (double)area.len;
+        }
+
+        double size = 0;
+        for (size_t p = 0, q = ring.len - 1; p < ring.len; q = p++)
+            size += ring.items[q].x * ring.items[p].y - ring.items[p].x * ring.items[q].y;
+        const double vehicles = fabs(size) / 2 * TRAFFIC_VEHICLES_PER_M2;
+        if (vehicles <= 0)
+            continue;
+
+        // The vertices of the segments that cross the bounds, checked once each
+        stamp++;
+        vec_empty(&starts);
+        vec_empty(&found);
+        rtree_query_rect(&tree, bounds, &found);
+        for (size_t f = 0; f < found.len; f++)
+        {
+            const size_t node = graph->road_nodes[found.items[f].road] + found.items[f].seg;
+            for (size_t n = node; n <= node + 1; n++)
+            {
+                const uint32_t vertex = graph->node_vertex[n];
+                if (seen[vertex] == stamp)
+                    continue;
+
+                seen[vertex] = stamp;
+                if (sim->vertex_cell[vertex] != NO_CELL &&
+                    ring_contains(ring.items, ring.len, graph->coords[vertex]))
+                {
+                    vec_push(&starts, vertex);
+                }
+            }
+        }
+
+        if (starts.len == 0)
+        {
+            vec_empty(&found);
+            rtree_nearest(&tree, middle, 1, &found);
+            if (found.len == 0)
+                continue;
+
+            const size_t node = graph->road_nodes[found.items[0].road] + found.items[0].seg;
+            const uint32_t a = graph->node_vertex[node];
+            const uint32_t b = graph->node_vertex[node + 1];
+            const uint32_t nearest =
+                mcoord_dst(graph->coords[a], middle) <= mcoord_dst(graph->coords[b], middle) ? a
+                                                                                            : b;
+            // Areas by an exit are out already
+            if (graph->is_exit[nearest])
+                continue;
+            if (sim->vertex_cell[nearest] != NO_CELL)
+            {
+                vec_push(&starts, nearest);
+            }
+        }
+
+        if (starts.len == 0)
+        {
+            sim->stranded += vehicles;
+            continue;
+        }
+
+        sim->demand += vehicles;
+        for (size_t s = 0; s < starts.len; s++)
+        {
+            const uint32_t cell = sim->vertex_cell[starts.items[s]];
+            sim->release[cell] += vehicles / (double)starts.len / TRAFFIC_LOADING_TIME;
+        }
+    }
+
+    free(seen);
+    vec_free(starts);
+    vec_free(ring);
+    vec_free(found);
+    rtree_free(&tree);
+}
+
+TrafficSim traffic_create(const RoadGraph* graph, RoadSegSlice roads, VegSlice vegetation,
+                          BoundBox bbox)
+{
+    const size_t vertexCount = MAX(graph->vertex_count, 1);
+    TrafficSim sim = {
+        .graph = graph,
+        .free_times = malloc(vertexCount * sizeof(double)),
+        .next = malloc(vertexCount * sizeof(size_t)),
+        .vertex_cell = malloc(vertexCount * sizeof(uint32_t)),
+        .step = TRAFFIC_STEP,
+    };
+    route_time_to_safety(graph, sim.free_times, sim.next);
+    build_cells(&sim, roads);
+
+    const size_t cellCount = MAX(sim.cell_count, 1);
+    sim.vehicles = calloc(cellCount, sizeof(double));
+    sim.waiting = calloc(cellCount, sizeof(double));
+    sim.release = calloc(cellCount, sizeof(double));
+    sim.vehicle_time = calloc(cellCount, sizeof(double));
+    sim.wait_time = calloc(cellCount, sizeof(double));
+    sim.passed = calloc(cellCount, sizeof(double));
+    sim.entered = calloc(cellCount, sizeof(double));
+    sim.sending = malloc(cellCount * sizeof(double));
+    sim.receiving = malloc(cellCount * sizeof(double));
+    sim.accept_share = malloc(cellCount * sizeof(double));
+    sim.inflow = malloc(cellCount * sizeof(double));
+    seed_demand(&sim, roads, vegetation, bbox);
+    return sim;
+}
+
+void traffic_free(TrafficSim* sim)
+{
+    free(sim->free_times);
+    free(sim->next);
+    free(sim->vertex_cell);
+    free(sim->down);
+    free(sim->up_offsets);
+    free(sim->up_cells);
+    free(sim->free_time);
+    free(sim->capacity);
+    free(sim->jam);
+    free(sim->send_share);
+    free(sim->receive_share);
+    free(sim->vehicles);
+    free(sim->waiting);
+    free(sim->release);
+    free(sim->vehicle_time);
+    free(sim->wait_time);
+    free(sim->passed);
+    free(sim->entered);
+    free(sim->sending);
+    free(sim->receiving);
+    free(sim->accept_share);
+    free(sim->inflow);
+    *sim = (TrafficSim){0};
+}
+
+typedef struct
+{
+    TrafficSim* sim;
+    /// The seconds of this step in which evacuees set off
+    double loading;
+    /// The cars that reached an exit in this step, per worker
+    double* evacuated;
+} StepCtx;
+
+/// The cars a cell can send on in a step
+static double cell_sending(const TrafficSim* sim, size_t cell)
+{
+    return MIN(sim->capacity[cell], sim->send_share[cell] * sim->vehicles[cell]);
+}
+
+/// The first pass of a step: what every cell can send on and take in, and how much of what flows
+/// into it it takes, shared between the cells driving into it in proportion to what they send.
+/// What the cells driving in send is worked out again here, so the pass reads nothing another
+/// thread writes
+static void step_merge(void* ctx, size_t start, size_t end, size_t worker)
+{
+    (void)worker;
+    TrafficSim* sim = ((StepCtx*)ctx)->sim;
+    for (size_t c = start; c < end; c++)
+    {
+        sim->sending[c] = cell_sending(sim, c);
+        sim->receiving[c] =
+            MIN(sim->capacity[c], sim->receive_share[c] * MAX(sim->jam[c] - sim->vehicles[c], 0));
+
+        double sent = 0;
+        for (size_t u = sim->up_offsets[c]; u < sim->up_offsets[c + 1]; u++)
+            sent += cell_sending(sim, sim->up_cells[u]);
+
+        sim->accept_share[c] = sent > sim->receiving[c] ? sim->receiving[c] / sent : 1;
+        sim->inflow[c] = MIN(sent, sim->receiving[c]);
+    }
+}
+
+/// The second pass: move the cars, let the waiting ones on where there is room left, and add up the
+/// time spent
+static void step_move(void* ctx, size_t start, size_t end, size_t worker)
+{
+    StepCtx* step = ctx;
+    TrafficSim* sim = step->sim;
+    for (size_t c = start; c < end; c++)
+    {
+        const uint32_t down = sim->down[c];
+        const double out = sim->sending[c] * (down != NO_CELL ? sim->accept_share[down] : 1);
+        const double enter =
+            MIN(sim->waiting[c], MAX(sim->receiving[c] - sim->inflow[c], 0));
+
+        sim->vehicles[c] += sim->inflow[c] - out + enter;
+        sim->waiting[c] += sim->release[c] * step->loading - enter;
+        sim->vehicle_time[c] += sim->vehicles[c] * sim->step;
+        sim->wait_time[c] += sim->waiting[c] * sim->step;
+        sim->passed[c] += out;
+        sim->entered[c] += enter;
+        if (down == NO_CELL)
+            step->evacuated[worker] += out;
+    }
+}
+
+void traffic_step(TrafficSim* sim, ThreadPool* pool)
+{
+    const size_t workers = pool_thread_count(pool);
+    StepCtx ctx = {
+        .sim = sim,
+        .loading = MAX(MIN(sim->step, TRAFFIC_LOADING_TIME - sim->time), 0),
+        .evacuated = calloc(workers, sizeof(double)),
+    };
+    pool_parallel_for(pool, sim->cell_count, TRAFFIC_CHUNK, step_merge, &ctx);
+    pool_parallel_for(pool, sim->cell_count, TRAFFIC_CHUNK, step_move, &ctx);
+
+    for (size_t w = 0; w < workers; w++)
+        sim->evacuated += ctx.evacuated[w];
+    free(ctx.evacuated);
+    sim->released += sim->demand * ctx.loading / TRAFFIC_LOADING_TIME;
+    sim->time += sim->step;
+}
+
+void traffic_run(TrafficSim* sim, double max_time, ThreadPool* pool)
+{
+    // Done once everyone has set off and less than half a car is left on the roads
+    while (sim->time < max_time &&
+           ((sim->demand > 0 && sim->time < TRAFFIC_LOADING_TIME) ||
+            sim->released - sim->evacuated >= 0.5))
+        traffic_step(sim, pool);
+}
+
+void traffic_times_to_safety(const TrafficSim* sim, double* times_out)
+{
+    // The delays add up from the exits backwards, so every cell comes after the one it drives into
+    const size_t cellCount = sim->cell_count;
+    double* delay = malloc(MAX(cellCount, 1) * sizeof(double));
+    uint32_t* order = malloc(MAX(cellCount, 1) * sizeof(uint32_t));
+    size_t head = 0;
+    size_t tail = 0;
+    for (size_t c = 0; c < cellCount; c++)
+    {
+        if (sim->down[c] == NO_CELL)
+            order[tail++] = (uint32_t)c;
+    }
+    while (head < tail)
+    {
+        const uint32_t c = order[head++];
+        // Little's law: the average time in the cell is the car seconds over the cars, counting
+        // the ones still in it. Cells shorter than a step take a step in the model
+        const double cars = sim->passed[c] + sim->vehicles[c];
+        const double time = cars > 0 ? sim->vehicle_time[c] / cars : 0;
+        delay[c] = MAX(time - MAX(sim->free_time[c], sim->step), 0);
+        if (sim->down[c] != NO_CELL)
+            delay[c] += delay[sim->down[c]];
+
+        for (size_t u = sim->up_offsets[c]; u < sim->up_offsets[c + 1]; u++)
+            order[tail++] = sim->up_cells[u];
+    }
+
+    for (size_t v = 0; v < sim->graph->vertex_count; v++)
+    {
+        const uint32_t c = sim->vertex_cell[v];
+        times_out[v] = sim->free_times[v];
+        if (c == NO_CELL)
+            continue;
+
+        const double waited = sim->entered[c] + sim->waiting[c];
+        times_out[v] += delay[c] + (waited > 0 ? sim->wait_time[c] / waited : 0);
+    }
+
+    free(order);
+    free(delay);
+}
@@ -0,0 +1,121 @@
+#ifndef TRAFFIC_H
+#define TRAFFIC_H
+
+#include "../models/geo.h"
+#include "../models/road.h"
+#include "../models/vegetation.h"
+#include "../routing/road_graph.h"
+#include "../threading/pool.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// The seconds each step of the traffic simulation covers
+#define TRAFFIC_STEP 2.0
+/// The seconds over which the evacuees set off, at an even rate
+#define TRAFFIC_LOADING_TIME (30 * 60)
+/// The cars that leave per square metre of built up area, about one per household in a town
+#define TRAFFIC_VEHICLES_PER_M2 0.003
+/// The cars per metre of lane when the traffic stands still
+#define TRAFFIC_JAM_DENSITY 0.15
+/// How long the console and batch mode let an evacuation run before they stop it, in seconds
+#define TRAFFIC_MAX_TIME (6 * 3600)
+/// The amount of cells each task of a step updates
+#define TRAFFIC_CHUNK 2048
+
+/// An evacuation by car over the roads of a graph, as a cell transmission model.
+///
+/// Every car drives to its nearest exit the way `route_time_to_safety()` picks, so the edges taken
+/// make up a tree hanging off the exits. The roads of the tree are cut into cells that take about
+/// one step to drive through, and each step moves as many cars from a cell into the next one as
+/// the first can send and the second can take: no more than the capacity of the road, and no more
+/// than the room left in the next cell. Where roads merge, the room is shared in proportion to
+/// what each road sends. The capacity and the lanes of a road come from its class.
+///
+/// The cars start at the vertices in and nearest to the built up areas, and set off over
+/// TRAFFIC_LOADING_TIME, queueing where they get onto the road until there is room.
+/// https://en.wikipedia.org/wiki/Cell_transmission_model
+typedef struct
+{
+    const RoadGraph* graph;
+    /// The time to safety of each vertex without traffic, and the edge it drives out over, like
+    /// `route_time_to_safety()` gives them
+    double* free_times;
+    size_t* next;
+    /// The cell the cars of each vertex get onto the road in, UINT32_MAX at the exits and at the
+    /// vertices with no way out
+    uint32_t* vertex_cell;
+
+    size_t cell_count;
+    /// The cell each cell drives into, UINT32_MAX for the cells that end at an exit
+    uint32_t* down;
+    /// The cells driving into cell `c` are at the indices `up_offsets[c]` up to (but not
+    /// including) `up_offsets[c + 1]` of `up_cells`
+    size_t* up_offsets;
+    uint32_t* up_cells;
+    /// The seconds it takes to drive through each cell without traffic
+    double* free_time;
+    /// The cars each cell lets through in a step
+    double* capacity;
+    /// The cars each cell holds when the traffic stands still
+    double* jam;
+    /// The share of its cars each cell can send on in a step in free flow, and the share of its
+    /// free room it can take in a step when jammed
+    double* send_share;
+    double* receive_share;
+
+    /// The cars in each cell, and the ones that have set off and wait to get onto it
+    double* vehicles;
+    double* waiting;
+    /// The cars that set off into each cell per second while the evacuees are leaving
+    double* release;
+
+    /// The car seconds spent in each cell and waiting to get onto it, and the cars that left it and
+    /// that got onto it, which make up the average time in it
+    double* vehicle_time;
+    double* wait_time;
+    double* passed;
+    double* entered;
+
+    // Scratch memory for the steps
+    double* sending;
+    double* receiving;
+    /// The share of what the cells driving into each cell send that it takes, and the cars that
+    /// come in with that
+    double* accept_share;
+    double* inflow;
+
+    /// The seconds simulated so far, and the length of a step
+    double time;
+    double step;
+    /// The cars that leave, have set off so far, and have reached an exit
+    double demand;
+    double released;
+    double evacuated;
+    /// The cars in built up areas with no way out, which are left out
+    double stranded;
+} TrafficSim;
+
+/// Set up an evacuation over a graph of the roads of a bbox, with the cars seeded from the built
+/// up areas of the vegetation. The graph must have been built from the roads, and outlive the
+/// simulation.
+/// The caller is responsible for freeing the simulation with `traffic_free()`
+TrafficSim traffic_create(const RoadGraph* graph, RoadSegSlice roads, VegSlice vegetation,
+                          BoundBox bbox);
+
+void traffic_free(TrafficSim* sim);
+
+/// Run one step, with the cells split between the threads of the pool. Each step goes over the
+/// cells twice: working out what every cell can send and take and what every merge lets through,
+/// and then the new amount of cars, so no cell is written by two threads
+void traffic_step(TrafficSim* sim, ThreadPool* pool);
+
+/// Run steps until everyone has set off and reached an exit, or `max_time` seconds have passed
+void traffic_run(TrafficSim* sim, double max_time, ThreadPool* pool);
+
+/// Get the time to safety of every vertex with the traffic so far: the time without traffic, plus
+/// the average wait to get onto the road there and the average delay in every cell on the way out.
+/// Vertices with no way out get INFINITY
+void traffic_times_to_safety(const TrafficSim* sim, double* times_out);
+
+#endif // TRAFFIC_H
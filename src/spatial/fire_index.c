@@ -0,0 +1,184 @@
+#include "fire_index.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+static int cmp_point_x(const void* p1, const void* p2)
+{
+    double c1 = ((const FireIndexPoint*)p1)->coord.x;
+    double c2 = ((const FireIndexPoint*)p2)->coord.x;
+    return (c1 > c2) - (c1 < c2);
+}
+
+static int cmp_point_y(const void* p1, const void* p2)
+{
+    double c1 = ((const FireIndexPoint*)p1)->coord.y;
+    double c2 = ((const FireIndexPoint*)p2)->coord.y;
+    return (c1 > c2) - (c1 < c2);
+}
+
+/// Sort the range of points into a subtree, splitting on x at even depths and y at odd ones
+static void build(FireIndexPoint* points, size_t count, size_t depth)
+{
+    if (count <= 1)
+        return;
+
+    qsort(points, count, sizeof(FireIndexPoint), depth % 2 == 0 ? cmp_point_x : cmp_point_y);
+
+    const size_t mid = count / 2;
+    build(points, mid, depth + 1);
+    build(points + mid + 1, count - mid - 1, depth + 1);
+}
+
+FireIndex fire_index_from_fires(FireSlice fires)
+{
+    FireIndex index = {0};
+    fire_index_rebuild(&index, fires);
+    return index;
+}
+
+void fire_index_free(FireIndex* index)
+{
+    free(index->points);
+    *index = (FireIndex){0};
+}
+
+void fire_index_rebuild(FireIndex* index, FireSlice fires)
+{
+    if (fires.len > index->count || index->points == NULL)
+        index->points = realloc(index->points, MAX(fires.len, 1) * sizeof(FireIndexPoint));
+    index->count = fires.len;
+    for (size_t i = 0; i < fires.len; i++)
+        index->points[i] = (FireIndexPoint){.coord = fires.items[i].mcoord, .fire = i};
+
+    build(index->points, index->count, 0);
+}
+
+static double axis_of(MCoord c, size_t depth)
+{
+    return depth % 2 == 0 ? c.x : c.y;
+}
+
+static void query_rect(const FireIndexPoint* points, size_t count, size_t depth, MRect rect,
+                       FireIdxVec* out)
+{
+    if (count == 0)
+        return;
+
+    const size_t mid = count / 2;
+    const FireIndexPoint point = points[mid];
+    if (point.coord.x >= rect.min_x && point.coord.x <= rect.max_x &&
+        point.coord.y >= rect.min_y && point.coord.y <= rect.max_y)
+        vec_push(out, point.fire);
+
+    // Equal coordinates can end up on either side of the split
+    const double split = axis_of(point.coord, depth);
+    if ((depth % 2 == 0 ? rect.min_x : rect.min_y) <= split)
+        query_rect(points, mid, depth + 1, rect, out);
+    if ((depth % 2 == 0 ? rect.max_x : rect.max_y) >= split)
+        query_rect(points + mid + 1, count - mid - 1, depth + 1, rect, out);
+}
+
+void fire_index_query_rect(const FireIndex* index, MRect rect, FireIdxVec* out)
+{
+    query_rect(index->points, index->count, 0, rect, out);
+}
+
+static void query_radius(const FireIndexPoint* points, size_t count, size_t depth, MCoord p,
+                         double radius, FireIdxVec* out)
+{
+    if (count == 0)
+        return;
+
+    const size_t mid = count / 2;
+    const FireIndexPoint point = points[mid];
+    if (mcoord_dst(point.coord, p) <= radius)
+        vec_push(out, point.fire);
+
+    const double diff = axis_of(p, depth) - axis_of(point.coord, depth);
+    if (diff <= radius)
+        query_radius(points, mid, depth + 1, p, radius, out);
+    if (diff >= -radius)
+        query_radius(points + mid + 1, count - mid - 1, depth + 1, p, radius, out);
+}
+
+void fire_index_query_radius(const FireIndex* index, MCoord p, double radius, FireIdxVec* out)
+{
+    query_radius(index->points, index->count, 0, p, radius, out);
+}
+
+/// The best match so far of a nearest neighbour search
+typedef struct
+{
+    long fire;
+    double dst2;
+} Nearest;
+
+static void nearest_to_segment(const FireIndexPoint* points, size_t count, size_t depth,
+                               MCoord a, MCoord b, Nearest* best)
+{
+    if (count == 0)
+        return;
+
+    const size_t mid = count / 2;
+    const FireIndexPoint point = points[mid];
+
+    const MCoord closest = closest_point_on_segment(a, b, point.coord);
+    const double dx = closest.x - point.coord.x;
+    const double dy = closest.y - point.coord.y;
+    const double dst2 = dx * dx + dy * dy;
+    if (dst2 < best->dst2 || (dst2 == best->dst2 && (long)point.fire < best->fire))
+        *best = (Nearest){.fire = (long)point.fire, .dst2 = dst2};
+
+    // How far the segment is from each side of the split. Visit the side the segment is on
+    // first, since that is most likely where the closest fire is
+    const double split = axis_of(point.coord, depth);
+    const double seg_min = MIN(axis_of(a, depth), axis_of(b, depth));
+    const double seg_max = MAX(axis_of(a, depth), axis_of(b, depth));
+    const double low_gap = MAX(seg_min - split, 0.0);
+    const double high_gap = MAX(split - seg_max, 0.0);
+
+    const FireIndexPoint* low = points;
+    const size_t low_count = mid;
+    const FireIndexPoint* high = points + mid + 1;
+    const size_t high_count = count - mid - 1;
+
+    if (low_gap <= high_gap)
+    {
+        nearest_to_segment(low, low_count, depth + 1, a, b, best);
+        if (high_gap * high_gap <= best->dst2)
+            nearest_to_segment(high, high_count, depth + 1, a, b, best);
+    }
+    else
+    {
+        nearest_to_segment(high, high_count, depth + 1, a, b, best);
+        if (low_gap * low_gap <= best->dst2)
+            nearest_to_segment(low, low_count, depth + 1, a, b, best);
+    }
+}
+
+long fire_index_nearest(const FireIndex* index, MCoord p, double* dst_out)
+{
+    Nearest best = {.fire = -1, .dst2 = INFINITY};
+    nearest_to_segment(index->points, index->count, 0, p, p, &best);
+
+    if (dst_out != NULL)
+        *dst_out = sqrt(best.dst2);
+    return best.fire;
+}
+
+long fire_index_nearest_to_road(const FireIndex* index, RoadSeg road, double* dst_out)
+{
+    // Searching segment after segment with the same best match lets the later segments skip
+    // everything that is further away than what the earlier ones found
+    Nearest best = {.fire = -1, .dst2 = INFINITY};
+    for (size_t i = 0; i + 1 < road.nodes.len; i++)
+    {
+        nearest_to_segment(index->points, index->count, 0, mcoord_load(road.nodes.items[i].mcoords),
+                           mcoord_load(road.nodes.items[i + 1].mcoords), &best);
+    }
+
+    if (dst_out != NULL)
+        *dst_out = sqrt(best.dst2);
+    return best.fire;
+}
@@ -0,0 +1,57 @@
+#ifndef FIRE_INDEX_H
+#define FIRE_INDEX_H
+
+#include "../dyn.h"
+#include "../models/fire.h"
+#include "../models/geo.h"
+#include "../models/road.h"
+
+#include <stddef.h>
+
+/// A fire in the index: its projected coordinate and its index in the slice the index was built
+/// from
+typedef struct
+{
+    MCoord coord;
+    size_t fire;
+} FireIndexPoint;
+
+typedef VecDef(size_t) FireIdxVec;
+
+/// A static 2D tree over the projected coordinates of a set of fires.
+///
+/// The tree is implicit: the points of a subtree are a range of `points`, the point in the middle
+/// of the range splits it in two, and the split alternates between x (at even depths) and y.
+/// https://en.wikipedia.org/wiki/K-d_tree
+typedef struct
+{
+    FireIndexPoint* points;
+    size_t count;
+} FireIndex;
+
+/// Build an index over the fires. The fires must have been projected with `project_fires()`
+/// beforehand.
+/// The caller is responsible for freeing the index with `fire_index_free()`
+FireIndex fire_index_from_fires(FireSlice fires);
+
+void fire_index_free(FireIndex* index);
+
+/// Build the index over another set of fires, reusing its memory
+void fire_index_rebuild(FireIndex* index, FireSlice fires);
+
+/// Push the index of every fire inside the rectangle into `out`, in no particular order
+void fire_index_query_rect(const FireIndex* index, MRect rect, FireIdxVec* out);
+
+/// Push the index of every fire within `radius` metres of `p` into `out`, in no particular order
+void fire_index_query_radius(const FireIndex* index, MCoord p, double radius, FireIdxVec* out);
+
+/// Get the index of the fire closest to `p`, or -1 if there are no fires.
+/// If `dst_out` is not NULL it gets the distance in metres. Ties go to the lowest index
+long fire_index_nearest(const FireIndex* index, MCoord p, double* dst_out);
+
+/// Get the index of the fire closest to any segment of a road, or -1 if there are no fires or the
+/// road has no segments. The road must have been projected with `project_roads()` beforehand.
+/// If `dst_out` is not NULL it gets the distance in metres. Ties go to the lowest index
+long fire_index_nearest_to_road(const FireIndex* index, RoadSeg road, double* dst_out);
+
+#endif // FIRE_INDEX_H
@@ -0,0 +1,339 @@
+#include "rtree.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+/// The max amount of children of a node
+#define RTREE_FANOUT 16
+/// The max amount of nodes waiting on the stack during a query. With full nodes (which STR gives)
+/// this is enough for trees far taller than any road network.
+#define RTREE_STACK_SIZE 512
+
+typedef VecDef(RTreeNode) RTreeNodeVec;
+
+typedef struct
+{
+    double dst2;
+    bool is_seg;
+    size_t idx;
+} HeapItem;
+
+typedef VecDef(HeapItem) HeapItemVec;
+
+static MRect seg_rect(RTreeSeg seg)
+{
+    return (MRect){
+        .min_x = MIN(seg.a.x, seg.b.x),
+        .min_y = MIN(seg.a.y, seg.b.y),
+        .max_x = MAX(seg.a.x, seg.b.x),
+        .max_y = MAX(seg.a.y, seg.b.y),
+    };
+}
+
+static MRect rect_union(MRect r1, MRect r2)
+{
+    return (MRect){
+        .min_x = MIN(r1.min_x, r2.min_x),
+        .min_y = MIN(r1.min_y, r2.min_y),
+        .max_x = MAX(r1.max_x, r2.max_x),
+        .max_y = MAX(r1.max_y, r2.max_y),
+    };
+}
+
+static bool rect_intersects(MRect r1, MRect r2)
+{
+    return r1.min_x <= r2.max_x && r2.min_x <= r1.max_x && r1.min_y <= r2.max_y &&
+           r2.min_y <= r1.max_y;
+}
+
+/// The squared distance from a point to the closest point of a rectangle
+static double rect_dst2(MRect rect, MCoord p)
+{
+    double dx = MAX(MAX(rect.min_x - p.x, 0.0), p.x - rect.max_x);
+    double dy = MAX(MAX(rect.min_y - p.y, 0.0), p.y - rect.max_y);
+    return dx * dx + dy * dy;
+}
+
+static int cmp_seg_x(const void* s1, const void* s2)
+{
+    double c1 = ((const RTreeSeg*)s1)->a.x + ((const RTreeSeg*)s1)->b.x;
+    double c2 = ((const RTreeSeg*)s2)->a.x + ((const RTreeSeg*)s2)->b.x;
+    return (c1 > c2) - (c1 < c2);
+}
+
+static int cmp_seg_y(const void* s1, const void* s2)
+{
+    double c1 = ((const RTreeSeg*)s1)->a.y + ((const RTreeSeg*)s1)->b.y;
+    double c2 = ((const RTreeSeg*)s2)->a.y + ((const RTreeSeg*)s2)->b.y;
+    return (c1 > c2) - (c1 < c2);
+}
+
+static int cmp_node_x(const void* n1, const void* n2)
+{
+    MRect r1 = ((const RTreeNode*)n1)->rect;
+    MRect r2 = ((const RTreeNode*)n2)->rect;
+    double c1 = r1.min_x + r1.max_x;
+    double c2 = r2.min_x + r2.max_x;
+    return (c1 > c2) - (c1 < c2);
+}
+
+static int cmp_node_y(const void* n1, const void* n2)
+{
+    MRect r1 = ((const RTreeNode*)n1)->rect;
+    MRect r2 = ((const RTreeNode*)n2)->rect;
+    double c1 = r1.min_y + r1.max_y;
+    double c2 = r2.min_y + r2.max_y;
+    return (c1 > c2) - (c1 < c2);
+}
+
+/// Sort-Tile-Recursive ordering: sort everything by x, cut it into sqrt(leaf count) vertical
+/// slices, and sort each slice by y. Taking RTREE_FANOUT items at a time afterwards gives tiles.
+static void str_sort(void* items, size_t count, size_t size,
+                     int (*cmp_x)(const void*, const void*), int (*cmp_y)(const void*, const void*))
+{
+    size_t tile_count = (count + RTREE_FANOUT - 1) / RTREE_FANOUT;
+    size_t slice_count = (size_t)ceil(sqrt((double)tile_count));
+    size_t slice_len = ((tile_count + slice_count - 1) / slice_count) * RTREE_FANOUT;
+
+    qsort(items, count, size, cmp_x);
+    for (size_t start = 0; start < count; start += slice_len)
+        qsort((char*)items + start * size, MIN(slice_len, count - start), size, cmp_y);
+}
+
+RTree rtree_from_roads(RoadSegSlice roads)
+{
+    RTreeSegVec segs = {0};
+    for (size_t i = 0; i < roads.len; i++)
+    {
+        NodeSlice nodes = roads.items[i].nodes;
+        for (size_t j = 0; j + 1 < nodes.len; j++)
+        {
+            RTreeSeg seg = {
+                .a = mcoord_load(nodes.items[j].mcoords),
+                .b = mcoord_load(nodes.items[j + 1].mcoords),
+                .road = i,
+                .seg = j,
+            };
+            vec_push(&segs, seg);
+        }
+    }
+
+    RTreeNodeVec nodes = {0};
+
+    // Leaves
+    str_sort(segs.items, segs.len, sizeof(RTreeSeg), cmp_seg_x, cmp_seg_y);
+    for (size_t i = 0; i < segs.len; i += RTREE_FANOUT)
+    {
+        RTreeNode leaf = {
+            .rect = seg_rect(segs.items[i]),
+            .first = i,
+            .count = MIN(RTREE_FANOUT, segs.len - i),
+            .is_leaf = true,
+        };
+        for (size_t j = 1; j < leaf.count; j++)
+            leaf.rect = rect_union(leaf.rect, seg_rect(segs.items[i + j]));
+
+        vec_push(&nodes, leaf);
+    }
+
+    // Pack each level into the one above it, until only the root is left
+    size_t level_start = 0;
+    size_t level_count = nodes.len;
+    while (level_count > 1)
+    {
+        str_sort(nodes.items + level_start, level_count, sizeof(RTreeNode), cmp_node_x,
+                 cmp_node_y);
+
+        size_t next_start = nodes.len;
+        for (size_t i = 0; i < level_count; i += RTREE_FANOUT)
+        {
+            RTreeNode parent = {
+                .rect = nodes.items[level_start + i].rect,
+                .first = level_start + i,
+                .count = MIN(RTREE_FANOUT, level_count - i),
+                .is_leaf = false,
+            };
+            for (size_t j = 1; j < parent.count; j++)
+                parent.rect = rect_union(parent.rect, nodes.items[level_start + i + j].rect);
+
+            vec_push(&nodes, parent);
+        }
+
+        level_start = next_start;
+        level_count = nodes.len - next_start;
+    }
+
+    RTree tree = {
+        .segs = segs.items,
+        .seg_count = segs.len,
+        .nodes = nodes.items,
+        .node_count = nodes.len,
+        .root = level_start,
+    };
+    return tree;
+}
+
+void rtree_free(RTree* tree)
+{
+    free(tree->segs);
+    free(tree->nodes);
+    *tree = (RTree){0};
+}
+
+double rtree_seg_dst(RTreeSeg seg, MCoord p)
+{
+    return mcoord_dst(p, closest_point_on_segment(seg.a, seg.b, p));
+}
+
+void rtree_query_rect(const RTree* tree, MRect rect, RTreeSegVec* out)
+{
+    if (tree->node_count == 0 || !rect_intersects(tree->nodes[tree->root].rect, rect))
+        return;
+
+    size_t stack[RTREE_STACK_SIZE];
+    size_t stack_len = 0;
+    stack[stack_len++] = tree->root;
+
+    while (stack_len > 0)
+    {
+        RTreeNode node = tree->nodes[stack[--stack_len]];
+
+        for (size_t i = node.first; i < node.first + node.count; i++)
+        {
+            if (node.is_leaf)
+            {
+                if (rect_intersects(seg_rect(tree->segs[i]), rect))
+                    vec_push(out, tree->segs[i]);
+            }
+            else if (rect_intersects(tree->nodes[i].rect, rect))
+            {
+                assert(stack_len < RTREE_STACK_SIZE && "R-tree query stack overflow");
+                stack[stack_len++] = i;
+            }
+        }
+    }
+}
+
+void rtree_query_radius(const RTree* tree, MCoord p, double radius, RTreeSegVec* out)
+{
+    if (tree->node_count == 0)
+        return;
+
+    const double radius2 = radius * radius;
+
+    size_t stack[RTREE_STACK_SIZE];
+    size_t stack_len = 0;
+    if (rect_dst2(tree->nodes[tree->root].rect, p) <= radius2)
+        stack[stack_len++] = tree->root;
+
+    while (stack_len > 0)
+    {
+        RTreeNode node = tree->nodes[stack[--stack_len]];
+
+        for (size_t i = node.first; i < node.first + node.count; i++)
+        {
+            if (node.is_leaf)
+            {
+                if (rtree_seg_dst(tree->segs[i], p) <= radius)
+                    vec_push(out, tree->segs[i]);
+            }
+            else if (rect_dst2(tree->nodes[i].rect, p) <= radius2)
+            {
+                assert(stack_len < RTREE_STACK_SIZE && "R-tree query stack overflow");
+                stack[stack_len++] = i;
+            }
+        }
+    }
+}
+
+static void heap_push(HeapItemVec* heap, HeapItem item)
+{
+    vec_push(heap, item);
+
+    size_t i = heap->len - 1;
+    while (i > 0)
+    {
+        size_t parent = (i - 1) / 2;
+        if (heap->items[parent].dst2 <= heap->items[i].dst2)
+            break;
+
+        HeapItem tmp = heap->items[parent];
+        heap->items[parent] = heap->items[i];
+        heap->items[i] = tmp;
+        i = parent;
+    }
+}
+
+static HeapItem heap_pop(HeapItemVec* heap)
+{
+    HeapItem top = heap->items[0];
+    heap->items[0] = heap->items[heap->len - 1];
+    heap->len--;
+
+    size_t i = 0;
+    while (true)
+    {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = 2 * i + 2;
+
+        if (left < heap->len && heap->items[left].dst2 < heap->items[smallest].dst2)
+            smallest = left;
+        if (right < heap->len && heap->items[right].dst2 < heap->items[smallest].dst2)
+            smallest = right;
+        if (smallest == i)
+            break;
+
+        HeapItem tmp = heap->items[smallest];
+        heap->items[smallest] = heap->items[i];
+        heap->items[i] = tmp;
+        i = smallest;
+    }
+
+    return top;
+}
+
+void rtree_nearest(const RTree* tree, MCoord p, size_t k, RTreeSegVec* out)
+{
+    if (tree->node_count == 0 || k == 0)
+        return;
+
+    // Best-first search: always expand whatever is closest, so segments come out of the heap in
+    // order of distance
+    HeapItemVec heap = {0};
+    heap_push(&heap, (HeapItem){
+                         .dst2 = rect_dst2(tree->nodes[tree->root].rect, p),
+                         .is_seg = false,
+                         .idx = tree->root,
+                     });
+
+    size_t found = 0;
+    while (heap.len > 0 && found < k)
+    {
+        HeapItem item = heap_pop(&heap);
+        if (item.is_seg)
+        {
+            vec_push(out, tree->segs[item.idx]);
+            found++;
+            continue;
+        }
+
+        RTreeNode node = tree->nodes[item.idx];
+        for (size_t i = node.first; i < node.first + node.count; i++)
+        {
+            double dst2;
+            if (node.is_leaf)
+            {
+                double dst = rtree_seg_dst(tree->segs[i], p);
+                dst2 = dst * dst;
+            }
+            else
+                dst2 = rect_dst2(tree->nodes[i].rect, p);
+
+            heap_push(&heap, (HeapItem){.dst2 = dst2, .is_seg = node.is_leaf, .idx = i});
+        }
+    }
+
+    vec_free(heap);
+}
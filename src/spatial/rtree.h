@@ -0,0 +1,68 @@
+#ifndef RTREE_H
+#define RTREE_H
+
+#include "../dyn.h"
+#include "../models/geo.h"
+#include "../models/road.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// A single road segment in the tree: the line between node `seg` and node `seg + 1` of road
+/// `road`
+typedef struct
+{
+    MCoord a;
+    MCoord b;
+    /// The index of the road in the slice the tree was built from
+    size_t road;
+    /// The index of the segment in the road
+    size_t seg;
+} RTreeSeg;
+
+typedef VecDef(RTreeSeg) RTreeSegVec;
+
+typedef struct
+{
+    MRect rect;
+    /// The index of the first child. Children are nodes for inner nodes, and segments for leaves
+    size_t first;
+    /// The amount of children
+    size_t count;
+    bool is_leaf;
+} RTreeNode;
+
+/// A static R-tree over the segments of a set of roads, bulk loaded with Sort-Tile-Recursive
+/// packing. Every node is full except the last of each level, and the children of a node are
+/// stored next to each other, so a query walks a handful of nodes per level.
+/// https://en.wikipedia.org/wiki/R-tree#Packing_and_bulk_loading
+typedef struct
+{
+    RTreeSeg* segs;
+    size_t seg_count;
+    RTreeNode* nodes;
+    size_t node_count;
+    /// The index of the root in `nodes`. Only valid if `node_count` > 0
+    size_t root;
+} RTree;
+
+/// Build a tree over every segment of the roads. The roads must have been projected with
+/// `project_roads()` beforehand.
+/// The caller is responsible for freeing the tree with `rtree_free()`
+RTree rtree_from_roads(RoadSegSlice roads);
+
+void rtree_free(RTree* tree);
+
+/// Push every segment whose bounding box intersects the rectangle into `out`
+void rtree_query_rect(const RTree* tree, MRect rect, RTreeSegVec* out);
+
+/// Push every segment that is within `radius` metres of `p` into `out`
+void rtree_query_radius(const RTree* tree, MCoord p, double radius, RTreeSegVec* out);
+
+/// Push the (up to) `k` segments closest to `p` into `out`, closest first
+void rtree_nearest(const RTree* tree, MCoord p, size_t k, RTreeSegVec* out);
+
+/// The distance in metres from a point to a segment in the tree
+double rtree_seg_dst(RTreeSeg seg, MCoord p);
+
+#endif // RTREE_H
@@ -0,0 +1,111 @@
+#include "veg_index.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/// Get the bin column or row of a local coordinate, clamped to the bins of the index
+static size_t bin_of(double c, double bin_size, size_t count)
+{
+    const double bin = floor(c / bin_size);
+    if (bin <= 0)
+        return 0;
+    return MIN((size_t)bin, count - 1);
+}
+
+VegIndex veg_index_from_vegetation(VegSlice data, BoundBox gbbox)
+{
+    const size_t width = VEG_INDEX_GRID_SIZE;
+    const size_t height = VEG_INDEX_GRID_SIZE;
+    VegIndex index = {
+        .polys = veg_polys_from_vegetation(data, gbbox, width, height),
+        .bbox = gbbox,
+        .width = width,
+        .height = height,
+        .bin_size = MAX(sqrt((double)(width * height) / (double)MAX(data.len, 1)), 1.0),
+    };
+    index.cols = MAX((size_t)ceil((double)width / index.bin_size), 1);
+    index.rows = MAX((size_t)ceil((double)height / index.bin_size), 1);
+
+    const size_t bin_count = index.cols * index.rows;
+    index.bin_offsets = calloc(bin_count + 1, sizeof(size_t));
+
+    // Count the polygons of each bin first, then fill them in
+    for (size_t i = 0; i < index.polys.len; i++)
+    {
+        const VegPoly* poly = &index.polys.items[i];
+        if (poly->edge_count == 0)
+            continue;
+
+        const size_t first_col = bin_of(poly->min.x, index.bin_size, index.cols);
+        const size_t last_col = bin_of(poly->max.x, index.bin_size, index.cols);
+        const size_t first_row = bin_of(poly->min.y, index.bin_size, index.rows);
+        const size_t last_row = bin_of(poly->max.y, index.bin_size, index.rows);
+        for (size_t row = first_row; row <= last_row; row++)
+        {
+            for (size_t col = first_col; col <= last_col; col++)
+                index.bin_offsets[row * index.cols + col + 1]++;
+        }
+    }
+    for (size_t b = 0; b < bin_count; b++)
+        index.bin_offsets[b + 1] += index.bin_offsets[b];
+
+    index.bin_polys = malloc(MAX(index.bin_offsets[bin_count], 1) * sizeof(size_t));
+    size_t* fill = malloc(bin_count * sizeof(size_t));
+    memcpy(fill, index.bin_offsets, bin_count * sizeof(size_t));
+    for (size_t i = 0; i < index.polys.len; i++)
+    {
+        const VegPoly* poly = &index.polys.items[i];
+        if (poly->edge_count == 0)
+            continue;
+
+        const size_t first_col = bin_of(poly->min.x, index.bin_size, index.cols);
+        const size_t last_col = bin_of(poly->max.x, index.bin_size, index.cols);
+        const size_t first_row = bin_of(poly->min.y, index.bin_size, index.rows);
+        const size_t last_row = bin_of(poly->max.y, index.bin_size, index.rows);
+        for (size_t row = first_row; row <= last_row; row++)
+        {
+            for (size_t col = first_col; col <= last_col; col++)
+                index.bin_polys[fill[row * index.cols + col]++] = i;
+        }
+    }
+    free(fill);
+
+    return index;
+}
+
+void veg_index_free(VegIndex* index)
+{
+    veg_polys_free(&index->polys);
+    free(index->bin_offsets);
+    free(index->bin_polys);
+    *index = (VegIndex){0};
+}
+
+bool veg_index_lookup_gcoord(const VegIndex* index, GCoord coord, VegType* type)
+{
+    const LCoord lcoord = global_to_local_exact(coord, index->bbox, index->height, index->width);
+    const size_t col = bin_of(lcoord.x, index->bin_size, index->cols);
+    const size_t row = bin_of(lcoord.y, index->bin_size, index->rows);
+    const size_t bin = row * index->cols + col;
+
+    // The polygons of a bin are in their original order, so only a higher priority replaces the
+    // polygon found so far
+    *type = VEG_NONE;
+    int best_priority = 0;
+    for (size_t j = index->bin_offsets[bin]; j < index->bin_offsets[bin + 1]; j++)
+    {
+        const VegPoly* poly = &index->polys.items[index->bin_polys[j]];
+        const int priority = veg_type_priority(poly->type);
+        if (priority <= best_priority)
+            continue;
+
+        if (veg_poly_contains(poly, lcoord, 0))
+        {
+            *type = poly->type;
+            best_priority = priority;
+        }
+    }
+
+    return *type != VEG_NONE;
+}
@@ -0,0 +1,51 @@
+#ifndef VEG_INDEX_H
+#define VEG_INDEX_H
+
+#include "../models/geo.h"
+#include "../models/vegetation.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/// The width and height of the local grid the polygons of a `VegIndex` are prepared on. It only
+/// sets the units of the index, lookups test the exact polygons
+#define VEG_INDEX_GRID_SIZE 4096
+
+/// A uniform grid of bins over a bbox, where each bin lists the vegetation polygons whose bounds
+/// overlap it. A point query only tests the polygons of its bin, so looking up the vegetation at
+/// exact coordinates stays cheap without rasterizing everything into a `VegGrid` at full
+/// resolution, which would take too much memory.
+///
+/// The bins are sized so there is about one bin per polygon, and polygons outside the bbox are kept
+/// in the bins at its border, so lookups outside of it are still correct.
+typedef struct
+{
+    /// The prepared polygons, owned by the index
+    VegPolySlice polys;
+    /// The bbox the local grid of the polygons covers, and its size
+    BoundBox bbox;
+    size_t width;
+    size_t height;
+    /// The width and height of a bin in local cells
+    double bin_size;
+    size_t cols;
+    size_t rows;
+    /// The polygons of bin `b` (row after row) are `bin_polys[bin_offsets[b]]` up to (but not
+    /// including) `bin_polys[bin_offsets[b + 1]]`, in the same order as in `polys`.
+    /// Has `cols * rows + 1` entries
+    size_t* bin_offsets;
+    size_t* bin_polys;
+} VegIndex;
+
+/// Prepare the vegetation polygons of a bbox and index them, once after they have been parsed.
+/// The caller is responsible for freeing the index with `veg_index_free()`
+VegIndex veg_index_from_vegetation(VegSlice data, BoundBox gbbox);
+
+void veg_index_free(VegIndex* index);
+
+/// Get the vegetation at a global coordinate. Where polygons overlap, the one with the highest
+/// priority wins like in a `VegGrid`, and the first of them if they have the same priority.
+/// Returns false if no polygon contains the coordinate.
+bool veg_index_lookup_gcoord(const VegIndex* index, GCoord coord, VegType* type);
+
+#endif // VEG_INDEX_H
@@ -0,0 +1,186 @@
+#include "pool.h"
+
+#include "../dyn.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+struct ThreadPool
+{
+    pthread_t* threads;
+    /// The amount of pool threads, not counting the calling thread
+    size_t thread_count;
+
+    pthread_mutex_t mutex;
+    /// Signalled when a new loop starts, or the pool stops
+    pthread_cond_t start_cond;
+    /// Signalled when the last pool thread is done with a loop
+    pthread_cond_t done_cond;
+    /// Counts up for every loop, so the threads can tell a new loop from the one they just did
+    size_t generation;
+    /// The amount of pool threads still working on the current loop
+    size_t busy;
+    bool stop;
+
+    // The current loop
+    PoolTask task;
+    void* ctx;
+    size_t count;
+    size_t chunk_size;
+    atomic_size_t next;
+};
+
+typedef struct
+{
+    ThreadPool* pool;
+    size_t worker;
+} WorkerArgs;
+
+/// Take chunks of the current loop until there are none left
+static void run_chunks(ThreadPool* pool, size_t worker)
+{
+    while (true)
+    {
+        const size_t start = atomic_fetch_add(&pool->next, pool->chunk_size);
+        if (start >= pool->count)
+            break;
+
+        pool->task(pool->ctx, start, MIN(start + pool->chunk_size, pool->count), worker);
+    }
+}
+
+static void* worker_main(void* arg)
+{
+    WorkerArgs args = *(WorkerArgs*)arg;
+    free(arg);
+    ThreadPool* pool = args.pool;
+
+    size_t seen_generation = 0;
+    pthread_mutex_lock(&pool->mutex);
+    while (true)
+    {
+        while (!pool->stop && pool->generation == seen_generation)
+            pthread_cond_wait(&pool->start_cond, &pool->mutex);
+        if (pool->stop)
+            break;
+
+        seen_generation = pool->generation;
+        pthread_mutex_unlock(&pool->mutex);
+
+        run_chunks(pool, args.worker);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->busy == 0)
+            pthread_cond_signal(&pool->done_cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+size_t pool_cpu_count(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return MAX((size_t)info.dwNumberOfProcessors, 1);
+#else
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (size_t)count : 1;
+#endif
+}
+
+ThreadPool* pool_create(size_t thread_count)
+{
+    if (thread_count == 0)
+        thread_count = pool_cpu_count();
+
+    ThreadPool* pool = calloc(1, sizeof(ThreadPool));
+    pool->threads = malloc(MAX(thread_count - 1, 1) * sizeof(pthread_t));
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+
+    // The calling thread is worker 0, the pool threads are the rest
+    for (size_t i = 0; i + 1 < thread_count; i++)
+    {
+        WorkerArgs* args = malloc(sizeof(WorkerArgs));
+        *args = (WorkerArgs){.pool = pool, .worker = i + 1};
+        if (pthread_create(&pool->threads[i], NULL, worker_main, args) != 0)
+        {
+            debug_log(WARNING, "pool_create: could only start %zu of %zu threads", i + 1,
+                      thread_count);
+            free(args);
+            break;
+        }
+        pool->thread_count++;
+    }
+
+    return pool;
+}
+
+void pool_free(ThreadPool* pool)
+{
+    if (pool == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (size_t i = 0; i < pool->thread_count; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->start_cond);
+    pthread_cond_destroy(&pool->done_cond);
+    free(pool->threads);
+    free(pool);
+}
+
+size_t pool_thread_count(const ThreadPool* pool)
+{
+    return pool != NULL ? pool->thread_count + 1 : 1;
+}
+
+void pool_parallel_for(ThreadPool* pool, size_t count, size_t chunk_size, PoolTask task,
+                       void* ctx)
+{
+    if (count == 0)
+        return;
+
+    chunk_size = MAX(chunk_size, 1);
+
+    if (pool == NULL || pool->thread_count == 0 || count <= chunk_size)
+    {
+        task(ctx, 0, count, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->task = task;
+    pool->ctx = ctx;
+    pool->count = count;
+    pool->chunk_size = chunk_size;
+    atomic_store(&pool->next, 0);
+    pool->busy = pool->thread_count;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    run_chunks(pool, 0);
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->busy > 0)
+        pthread_cond_wait(&pool->done_cond, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
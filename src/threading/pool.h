@@ -0,0 +1,37 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+/// A task run by `pool_parallel_for()`, for the items from `start` up to (but not including)
+/// `end`. `worker` is the index of the thread running it, from 0 up to `pool_thread_count()`, so
+/// it can be used to pick per-thread scratch memory.
+typedef void (*PoolTask)(void* ctx, size_t start, size_t end, size_t worker);
+
+/// A fixed set of worker threads that split loops between them.
+/// The calling thread of `pool_parallel_for()` works along with the pool threads.
+typedef struct ThreadPool ThreadPool;
+
+/// Create a pool with `thread_count` threads in total (including the calling thread), or one per
+/// CPU if `thread_count` is 0.
+/// The caller is responsible for freeing the pool with `pool_free()`
+ThreadPool* pool_create(size_t thread_count);
+
+/// Stop the threads of the pool and free it. Does nothing if the pool is NULL
+void pool_free(ThreadPool* pool);
+
+/// The amount of threads that work on a loop, including the calling thread. 1 for a NULL pool
+size_t pool_thread_count(const ThreadPool* pool);
+
+/// The amount of CPUs of the machine
+size_t pool_cpu_count(void);
+
+/// Run `task` over the items 0 up to `count` and wait for it to finish.
+///
+/// The items are handed out in chunks of `chunk_size` to whichever thread is free, so threads
+/// that get cheap chunks take more of them. A NULL pool runs everything on the calling thread.
+/// Loops on the same pool must not overlap, and a task must not start a loop on its own pool.
+void pool_parallel_for(ThreadPool* pool, size_t count, size_t chunk_size, PoolTask task,
+                       void* ctx);
+
+#endif // POOL_H
@@ -2,6 +2,9 @@
 
 #include "../Debug/Logger.h"
 #include "../dyn.h"
+#include "../risk/fire_field.h"
+#include "../spatial/fire_index.h"
+#include "../spatial/rtree.h"
 
 #include <math.h>
 #include <pthread.h>
@@ -151,7 +154,20 @@ int scaled_height()
 unsigned int selectedCmd = 0;
 RoadSegSlice current_roads;
 FireSlice current_fires;
-VegSlice current_vegetation;
+VegGrid current_vegetation;
+
+// Spatial index over the segments of current_roads, used to find the roads under grid cells
+RTree roadTree;
+Projection roadTreeProjection;
+RTreeSegVec roadTreeResults;
+// Spatial index over current_fires
+FireIndex fireIndex;
+// Distance to the nearest fire over the viewport, shown instead of the vegetation when enabled
+FireField fireField;
+bool showFireDistance = false;
+// The fire arrival lines over the viewport: one more than the level of the earliest line through
+// each cell, or 0 for none
+uint8_t isochroneCells[VIEWPORT_HEIGHT][VIEWPORT_WIDTH];
 
 typedef struct
 {
@@ -369,6 +385,45 @@ LCoord get_cursor_pos()
 }
 
 
+/// Mark the cells of the viewport a line passes through, in steps of at most half a cell
+static void mark_isochrone_line(const Isochrone* line)
+{
+    for (size_t i = 0; i + 1 < line->points.len; i++)
+    {
+        const LCoord a = global_to_local_exact(line->points.items[i], globalBounds,
+                                               VIEWPORT_HEIGHT, VIEWPORT_WIDTH);
+        const LCoord b = global_to_local_exact(line->points.items[i + 1], globalBounds,
+                                               VIEWPORT_HEIGHT, VIEWPORT_WIDTH);
+        const int steps = (int)ceil(MAX(fabs(b.x - a.x), fabs(b.y - a.y)) * 2) + 1;
+        for (int s = 0; s <= steps; s++)
+        {
+            const double t = (double)s / steps;
+            const double x = floor(a.x + (b.x - a.x) * t);
+            const double y = floor(a.y + (b.y - a.y) * t);
+            if (x < 0 || y < 0 || x >= VIEWPORT_WIDTH || y >= VIEWPORT_HEIGHT)
+                continue;
+
+            uint8_t* cell = &isochroneCells[(int)y][(int)x];
+            if (*cell == 0 || *cell > line->level + 1)
+                *cell = (uint8_t)MIN(line->level + 1, UINT8_MAX);
+        }
+    }
+}
+
+void set_isochrones(IsochroneVec lines)
+{
+    memset(isochroneCells, 0, sizeof(isochroneCells));
+    for (size_t i = 0; i < lines.len; i++)
+        mark_isochrone_line(&lines.items[i]);
+}
+
+/// Get one more than the level of the earliest line through a cell of the viewport, or 0
+static uint8_t isochrone_at(LCoord point)
+{
+    return isochroneCells[MIN((int)point.y, VIEWPORT_HEIGHT - 1)]
+                         [MIN((int)point.x, VIEWPORT_WIDTH - 1)];
+}
+
 void set_bounding_box(BoundBox box)
 {
     globalBounds = box;
@@ -423,66 +478,64 @@ double get_point_dist_to_road(LCoord n1, LCoord n2, LCoord p, double tolerance)
     return numerator / denominator;
 }
 
-RoadSeg* get_road_seg_at(RoadSegSlice road_data, LCoord point, double tolerance)
+/// Get the index of the first road in `current_roads` that is within `tolerance` grid cells of the
+/// point, or -1 if there is none
+long get_road_idx_at(LCoord point, double tolerance)
 {
-    RoadSegSlice roads = road_data;
-
-    for (size_t i = 0; i < roads.len; i++)
+    // Find the segments around the point in the road index. The grid snaps nodes down to whole
+    // cells, so the search is widened by one cell to not miss any.
+    const double margin = tolerance + 1;
+    const LCoord lc1 = {.x = point.x - margin, .y = point.y - margin};
+    const LCoord lc2 = {.x = point.x + margin, .y = point.y + margin};
+    const MCoord mc1 = project_coord(
+        local_to_global(lc1, globalBounds, VIEWPORT_HEIGHT, VIEWPORT_WIDTH), roadTreeProjection);
+    const MCoord mc2 = project_coord(
+        local_to_global(lc2, globalBounds, VIEWPORT_HEIGHT, VIEWPORT_WIDTH), roadTreeProjection);
+    const MRect rect = {
+        .min_x = MIN(mc1.x, mc2.x),
+        .min_y = MIN(mc1.y, mc2.y),
+        .max_x = MAX(mc1.x, mc2.x),
+        .max_y = MAX(mc1.y, mc2.y),
+    };
+
+    vec_empty(&roadTreeResults);
+    rtree_query_rect(&roadTree, rect, &roadTreeResults);
+
+    // Pick the lowest road index that is actually hit, so overlapping roads are resolved the same
+    // way as when every road was checked in order
+    long roadIdx = -1;
+    for (size_t i = 0; i < roadTreeResults.len; i++)
     {
-        NodeSlice nodes = roads.items[i].nodes;
+        const RTreeSeg seg = roadTreeResults.items[i];
+        if (roadIdx >= 0 && seg.road >= (size_t)roadIdx)
+            continue;
 
-        for (size_t j = 0; j < nodes.len; j++)
-        {
-            if (j >= nodes.len - 1)
-                break;
+        NodeSlice nodes = current_roads.items[seg.road].nodes;
 
-            RoadNode node1 = nodes.items[j];
-            LCoord node1LCoord =
-                global_to_local(node1.coords, globalBounds, VIEWPORT_HEIGHT, VIEWPORT_WIDTH);
-            RoadNode node2 = nodes.items[j + 1];
-            LCoord node2LCoord =
-                global_to_local(node2.coords, globalBounds, VIEWPORT_HEIGHT, VIEWPORT_WIDTH);
+        RoadNode node1 = nodes.items[seg.seg];
+        LCoord node1LCoord = global_to_local(gcoord_load(node1.coords), globalBounds,
+                                             VIEWPORT_HEIGHT, VIEWPORT_WIDTH);
+        RoadNode node2 = nodes.items[seg.seg + 1];
+        LCoord node2LCoord = global_to_local(gcoord_load(node2.coords), globalBounds,
+                                             VIEWPORT_HEIGHT, VIEWPORT_WIDTH);
 
 
-            double dist = get_point_dist_to_road(node1LCoord, node2LCoord, point, tolerance);
+        double dist = get_point_dist_to_road(node1LCoord, node2LCoord, point, tolerance);
 
-            if (dist >= -tolerance && dist <= tolerance)
-                return &roads.items[i];
-        }
+        if (dist >= -tolerance && dist <= tolerance)
+            roadIdx = (long)seg.road;
     }
 
-    return NULL;
+    return roadIdx;
 }
 
-bool road_has_road_at(RoadSegSlice road_data, LCoord point, double tolerance)
+RoadSeg* get_road_seg_at(LCoord point, double tolerance)
 {
-    RoadSegSlice roads = road_data;
+    const long roadIdx = get_road_idx_at(point, tolerance);
+    if (roadIdx < 0)
+        return NULL;
 
-    for (size_t i = 0; i < roads.len; i++)
-    {
-        NodeSlice nodes = roads.items[i].nodes;
-
-        for (size_t j = 0; j < nodes.len; j++)
-        {
-            if (j >= nodes.len - 1)
-                break;
-
-            RoadNode node1 = nodes.items[j];
-            LCoord node1LCoord =
-                global_to_local(node1.coords, globalBounds, VIEWPORT_HEIGHT, VIEWPORT_WIDTH);
-            RoadNode node2 = nodes.items[j + 1];
-            LCoord node2LCoord =
-                global_to_local(node2.coords, globalBounds, VIEWPORT_HEIGHT, VIEWPORT_WIDTH);
-
-
-            double dist = get_point_dist_to_road(node1LCoord, node2LCoord, point, tolerance);
-
-            if (dist >= -tolerance && dist <= tolerance)
-                return true;
-        }
-    }
-
-    return false;
+    return &current_roads.items[roadIdx];
 }
 
 bool fire_has_fire_at(FireSlice fire_data, LCoord point, double tolerance)
@@ -498,41 +551,6 @@ bool fire_has_fire_at(FireSlice fire_data, LCoord point, double tolerance)
     return false;
 }
 
-int get_road_risk(RoadSegSlice road_data, LCoord point, double tolerance)
-{
-    RoadSegSlice roads = road_data;
-
-    for (size_t i = 0; i < roads.len; i++)
-    {
-        NodeSlice nodes = roads.items[i].nodes;
-
-        for (size_t j = 0; j < nodes.len; j++)
-        {
-            if (j >= nodes.len - 1)
-                break;
-
-            RoadNode node1 = nodes.items[j];
-            LCoord node1LCoord =
-                global_to_local(node1.coords, globalBounds, VIEWPORT_HEIGHT, VIEWPORT_WIDTH);
-            RoadNode node2 = nodes.items[j + 1];
-            LCoord node2LCoord =
-                global_to_local(node2.coords, globalBounds, VIEWPORT_HEIGHT, VIEWPORT_WIDTH);
-
-
-            double dist = get_point_dist_to_road(node1LCoord, node2LCoord, point, tolerance);
-
-            if (dist >= -tolerance && dist <= tolerance)
-            {
-                debug_log(MESSAGE, "risk is: %d with the id: %d", roads.items[i].risk,
-                          roads.items[i].id);
-                return roads.items[i].risk;
-            }
-        }
-    }
-
-    return -1;
-}
-
 void grid_str_append_color_background(String* str, const char* chs, char* color)
 {
     static char* previousColor = "";
@@ -557,6 +575,13 @@ void grid_str_append_color(String* str, const char* chs, char* color)
 
 LCoord selectedCoord = (LCoord){.x = -1, .y = -1};
 
+long get_selected_road_idx()
+{
+    if (selectedCoord.x < 0 || selectedCoord.y < 0)
+        return -1;
+    return get_road_idx_at(selectedCoord, 1);
+}
+
 void draw_grid()
 {
     static size_t localRoadId = -1;
@@ -567,15 +592,6 @@ void draw_grid()
     String gridContent = str_from("");
     fast_print("\033[2;2H");
 
-    VegType max_type = VEG_NONE;
-    for (size_t i = 0; i < current_vegetation.len; i++)
-    {
-        if (current_vegetation.items[i].type >= max_type)
-            max_type = current_vegetation.items[i].type;
-    }
-    debug_log(MESSAGE, "MAX VEGETATION TYPE BEFORE DRAW_GRID: %d", max_type);
-
-
     int blueCount = 0;
     const int h = scaled_vHeight();
     const int w = scaled_vWidth();
@@ -586,8 +602,8 @@ void draw_grid()
         {
             const double tolerance = 1.0;
             const LCoord lCoord = (LCoord){.x = (x / prctDiff.x), .y = (y / prctDiff.y)};
-            const bool isRoad = road_has_road_at(current_roads, lCoord, tolerance);
-            const RoadSeg* roadSeg = get_road_seg_at(current_roads, lCoord, tolerance);
+            const RoadSeg* roadSeg = get_road_seg_at(lCoord, tolerance);
+            const bool isRoad = roadSeg != NULL;
             if (!isRoad)
                 grid_str_append_color(&gridContent, "", ANSI_NONE_BACKGROUND);
             const bool isFire = fire_has_fire_at(current_fires, lCoord, tolerance);
@@ -615,7 +631,7 @@ void draw_grid()
             {
                 char* ANSI_CODE;
 
-                const int risk = get_road_risk(current_roads, lCoord, tolerance);
+                const int risk = roadSeg->risk;
                 blueCount++;
 
                 if (risk > RISK_THRESHOLD_MEDIUM)
@@ -647,13 +663,40 @@ void draw_grid()
                                           roadSeg->id != localRoadId ? frontColor : ANSI_BLUE);
                 }
             }
+            else if (isochrone_at(lCoord) != 0)
+            {
+                // The earliest line is the most urgent
+                char* lineColor = ANSI_YELLOW;
+                if (isochrone_at(lCoord) == 1)
+                    lineColor = ANSI_RED;
+                else if (isochrone_at(lCoord) == 2)
+                    lineColor = ANSI_ORANGE;
+                grid_str_append_color(&gridContent, GRID_BLOCK_DARK, lineColor);
+                str_append(&gridContent, GRID_BLOCK_DARK);
+            }
+            else if (showFireDistance)
+            {
+                const MCoord mCoord = project_coord(
+                    local_to_global(lCoord, globalBounds, VIEWPORT_HEIGHT, VIEWPORT_WIDTH),
+                    roadTreeProjection);
+                const double fireDst = fire_field_dst(&fireField, mCoord);
+
+                char* dstColor = ANSI_GREEN;
+                if (fireDst < FIRE_DISTANCE_NEAR)
+                    dstColor = ANSI_RED;
+                else if (fireDst < FIRE_DISTANCE_MEDIUM)
+                    dstColor = ANSI_ORANGE;
+                else if (fireDst < FIRE_DISTANCE_FAR)
+                    dstColor = ANSI_YELLOW;
+                grid_str_append_color(&gridContent, GRID_BLOCK_MEDIUM, dstColor);
+                str_append(&gridContent, GRID_BLOCK_MEDIUM);
+            }
             else
             {
                 char* vegColor = ANSI_NORMAL;
                 VegType veg_type = VEG_NONE;
                 // GCoord gCoord = local_to_global(lCoord, globalBounds, vHeight, vWidth);
-                if (coord_has_vegetation(lCoord, &veg_type, current_vegetation, tolerance,
-                                         globalBounds, VIEWPORT_WIDTH, VIEWPORT_HEIGHT))
+                if (veg_grid_lookup(&current_vegetation, lCoord, &veg_type))
                 {
                     switch (veg_type)
                     {
@@ -927,7 +970,7 @@ void draw_console()
     pthread_mutex_unlock(&mutex);
 }
 
-void draw_current_state(RoadSegSlice roads, FireSlice fires, VegSlice vegetation)
+void draw_current_state(RoadSegSlice roads, FireSlice fires, VegGrid vegetation)
 {
     if (fires.len <= 0)
     {
@@ -939,15 +982,35 @@ void draw_current_state(RoadSegSlice roads, FireSlice fires, VegSlice vegetation
         debug_log(ERROR, "Roads is empty!");
         assert(roads.len > 0);
     }
-    if (vegetation.len <= 0)
+    if (vegetation.width * vegetation.height <= 0)
     {
         debug_log(ERROR, "Vegetation is empty!");
-        assert(vegetation.len > 0);
+        assert(vegetation.width * vegetation.height > 0);
     }
 
     current_roads = roads;
     current_fires = fires;
     current_vegetation = vegetation;
+
+    rtree_free(&roadTree);
+    roadTree = rtree_from_roads(roads);
+    roadTreeProjection = projection_from_bbox(globalBounds);
+    fire_index_free(&fireIndex);
+    fireIndex = fire_index_from_fires(fires);
+
+    // One field cell per viewport cell is all the grid can show
+    const MCoord corner1 = project_coord(globalBounds.c1, roadTreeProjection);
+    const MCoord corner2 = project_coord(globalBounds.c2, roadTreeProjection);
+    const MRect viewRect = {
+        .min_x = MIN(corner1.x, corner2.x),
+        .min_y = MIN(corner1.y, corner2.y),
+        .max_x = MAX(corner1.x, corner2.x),
+        .max_y = MAX(corner1.y, corner2.y),
+    };
+    fire_field_free(&fireField);
+    const double cellSize = (viewRect.max_x - viewRect.min_x) / VIEWPORT_WIDTH;
+    fireField = fire_field_create(fires, viewRect, cellSize, NULL);
+
     draw_console();
 
     // LCoord lc = global_to_local(globalBounds.c2, globalBounds, scaled_vHeight(),
@@ -957,6 +1020,12 @@ void draw_current_state(RoadSegSlice roads, FireSlice fires, VegSlice vegetation
     //                  globalBounds.c2.lon, gc.lat, gc.lon);
 }
 
+void toggle_fire_distance()
+{
+    showFireDistance = !showFireDistance;
+    draw_grid();
+}
+
 void write_to_textbox(const char* format, ...)
 {
     va_list args;
@@ -1090,8 +1159,7 @@ void execute_command()
 
                 VegType veg_type = VEG_NONE;
                 char* vegTypeName = "UNKNOWN";
-                if (coord_has_vegetation(lCoord, &veg_type, current_vegetation, 1, globalBounds,
-                                         VIEWPORT_WIDTH, VIEWPORT_HEIGHT))
+                if (veg_grid_lookup(&current_vegetation, lCoord, &veg_type))
                 {
                     switch (veg_type)
                     {
@@ -1129,19 +1197,12 @@ void execute_command()
                 }
                 str_appendf(&infoText, "Vegetation type: %s\n", vegTypeName);
 
-                RoadSeg* seg = get_road_seg_at(current_roads, lCoord, 1);
+                RoadSeg* seg = get_road_seg_at(lCoord, 1);
                 if (seg != NULL)
                 {
                     double roadLength = GetRoadLength(*seg);
                     double closestFire = INFINITY;
-                    for (int i = 0; i < current_fires.len; i++)
-                    {
-                        double dst = get_fire_dst_to_road(*seg, current_fires.items[i]);
-                        if (dst < closestFire)
-                        {
-                            closestFire = dst;
-                        }
-                    }
+                    fire_index_nearest_to_road(&fireIndex, *seg, &closestFire);
                     char* riskMsg = "Low";
                     if (seg->risk > RISK_THRESHOLD_HIGH)
                         riskMsg = "High";
@@ -5,6 +5,7 @@
 #include "../models/geo.h"
 #include "../models/road.h"
 #include "../models/vegetation.h"
+#include "../simulation/isochrone.h"
 
 #define VIEWPORT_HEIGHT 50
 #define VIEWPORT_WIDTH 50
@@ -16,8 +17,15 @@
 #define CONSOLE_TARGET_HEIGHT 63
 #define CONSOLE_TARGET_WIDTH 237
 
-#define RISK_THRESHOLD_MEDIUM 1
-#define RISK_THRESHOLD_HIGH 10
+// Road risks above which a road counts as medium and high risk. They are set for an exposure that
+// is the time to safety over the road network, see `assess_roads()`
+#define RISK_THRESHOLD_MEDIUM 3
+#define RISK_THRESHOLD_HIGH 30
+
+// Distances to the nearest fire in metres, for the fire distance overlay
+#define FIRE_DISTANCE_NEAR 1000
+#define FIRE_DISTANCE_MEDIUM 3000
+#define FIRE_DISTANCE_FAR 6000
 
 // Escape codes
 #define ENABLE_MOUSE_INPUT_ANSI "\e[?1000;1006;1015h"
@@ -75,9 +83,17 @@ void save_state_to_image(const char* path, size_t size, RoadSegSlice roads, Fire
 
 void save_veg_to_image(const char* path, size_t size, VegSlice vegetation, BoundBox bbox);
 
-void draw_current_state(RoadSegSlice roads, FireSlice fires, VegSlice vegetation);
+void draw_current_state(RoadSegSlice roads, FireSlice fires, VegGrid vegetation);
 /// Refreshes the console, and redraws everything
 void draw_console();
+
+/// Switch the grid between showing the vegetation and the distance to the nearest fire
+void toggle_fire_distance();
+/// Get the index of the road at the cell last clicked on the grid, or -1 if there is none
+long get_selected_road_idx();
+/// Draw the fire arrival lines over the grid, replacing the ones drawn before. The lines are copied
+/// onto the cells of the grid, so they can be freed afterwards
+void set_isochrones(IsochroneVec lines);
 /// This changes the content of the textbox that is displayed besides the gridmap
 void write_to_textbox(const char*, ...);
 